@@ -0,0 +1,765 @@
+/* Benchmarks of zvar, meant to track performance between versions.
+ *
+ * Runs without a window system or GPU, on lavapipe through VK_EXT_headless_surface.
+ *
+ * Building from the repository root, with volk checked out into volk/:
+ *     cc -std=c11 -O2 -I. bench/zvar_bench.c zvar.c volk/volk.c -ldl -lpthread -o zvar_bench
+ *
+ * Running on lavapipe:
+ *     VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./zvar_bench [--csv] [--iterations-scale N] [output]
+ *
+ * Results go to `output`, zvar_bench.json or zvar_bench.csv by default, stdout is left to zvar.
+ * Every benchmark reports min, p50, p90, p99, max and mean in nanoseconds per iteration,
+ * the ones moving data also report bytes per second at the median.
+ */
+
+// NOTE: clock_gettime is POSIX, not C11.
+#ifndef _POSIX_C_SOURCE
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "zvar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+void zvar_error(char *message)
+{
+    fprintf(stderr, "zvar: %s\n", message);
+    exit(1);
+}
+
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+/* results */
+
+#define BENCH_MAX_SAMPLES 16384
+#define BENCH_MAX_RESULTS 32
+
+typedef struct
+{
+    const char *name;
+    uint32_t iterations;
+    uint64_t min_ns, p50_ns, p90_ns, p99_ns, max_ns;
+    double mean_ns;
+    /* Zero when the benchmark moves no data. */
+    double bytes_per_second;
+} bench_result_t;
+
+static uint32_t sample_count;
+static uint64_t samples[BENCH_MAX_SAMPLES];
+
+static uint32_t result_count;
+static bench_result_t results[BENCH_MAX_RESULTS];
+
+static uint32_t iterations_scale = 1;
+
+
+static int bench_compare_samples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static uint32_t bench_iterations(uint32_t iterations)
+{
+    uint64_t scaled = (uint64_t)iterations * iterations_scale;
+
+    return scaled > BENCH_MAX_SAMPLES ? BENCH_MAX_SAMPLES : (uint32_t)scaled;
+}
+
+
+static void bench_begin(void)
+{
+    sample_count = 0;
+}
+
+
+static void bench_sample(uint64_t begin_ns)
+{
+    uint64_t end_ns = bench_time_ns();
+
+    if (sample_count < BENCH_MAX_SAMPLES) {
+        samples[sample_count++] = end_ns - begin_ns;
+    }
+}
+
+
+/* Nearest rank percentile of the sorted samples. */
+static uint64_t bench_percentile(uint32_t percent)
+{
+    uint32_t rank = (uint32_t)(((uint64_t)percent * sample_count + 99) / 100);
+
+    return samples[rank ? rank - 1 : 0];
+}
+
+
+/* `bytes` moved per iteration, zero for none. */
+static void bench_end(const char *name, uint64_t bytes)
+{
+    if (sample_count == 0 || result_count == BENCH_MAX_RESULTS)
+        return;
+
+    qsort(samples, sample_count, sizeof(uint64_t), bench_compare_samples);
+
+    double sum = 0.0;
+    for (uint32_t i = 0; i < sample_count; ++i) {
+        sum += (double)samples[i];
+    }
+
+    bench_result_t *result = &results[result_count++];
+
+    *result = (bench_result_t) {
+        .name       = name,
+        .iterations = sample_count,
+        .min_ns     = samples[0],
+        .p50_ns     = bench_percentile(50),
+        .p90_ns     = bench_percentile(90),
+        .p99_ns     = bench_percentile(99),
+        .max_ns     = samples[sample_count - 1],
+        .mean_ns    = sum / sample_count,
+    };
+
+    if (bytes && result->p50_ns) {
+        result->bytes_per_second = (double)bytes * 1e9 / (double)result->p50_ns;
+    }
+
+    fprintf(stderr, "%-28s %6u iterations, p50 %12llu ns, p99 %12llu ns\n",
+            name, sample_count, (unsigned long long)result->p50_ns, (unsigned long long)result->p99_ns);
+}
+
+
+static bool bench_write_results(const char *path, bool csv)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    if (csv) {
+        fprintf(file, "name,iterations,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,bytes_per_second\n");
+
+        for (uint32_t i = 0; i < result_count; ++i) {
+            bench_result_t *r = &results[i];
+
+            fprintf(file, "%s,%u,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f\n",
+                    r->name, r->iterations,
+                    (unsigned long long)r->min_ns, (unsigned long long)r->p50_ns, (unsigned long long)r->p90_ns,
+                    (unsigned long long)r->p99_ns, (unsigned long long)r->max_ns,
+                    r->mean_ns, r->bytes_per_second);
+        }
+    }
+    else {
+        fprintf(file, "{\n  \"results\": [\n");
+
+        for (uint32_t i = 0; i < result_count; ++i) {
+            bench_result_t *r = &results[i];
+
+            fprintf(file, "    {\"name\": \"%s\", \"iterations\": %u, \"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+                          "\"p99_ns\": %llu, \"max_ns\": %llu, \"mean_ns\": %.1f, \"bytes_per_second\": %.1f}%s\n",
+                    r->name, r->iterations,
+                    (unsigned long long)r->min_ns, (unsigned long long)r->p50_ns, (unsigned long long)r->p90_ns,
+                    (unsigned long long)r->p99_ns, (unsigned long long)r->max_ns,
+                    r->mean_ns, r->bytes_per_second,
+                    i + 1 < result_count ? "," : "");
+        }
+
+        fprintf(file, "  ]\n}\n");
+    }
+
+    return fclose(file) == 0;
+}
+
+
+/* vulkan setup */
+
+static char *instance_extensions[] = {
+    VK_KHR_SURFACE_EXTENSION_NAME,
+    VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME,
+};
+
+static zvar_instance_create_info_t instance_info = {
+    .minimum_version = VK_API_VERSION_1_0,
+
+    .application_name = "zvar_bench",
+    .engine_name = "zvar",
+
+    .required_instance_extension_count = sizeof(instance_extensions) / sizeof(*instance_extensions),
+    .required_instance_extensions = instance_extensions,
+
+    .headless = true,
+};
+
+static char *device_extensions[] = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+};
+
+static VkSurfaceKHR bench_create_surface(VkInstance instance)
+{
+    VkHeadlessSurfaceCreateInfoEXT surface_info = {
+        .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+    };
+
+    VkSurfaceKHR surface;
+    ZVAR_CHECK(vkCreateHeadlessSurfaceEXT(instance, &surface_info, zvar_get_instance_allocation_callbacks(instance), &surface));
+
+    return surface;
+}
+
+
+static VkRenderPass bench_create_render_pass(VkDevice device, VkFormat color_format, VkFormat depth_format)
+{
+    VkAttachmentDescription attachments[] = {
+        {
+            .format         = color_format,
+            .samples        = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp        = VK_ATTACHMENT_STORE_OP_STORE,
+            .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        },
+        {
+            .format         = depth_format,
+            .samples        = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        },
+    };
+
+    VkAttachmentReference color_reference = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference depth_reference = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+    VkSubpassDescription subpass = {
+        .pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount    = 1,
+        .pColorAttachments       = &color_reference,
+        .pDepthStencilAttachment = &depth_reference,
+    };
+
+    VkRenderPassCreateInfo render_pass_info = {
+        .sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = 2,
+        .pAttachments    = attachments,
+        .subpassCount    = 1,
+        .pSubpasses      = &subpass,
+    };
+
+    VkRenderPass render_pass;
+    ZVAR_CHECK(vkCreateRenderPass(device, &render_pass_info, zvar_get_device_allocation_callbacks(device), &render_pass));
+
+    return render_pass;
+}
+
+
+/* benchmarks */
+
+static void bench_instance_creation(void)
+{
+    uint32_t iterations = bench_iterations(20);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        VkInstance instance = zvar_create_instance(&instance_info);
+        if (instance == VK_NULL_HANDLE)
+            zvar_error("Failed to create an instance");
+
+        zvar_destroy_instance(instance);
+
+        bench_sample(begin_ns);
+    }
+    bench_end("instance_create_destroy", 0);
+}
+
+
+static void bench_device_creation(const zvar_device_create_info_t *device_info)
+{
+    uint32_t iterations = bench_iterations(20);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        uint32_t graphics_index, compute_index, transfer_index;
+        VkDevice device = zvar_create_device(device_info, &graphics_index, &compute_index, &transfer_index);
+        if (device == VK_NULL_HANDLE)
+            zvar_error("Failed to create a device");
+
+        zvar_destroy_device(device);
+
+        bench_sample(begin_ns);
+    }
+    bench_end("device_create_destroy", 0);
+}
+
+
+static void bench_format_queries(const zvar_surface_format_info_t *surface_format_info, const zvar_depth_format_info_t *depth_format_info)
+{
+    uint32_t iterations = bench_iterations(1000);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+        zvar_find_surface_format(surface_format_info);
+        bench_sample(begin_ns);
+    }
+    bench_end("find_surface_format", 0);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+        zvar_find_depth_format(depth_format_info);
+        bench_sample(begin_ns);
+    }
+    bench_end("find_depth_format", 0);
+}
+
+
+#define BENCH_MAX_SWAPCHAIN_IMAGES 8
+
+typedef struct
+{
+    VkSwapchainKHR swapchain;
+    uint32_t width, height;
+    uint32_t image_count;
+    VkImage images[BENCH_MAX_SWAPCHAIN_IMAGES];
+    VkImageView views[BENCH_MAX_SWAPCHAIN_IMAGES];
+    VkFramebuffer framebuffers[BENCH_MAX_SWAPCHAIN_IMAGES];
+    VkImage color_image;
+    VkImageView color_view;
+    VkImage depth_image;
+    VkDeviceMemory depth_memory;
+    VkDeviceSize depth_memory_size;
+    VkImageView depth_view;
+} bench_clique_t;
+
+static bool bench_create_clique(const zvar_swapchain_create_info_t *info, bench_clique_t *clique, uint32_t width, uint32_t height)
+{
+    clique->width  = width;
+    clique->height = height;
+
+    if (info->render_pass == VK_NULL_HANDLE) {
+        return zvar_create_dynamic_swapchain_clique(info, &clique->swapchain, &clique->width, &clique->height, &clique->image_count, clique->images, clique->views,
+                                                    &clique->color_image, &clique->color_view,
+                                                    &clique->depth_image, &clique->depth_memory, &clique->depth_memory_size, &clique->depth_view);
+    }
+
+    return zvar_create_swapchain_clique(info, &clique->swapchain, &clique->width, &clique->height, &clique->image_count, clique->views, clique->framebuffers,
+                                        &clique->color_image, &clique->color_view,
+                                        &clique->depth_image, &clique->depth_memory, &clique->depth_memory_size, &clique->depth_view);
+}
+
+
+static void bench_destroy_clique(VkDevice device, bench_clique_t *clique)
+{
+    const VkAllocationCallbacks *allocation_callbacks = zvar_get_device_allocation_callbacks(device);
+
+    for (uint32_t i = 0; i < clique->image_count; ++i) {
+        vkDestroyFramebuffer(device, clique->framebuffers[i], allocation_callbacks);
+        vkDestroyImageView(device, clique->views[i], allocation_callbacks);
+    }
+
+    if (clique->color_image != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, clique->color_view, allocation_callbacks);
+        vkDestroyImage(device, clique->color_image, allocation_callbacks);
+    }
+
+    vkDestroyImageView(device, clique->depth_view, allocation_callbacks);
+    vkDestroyImage(device, clique->depth_image, allocation_callbacks);
+    vkFreeMemory(device, clique->depth_memory, allocation_callbacks);
+    vkDestroySwapchainKHR(device, clique->swapchain, allocation_callbacks);
+
+    *clique = (bench_clique_t) {0};
+}
+
+
+/* Without a render pass the dynamic rendering clique is measured. */
+static void bench_clique_creation(const zvar_swapchain_create_info_t *swapchain_info, const char *create_name, const char *recreate_name)
+{
+    uint32_t iterations = bench_iterations(20);
+    bench_clique_t clique = {0};
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        if (!bench_create_clique(swapchain_info, &clique, 1280, 720))
+            zvar_error("Failed to create a swapchain clique");
+
+        bench_sample(begin_ns);
+
+        bench_destroy_clique(swapchain_info->device, &clique);
+    }
+    bench_end(create_name, 0);
+
+    if (!bench_create_clique(swapchain_info, &clique, 1280, 720))
+        zvar_error("Failed to create a swapchain clique");
+
+    // NOTE: Alternates between two sizes below the depth reserve, the steady state of a window being resized.
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        if (!bench_create_clique(swapchain_info, &clique, i & 1 ? 1280 : 1024, i & 1 ? 720 : 576))
+            zvar_error("Failed to recreate a swapchain clique");
+
+        bench_sample(begin_ns);
+    }
+    bench_end(recreate_name, 0);
+
+    bench_destroy_clique(swapchain_info->device, &clique);
+}
+
+
+static void bench_one_off_submission(VkDevice device, VkQueue queue, uint32_t queue_family_index)
+{
+    uint32_t iterations = bench_iterations(200);
+    VkCommandPool command_pool = zvar_create_command_pool(device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queue_family_index);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        VkCommandBuffer command_buffer = zvar_begin_one_off_command_buffer(device, command_pool);
+        zvar_finish_one_off_command_buffer(device, command_pool, queue, command_buffer);
+
+        bench_sample(begin_ns);
+    }
+    bench_end("one_off_submit_latency", 0);
+
+    vkDestroyCommandPool(device, command_pool, zvar_get_device_allocation_callbacks(device));
+}
+
+
+#define BENCH_SUBALLOCATION_COUNT 256
+
+#define BENCH_RECORDING_JOBS      256
+#define BENCH_COMMANDS_PER_JOB    64
+
+static void bench_record_job(VkCommandBuffer command_buffer, uint32_t worker_index, void *user_data)
+{
+    (void)worker_index;
+    (void)user_data;
+
+    VkRect2D scissor = { .extent = { 1280, 720 } };
+
+    for (uint32_t i = 0; i < BENCH_COMMANDS_PER_JOB; ++i) {
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    }
+}
+
+
+/* Records small secondaries, zero workers means one per logical processor. */
+static void bench_parallel_recording(VkDevice device, uint32_t queue_family_index, uint32_t worker_count, const char *name)
+{
+    uint32_t iterations = bench_iterations(100);
+
+    zvar_parallel_recorder_create_info_t recorder_info = {
+        .device = device,
+        .queue_family_index = queue_family_index,
+        .worker_count = worker_count,
+    };
+
+    zvar_parallel_recorder_t recorder;
+    zvar_create_parallel_recorder(&recorder_info, &recorder);
+
+    static zvar_recording_job_t jobs[BENCH_RECORDING_JOBS];
+
+    for (uint32_t i = 0; i < BENCH_RECORDING_JOBS; ++i) {
+        jobs[i] = (zvar_recording_job_t) { .record = bench_record_job };
+    }
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        zvar_begin_recording_frame(&recorder, i % recorder.frame_count);
+
+        uint64_t begin_ns = bench_time_ns();
+
+        zvar_record_parallel(&recorder, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, &(VkCommandBufferInheritanceInfo) {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        }, BENCH_RECORDING_JOBS, jobs);
+
+        bench_sample(begin_ns);
+    }
+    bench_end(name, 0);
+
+    zvar_destroy_parallel_recorder(&recorder);
+}
+
+
+static void bench_memory_allocation(VkDevice device, VkPhysicalDevice physical_device, VkPhysicalDeviceMemoryProperties *memory_properties)
+{
+    const VkAllocationCallbacks *allocation_callbacks = zvar_get_device_allocation_callbacks(device);
+
+    VkDeviceSize allocation_size = 1024 * 1024;
+    int32_t memory_type = zvar_find_memory_type(memory_properties, ~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (memory_type < 0)
+        zvar_error("No device local memory type");
+
+    uint32_t iterations = bench_iterations(200);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        VkDeviceMemory memory = zvar_allocate_memory(device, (uint32_t)memory_type, allocation_size);
+        vkFreeMemory(device, memory, allocation_callbacks);
+
+        bench_sample(begin_ns);
+    }
+    bench_end("allocate_memory_1m", allocation_size);
+
+    zvar_allocator_t allocator;
+    zvar_allocator_create_info_t allocator_info = {
+        .device = device,
+        .physical_device = physical_device,
+    };
+
+    if (!zvar_create_allocator(&allocator_info, &allocator))
+        zvar_error("Failed to create an allocator");
+
+    // NOTE: Every iteration fills a batch of mixed sizes and frees every other one first, so the free lists get exercised.
+    static zvar_allocation_t allocations[BENCH_SUBALLOCATION_COUNT];
+    iterations = bench_iterations(100);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        for (uint32_t j = 0; j < BENCH_SUBALLOCATION_COUNT; ++j) {
+            VkMemoryRequirements requirements = {
+                .size           = 256ull << (j % 8),
+                .alignment      = 256,
+                .memoryTypeBits = 1u << memory_type,
+            };
+
+            if (!zvar_suballocate_memory(&allocator, &requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, &allocations[j]))
+                zvar_error("Failed to suballocate memory");
+        }
+
+        for (uint32_t j = 0; j < BENCH_SUBALLOCATION_COUNT; j += 2) {
+            zvar_free_suballocation(&allocator, &allocations[j]);
+        }
+        for (uint32_t j = 1; j < BENCH_SUBALLOCATION_COUNT; j += 2) {
+            zvar_free_suballocation(&allocator, &allocations[j]);
+        }
+
+        bench_sample(begin_ns);
+    }
+    bench_end("suballocate_free_256", 0);
+
+    zvar_destroy_allocator(&allocator);
+}
+
+
+static void bench_upload_bandwidth(VkDevice device, VkQueue queue, uint32_t queue_family_index, VkPhysicalDeviceMemoryProperties *memory_properties)
+{
+    const VkAllocationCallbacks *allocation_callbacks = zvar_get_device_allocation_callbacks(device);
+    VkDeviceSize size = 64ull * 1024 * 1024;
+
+    VkBuffer staging = zvar_create_buffer_exclusive(device, 0, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    VkBuffer target  = zvar_create_buffer_exclusive(device, 0, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+    VkMemoryRequirements staging_requirements = zvar_get_buffer_memory_requirements(device, staging);
+    VkMemoryRequirements target_requirements  = zvar_get_buffer_memory_requirements(device, target);
+
+    int32_t staging_type = zvar_find_memory_type(memory_properties, staging_requirements.memoryTypeBits,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    int32_t target_type  = zvar_find_memory_type(memory_properties, target_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (staging_type < 0 || target_type < 0)
+        zvar_error("No memory type for the upload buffers");
+
+    VkDeviceMemory staging_memory = zvar_allocate_memory(device, (uint32_t)staging_type, staging_requirements.size);
+    VkDeviceMemory target_memory  = zvar_allocate_memory(device, (uint32_t)target_type, target_requirements.size);
+
+    ZVAR_CHECK(vkBindBufferMemory(device, staging, staging_memory, 0));
+    ZVAR_CHECK(vkBindBufferMemory(device, target, target_memory, 0));
+
+    void *mapped;
+    ZVAR_CHECK(vkMapMemory(device, staging_memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    memset(mapped, 0xAB, size);
+
+    zvar_upload_context_t upload_context;
+    zvar_upload_context_create_info_t upload_info = {
+        .device = device,
+        .queue = queue,
+        .queue_family_index = queue_family_index,
+    };
+
+    zvar_create_upload_context(&upload_info, &upload_context);
+
+    uint32_t iterations = bench_iterations(20);
+
+    bench_begin();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t begin_ns = bench_time_ns();
+
+        zvar_upload_buffer(&upload_context, staging, 0, target, 0, size);
+        zvar_wait_for_upload(&upload_context, zvar_submit_uploads(&upload_context));
+
+        bench_sample(begin_ns);
+    }
+    bench_end("upload_buffer_64m", size);
+
+    zvar_destroy_upload_context(&upload_context);
+
+    vkUnmapMemory(device, staging_memory);
+    vkDestroyBuffer(device, staging, allocation_callbacks);
+    vkDestroyBuffer(device, target, allocation_callbacks);
+    vkFreeMemory(device, staging_memory, allocation_callbacks);
+    vkFreeMemory(device, target_memory, allocation_callbacks);
+}
+
+
+int main(int argc, char **argv)
+{
+    bool csv = false;
+    const char *output_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        }
+        else if (strcmp(argv[i], "--iterations-scale") == 0 && i + 1 < argc) {
+            iterations_scale = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (iterations_scale == 0)
+                iterations_scale = 1;
+        }
+        else if (argv[i][0] != '-') {
+            output_path = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [--csv] [--iterations-scale N] [output]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!output_path) {
+        output_path = csv ? "zvar_bench.csv" : "zvar_bench.json";
+    }
+
+    bench_instance_creation();
+
+    VkInstance instance = zvar_create_instance(&instance_info);
+    if (instance == VK_NULL_HANDLE)
+        zvar_error("Failed to create an instance");
+
+    VkSurfaceKHR surface = bench_create_surface(instance);
+    VkPhysicalDevice physical_device = zvar_choose_some_physical_device(instance);
+
+    zvar_device_create_info_t device_info = {
+        .physical_device = physical_device,
+        .surface = surface,
+        .required_device_extension_count = sizeof(device_extensions) / sizeof(*device_extensions),
+        .required_device_extensions = device_extensions,
+    };
+
+    bench_device_creation(&device_info);
+
+    uint32_t graphics_index, compute_index, transfer_index;
+    VkDevice device = zvar_create_device(&device_info, &graphics_index, &compute_index, &transfer_index);
+    if (device == VK_NULL_HANDLE)
+        zvar_error("Failed to create a device");
+
+    VkQueue queue;
+    vkGetDeviceQueue(device, graphics_index, 0, &queue);
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    VkFormat surface_formats[] = {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM};
+    VkColorSpaceKHR color_spaces[] = {VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+
+    zvar_surface_format_info_t surface_format_info = {
+        .physical_device = physical_device,
+        .surface = surface,
+        .supported_surface_format_count = sizeof(surface_formats) / sizeof(*surface_formats),
+        .supported_surface_formats = surface_formats,
+        .supported_surface_color_space_count = sizeof(color_spaces) / sizeof(*color_spaces),
+        .supported_surface_color_spaces = color_spaces,
+    };
+
+    VkFormat depth_formats[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM};
+
+    zvar_depth_format_info_t depth_format_info = {
+        .physical_device = physical_device,
+        .supported_depth_format_count = sizeof(depth_formats) / sizeof(*depth_formats),
+        .supported_depth_formats = depth_formats,
+    };
+
+    bench_format_queries(&surface_format_info, &depth_format_info);
+
+    VkSurfaceFormatKHR surface_format = zvar_find_surface_format(&surface_format_info);
+    VkFormat depth_format = zvar_find_depth_format(&depth_format_info);
+    VkRenderPass render_pass = bench_create_render_pass(device, surface_format.format, depth_format);
+
+    zvar_swapchain_create_info_t swapchain_info = {
+        .device = device,
+        .physical_device = physical_device,
+        .surface = surface,
+        .surface_format = surface_format,
+        .physical_device_memory_properties = &memory_properties,
+        .depth_format = depth_format,
+        .render_pass = render_pass,
+        .prefered_image_count = 3,
+        .maximum_image_count = BENCH_MAX_SWAPCHAIN_IMAGES,
+        .present_mode_prefs = ZVAR_NOSYNC_DEFAULT_PRESENT_MODE,
+        .depth_reserve_width = 1280,
+        .depth_reserve_height = 720,
+    };
+
+    bench_clique_creation(&swapchain_info, "swapchain_clique_create", "swapchain_clique_recreate");
+
+    zvar_swapchain_create_info_t dynamic_swapchain_info = swapchain_info;
+    dynamic_swapchain_info.render_pass = VK_NULL_HANDLE;
+
+    bench_clique_creation(&dynamic_swapchain_info, "dynamic_swapchain_clique_create", "dynamic_swapchain_clique_recreate");
+
+    // NOTE: Every device supports 4 samples for color and depth attachments.
+    zvar_swapchain_create_info_t msaa_swapchain_info = dynamic_swapchain_info;
+    msaa_swapchain_info.samples = VK_SAMPLE_COUNT_4_BIT;
+
+    bench_clique_creation(&msaa_swapchain_info, "msaa_swapchain_clique_create", "msaa_swapchain_clique_recreate");
+    bench_one_off_submission(device, queue, graphics_index);
+    bench_parallel_recording(device, graphics_index, 1, "record_secondaries_1_worker");
+    bench_parallel_recording(device, graphics_index, 0, "record_secondaries_all_workers");
+    bench_memory_allocation(device, physical_device, &memory_properties);
+    bench_upload_bandwidth(device, queue, graphics_index, &memory_properties);
+
+    vkDestroyRenderPass(device, render_pass, zvar_get_device_allocation_callbacks(device));
+    zvar_destroy_device(device);
+    vkDestroySurfaceKHR(instance, surface, zvar_get_instance_allocation_callbacks(instance));
+    zvar_destroy_instance(instance);
+
+    zvar_free_thread_scratch();
+
+    if (!bench_write_results(output_path, csv)) {
+        fprintf(stderr, "Failed to write %s!\n", output_path);
+        return 1;
+    }
+
+    fprintf(stderr, "Results written to %s\n", output_path);
+
+    return 0;
+}
@@ -1,12 +1,39 @@
-#include "zvar.h"
+// NOTE: clock_gettime, fileno and friends are POSIX, not C11, so they have to be asked for before any header.
+#ifndef _POSIX_C_SOURCE
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+// NOTE: Asking for POSIX hides what goes beyond it on Apple platforms, _SC_NPROCESSORS_ONLN among them.
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+    #define _DARWIN_C_SOURCE
+#endif
 
-#include "../dck.h"
+#include "zvar.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 // TODO: Remove.
 #include <assert.h>
 
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <time.h>
+    #include <pthread.h>
+#endif
+
 #define lengthof(arr) (sizeof(arr) / sizeof(*arr))
 
 #ifdef _DEBUG
@@ -28,9 +55,12 @@ static char *default_validation_layers[] = {
     "VK_LAYER_KHRONOS_validation",
 };
 
+// NOTE: Other platforms have to list their window system surface extension.
 static char *default_instance_extensions[] = {
     VK_KHR_SURFACE_EXTENSION_NAME,
+#ifdef _WIN32
     VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+#endif
 };
 
 static char *default_device_extensions[] = {
@@ -82,6 +112,114 @@ static const VkFormat default_depth_format_prefs[] = {
     VK_FORMAT_D24_UNORM_S8_UINT,
 };
 
+typedef struct
+{
+    const char *extension;
+    uint32_t core_version;
+} zvar_extension_dependency_t;
+
+// NOTE: Optional device extensions that need more than their name in the enabled list.
+// Every one of them needs Vulkan 1.1 or VK_KHR_get_physical_device_properties2 on the instance.
+// Every listed feature has to be supported, a zero offset ends the list since sType sits there, a zero size means no features.
+// Extensions promoted to Vulkan 1.3 have the offset of their feature in VkPhysicalDeviceVulkan13Features, zero otherwise.
+// The dependencies get enabled along with the extension on devices older than the version they went core in.
+typedef struct
+{
+    const char *extension;
+    VkStructureType type;
+    size_t size;
+    size_t feature_offsets[8];
+    size_t core_feature_offset;
+    zvar_extension_dependency_t dependencies[4];
+} zvar_optional_feature_t;
+
+static const zvar_optional_feature_t optional_device_features[] = {
+    {
+        .extension = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+        .type = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+        .size = sizeof(VkPhysicalDeviceSynchronization2Features),
+        .feature_offsets = { offsetof(VkPhysicalDeviceSynchronization2Features, synchronization2) },
+        .core_feature_offset = offsetof(VkPhysicalDeviceVulkan13Features, synchronization2),
+    },
+    {
+        .extension = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+        .type = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .size = sizeof(VkPhysicalDeviceTimelineSemaphoreFeatures),
+        .feature_offsets = { offsetof(VkPhysicalDeviceTimelineSemaphoreFeatures, timelineSemaphore) },
+    },
+    {
+        .extension = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+        .type = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+        .size = sizeof(VkPhysicalDeviceDynamicRenderingFeatures),
+        .feature_offsets = { offsetof(VkPhysicalDeviceDynamicRenderingFeatures, dynamicRendering) },
+        .core_feature_offset = offsetof(VkPhysicalDeviceVulkan13Features, dynamicRendering),
+        .dependencies = {
+            { VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME, VK_API_VERSION_1_2 },
+            { VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,   VK_API_VERSION_1_2 },
+            { VK_KHR_MULTIVIEW_EXTENSION_NAME,             VK_API_VERSION_1_1 },
+            { VK_KHR_MAINTENANCE_2_EXTENSION_NAME,         VK_API_VERSION_1_1 },
+        },
+    },
+    {
+        .extension = VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME,
+        .type = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES,
+        .size = sizeof(VkPhysicalDevicePipelineCreationCacheControlFeatures),
+        .feature_offsets = { offsetof(VkPhysicalDevicePipelineCreationCacheControlFeatures, pipelineCreationCacheControl) },
+        .core_feature_offset = offsetof(VkPhysicalDeviceVulkan13Features, pipelineCreationCacheControl),
+    },
+    {
+        .extension = VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME,
+        .type = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PRIORITY_FEATURES_EXT,
+        .size = sizeof(VkPhysicalDeviceMemoryPriorityFeaturesEXT),
+        .feature_offsets = { offsetof(VkPhysicalDeviceMemoryPriorityFeaturesEXT, memoryPriority) },
+    },
+    {
+        .extension = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+    },
+    {
+        .extension = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+        .type = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+        .size = sizeof(VkPhysicalDeviceDescriptorIndexingFeatures),
+        .feature_offsets = {
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, runtimeDescriptorArray),
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, descriptorBindingPartiallyBound),
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, descriptorBindingUpdateUnusedWhilePending),
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, descriptorBindingSampledImageUpdateAfterBind),
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, descriptorBindingStorageBufferUpdateAfterBind),
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, shaderSampledImageArrayNonUniformIndexing),
+            offsetof(VkPhysicalDeviceDescriptorIndexingFeatures, shaderStorageBufferArrayNonUniformIndexing),
+        },
+        .dependencies = {
+            { VK_KHR_MAINTENANCE_3_EXTENSION_NAME, VK_API_VERSION_1_1 },
+        },
+    },
+};
+
+// NOTE: Descriptors per set, close enough for the usual material and pass sets.
+static const zvar_descriptor_pool_ratio_t default_descriptor_pool_ratios[] = {
+    { VK_DESCRIPTOR_TYPE_SAMPLER,                0.5f },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+    { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          4.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          1.0f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         2.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         2.0f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+    { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,       0.5f },
+};
+
+static const VkDescriptorType bindless_descriptor_types[ZVAR_BINDLESS_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+};
+
+static const uint32_t default_bindless_capacities[ZVAR_BINDLESS_BINDING_COUNT] = {
+    16384,
+    16384,
+    256,
+};
+
 
 void zvar_vulkan_handle_error(VkResult res, const char *file, const char *function, int line)
 {
@@ -93,7 +231,7 @@ void zvar_vulkan_handle_error(VkResult res, const char *file, const char *functi
 }
 
 
-static bool str_eq(char *str_a, char *str_b)
+static bool str_eq(const char *str_a, const char *str_b)
 {
     for (; *str_a && *str_b; ++str_a, ++str_b) {
         if (*str_a != *str_b)
@@ -104,868 +242,7886 @@ static bool str_eq(char *str_a, char *str_b)
 }
 
 
-static dck_stretchy_t (uint8_t, uint32_t) scratch;
-
-static void *zvar_get_scratch(uint32_t size)
+static bool zvar_contains_name(uint32_t count, char **names, const char *name)
 {
-    scratch.count = 0;
-    dck_stretchy_reserve(scratch, size);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (str_eq(names[i], name))
+            return true;
+    }
 
-    return scratch.data;
+    return false;
 }
 
 
-VkCommandPool zvar_create_command_pool(VkDevice device, VkCommandPoolCreateFlags flags, uint32_t queue_family_index)
+static void *zvar_realloc(void *ptr, size_t size)
 {
-    VkCommandPoolCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = flags,
-        .queueFamilyIndex = queue_family_index,
-    };
-
-    VkCommandPool res = VK_NULL_HANDLE;
+    void *res = realloc(ptr, size);
 
-    ZVAR_CHECK(vkCreateCommandPool(device, &create_info, NULL, &res));
+    if (!res && size) {
+        fprintf(stderr, "Out of host memory!\n");
+        exit(1);
+    }
 
     return res;
 }
 
 
-void zvar_allocate_command_buffers(VkDevice device, VkCommandPool command_pool, VkCommandBufferLevel secondary, uint32_t count, VkCommandBuffer *command_buffers)
+#define zvar_array_push(data, count, capacity, ...)                     \
+do {                                                                    \
+    if ((count) == (capacity)) {                                        \
+        (capacity) = (capacity) ? (capacity) * 2 : 16;                  \
+        (data) = zvar_realloc((data), (capacity) * sizeof(*(data)));    \
+    }                                                                   \
+    (data)[(count)++] = (__VA_ARGS__);                                  \
+} while (0)
+
+
+static uint64_t zvar_time_ns(void)
 {
-    VkCommandBufferAllocateInfo allocate_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = command_pool,
-        .level = secondary,
-        .commandBufferCount = count,
-    };
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
 
-    ZVAR_CHECK(vkAllocateCommandBuffers(device, &allocate_info, command_buffers));
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
 }
 
 
-VkSemaphore zvar_create_semaphore(VkDevice device)
+/* FNV-1a */
+static uint64_t zvar_hash_bytes(const void *data, size_t size)
 {
-    VkSemaphoreCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-    };
-
-    VkSemaphore res = VK_NULL_HANDLE;
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xcbf29ce484222325ull;
 
-    ZVAR_CHECK(vkCreateSemaphore(device, &create_info, NULL, &res));
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
 
-    return res;
+    return hash;
 }
 
 
-VkFence zvar_create_fence(VkDevice device, VkFenceCreateFlags signaled)
+typedef struct
 {
-    VkFenceCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = signaled,
-    };
+    const void *data;
+    size_t size;
 
-    VkFence res = VK_NULL_HANDLE;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} zvar_mapped_file_t;
 
-    ZVAR_CHECK(vkCreateFence(device, &create_info, NULL, &res));
+/* Read only mapping of a whole file. */
+static bool zvar_map_file(const char *path, zvar_mapped_file_t *mapped)
+{
+    *mapped = (zvar_mapped_file_t) {0};
 
-    return res;
-}
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
 
-VkShaderModule zvar_create_shader_module(VkDevice device, size_t size, void *code)
-{
-    VkShaderModuleCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = size,
-        .pCode = (uint32_t *)code,
-    };
+    LARGE_INTEGER size;
 
-    VkShaderModule res = VK_NULL_HANDLE;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
 
-    ZVAR_CHECK(vkCreateShaderModule(device, &create_info, NULL, &res));
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
 
-    return res;
-}
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
 
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
 
-VkBuffer zvar_create_buffer_exclusive(VkDevice device, VkBufferCreateFlags flags, VkDeviceSize size, VkBufferUsageFlags usage)
-{
-    VkBufferCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .flags = flags,
-        .size = size,
-        .usage = usage,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    *mapped = (zvar_mapped_file_t) {
+        .data = data,
+        .size = (size_t)size.QuadPart,
+        .file = file,
+        .mapping = mapping,
     };
+#else
+    int fd = open(path, O_RDONLY);
 
-    VkBuffer res = VK_NULL_HANDLE;
+    if (fd < 0)
+        return false;
 
-    ZVAR_CHECK(vkCreateBuffer(device, &create_info, NULL, &res));
+    struct stat st;
 
-    return res;
-}
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
 
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-VkMemoryRequirements zvar_get_buffer_memory_requirements(VkDevice device, VkBuffer buffer)
-{
-    VkMemoryRequirements res;
+    // NOTE: The mapping stays valid after closing.
+    close(fd);
 
-    vkGetBufferMemoryRequirements(device, buffer, &res);
+    if (data == MAP_FAILED)
+        return false;
 
-    return res;
-}
+    *mapped = (zvar_mapped_file_t) {
+        .data = data,
+        .size = (size_t)st.st_size,
+    };
+#endif
 
+    return true;
+}
 
-VkMemoryRequirements zvar_get_image_memory_requirements(VkDevice device, VkImage image)
+static void zvar_unmap_file(zvar_mapped_file_t *mapped)
 {
-    VkMemoryRequirements res;
+    if (!mapped->data)
+        return;
 
-    vkGetImageMemoryRequirements(device, image, &res);
+#ifdef _WIN32
+    UnmapViewOfFile(mapped->data);
+    CloseHandle(mapped->mapping);
+    CloseHandle(mapped->file);
+#else
+    munmap((void *)mapped->data, mapped->size);
+#endif
 
-    return res;
+    *mapped = (zvar_mapped_file_t) {0};
 }
 
 
-VkCommandBuffer zvar_begin_one_off_command_buffer(VkDevice device, VkCommandPool command_pool)
+/* Writes to a temporary file next to `path` and renames it over, readers never see a partial file. */
+static bool zvar_write_file_atomic(const char *path, const void *header, size_t header_size, const void *data, size_t size)
 {
-    VkCommandBuffer res = VK_NULL_HANDLE;
+    size_t length = strlen(path);
+    char *temp_path = zvar_realloc(NULL, length + sizeof(".tmp"));
+    memcpy(temp_path, path, length);
+    memcpy(temp_path + length, ".tmp", sizeof(".tmp"));
 
-    zvar_allocate_command_buffers(device, command_pool, false, 1, &res);
+    FILE *file = fopen(temp_path, "wb");
 
-    VkCommandBufferBeginInfo begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-    };
+    if (!file) {
+        free(temp_path);
+        return false;
+    }
 
-    ZVAR_CHECK(vkBeginCommandBuffer(res, &begin_info));
+    bool ok = fwrite(header, 1, header_size, file) == header_size
+           && fwrite(data, 1, size, file) == size
+           && fflush(file) == 0;
 
-    return res;
-}
+#ifndef _WIN32
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
 
+    ok = fclose(file) == 0 && ok;
 
-void zvar_finish_one_off_command_buffer(VkDevice device, VkCommandPool command_pool, VkQueue queue, VkCommandBuffer command_buffer)
-{
-    ZVAR_CHECK(vkEndCommandBuffer(command_buffer));
+    if (ok) {
+#ifdef _WIN32
+        ok = MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        ok = rename(temp_path, path) == 0;
+#endif
+    }
 
-    VkFence fence = zvar_create_fence(device, false);
+    if (!ok) {
+        remove(temp_path);
+    }
 
-    VkSubmitInfo submit_info = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &command_buffer,
-    };
+    free(temp_path);
 
-    ZVAR_CHECK(vkQueueSubmit(queue, 1, &submit_info, fence));
+    return ok;
+}
 
-    ZVAR_CHECK(vkWaitForFences(device, 1, &fence, false, ~0ull));
 
-    vkDestroyFence(device, fence, NULL);
-    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+/* `value` must not be zero. */
+static uint32_t zvar_bit_scan_forward(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctzll(value);
+#endif
 }
 
-
-VkImage zvar_create_2d_image_exclusive(VkDevice device, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, VkImageUsageFlags usage)
+/* `value` must not be zero. */
+static uint32_t zvar_bit_scan_reverse(uint64_t value)
 {
-    VkImage res = VK_NULL_HANDLE;
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (uint32_t)index;
+#else
+    return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+}
 
-    VkImageCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = format,
-        .extent = {
-            .width  = width,
-            .height = height,
-            .depth = 1,
-        },
-        .mipLevels = mip_levels,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = usage,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-    };
+/* `alignment` has to be a power of two. */
+static VkDeviceSize zvar_align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
 
-    ZVAR_CHECK(vkCreateImage(device, &create_info, NULL, &res));
 
-    return res;
+static void zvar_lock(long *lock)
+{
+#ifdef _MSC_VER
+    while (_InterlockedExchange((volatile long *)lock, 1)) {
+        while (*(volatile long *)lock);
+    }
+#else
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED));
+    }
+#endif
 }
 
-
-VkDeviceMemory zvar_allocate_memory(VkDevice device, uint32_t memory_type, VkDeviceSize size)
+static void zvar_unlock(long *lock)
 {
-    VkMemoryAllocateInfo allocate_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = size,
-        .memoryTypeIndex = memory_type,
-    };
+#ifdef _MSC_VER
+    _InterlockedExchange((volatile long *)lock, 0);
+#else
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#endif
+}
 
-    VkDeviceMemory res = VK_NULL_HANDLE;
+static void zvar_atomic_add(uint64_t *value, uint64_t addend)
+{
+#ifdef _MSC_VER
+    _InterlockedExchangeAdd64((volatile long long *)value, (long long)addend);
+#else
+    __atomic_fetch_add(value, addend, __ATOMIC_RELAXED);
+#endif
+}
 
-    ZVAR_CHECK(vkAllocateMemory(device, &allocate_info, NULL, &res));
+static uint64_t zvar_atomic_exchange(uint64_t *value, uint64_t desired)
+{
+#ifdef _MSC_VER
+    return (uint64_t)_InterlockedExchange64((volatile long long *)value, (long long)desired);
+#else
+    return __atomic_exchange_n(value, desired, __ATOMIC_RELAXED);
+#endif
+}
 
-    return res;
+static uint64_t zvar_atomic_load(const uint64_t *value)
+{
+#ifdef _MSC_VER
+    // NOTE: Aligned 64 bit loads are atomic on every 64 bit target MSVC has.
+    return *(const volatile uint64_t *)value;
+#else
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+#endif
 }
 
 
-VkImageView zvar_create_2d_image_view(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect_mask, uint32_t level_count)
-{
-    VkImageViewCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image = image,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = format,
-        .components = { // NOTE: Optional.
-            .r = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .g = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .b = VK_COMPONENT_SWIZZLE_IDENTITY,
-            .a = VK_COMPONENT_SWIZZLE_IDENTITY,
-        },
-        .subresourceRange = {
-            .aspectMask = aspect_mask,
-            .baseMipLevel = 0,
-            .levelCount = level_count,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-    };
+/* CPU side instrumentation, compiled out unless ZVAR_INSTRUMENT is defined. */
 
-    VkImageView res = VK_NULL_HANDLE;
+static const char *counter_names[ZVAR_COUNTER_COUNT] = {
+#define X(counter, name) [ZVAR_COUNTER_##counter] = name,
+    ZVAR_COUNTERS(X)
+#undef X
+};
 
-    ZVAR_CHECK(vkCreateImageView(device, &create_info, NULL, &res));
+static zvar_instrumentation_t instrumentation;
 
-    return res;
-}
+#ifdef ZVAR_INSTRUMENT
+    #define zvar_instrument_begin(counter)              uint64_t _m_instrument_start = zvar_time_ns()
+    #define zvar_instrument_end(counter)                zvar_count_call((counter), _m_instrument_start)
+    #define zvar_instrument_memory(memory_type, size)   zvar_count_device_memory((memory_type), (size))
 
-int32_t zvar_find_memory_type(VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t supported_type_mask, VkMemoryPropertyFlags required_properties)
+static void zvar_atomic_max(uint64_t *value, uint64_t candidate)
 {
-    uint32_t type_count = memory_properties->memoryTypeCount;
+#ifdef _MSC_VER
+    long long current = *(volatile long long *)value;
 
-    for (uint32_t index = 0; index < type_count; ++index) {
-        if (!(supported_type_mask & (1 << index)))
-            continue;
+    while ((uint64_t)current < candidate) {
+        long long previous = _InterlockedCompareExchange64((volatile long long *)value, (long long)candidate, current);
 
-        VkMemoryPropertyFlags properties = memory_properties->memoryTypes[index].propertyFlags;
+        if (previous == current)
+            break;
 
-        if ((properties & required_properties) == required_properties)
-            return (int32_t)index;
+        current = previous;
     }
+#else
+    uint64_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
 
-    return -1;
+    while (current < candidate && !__atomic_compare_exchange_n(value, &current, candidate, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#endif
 }
 
-// TODO: Make depth parameters nullable.
-bool zvar_create_swapchain_clique(const zvar_swapchain_create_info_t *info,
-                                  VkSwapchainKHR *swapchain, uint32_t *width, uint32_t *height, uint32_t *image_count, VkImageView *views, VkFramebuffer *framebuffers,
-                                  VkImage *depth_image, VkDeviceMemory *depth_memory, VkImageView *depth_view)
+static void zvar_count_call(zvar_counter_t counter, uint64_t start)
 {
-    // create swapchain
-    {
-        VkSwapchainKHR old_swapchain = *swapchain;
+    zvar_atomic_add(&instrumentation.calls[counter].count, 1);
+    zvar_atomic_add(&instrumentation.calls[counter].time_ns, zvar_time_ns() - start);
+}
 
-        VkSurfaceCapabilitiesKHR surface_capabilities;
-        ZVAR_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(info->physical_device, info->surface, &surface_capabilities));
+static void zvar_count_device_memory(uint32_t memory_type, VkDeviceSize size)
+{
+    zvar_atomic_add(&instrumentation.memory_type_allocation_counts[memory_type], 1);
+    zvar_atomic_add(&instrumentation.memory_type_bytes[memory_type], size);
+}
+#else
+    #define zvar_instrument_begin(counter)
+    #define zvar_instrument_end(counter)
+    #define zvar_instrument_memory(memory_type, size)
+#endif
 
-        uint32_t present_mode_count;
-        ZVAR_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(info->physical_device, info->surface, &present_mode_count, NULL));
-        VkPresentModeKHR *present_modes = zvar_get_scratch(present_mode_count * sizeof(VkPresentModeKHR));
-        ZVAR_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(info->physical_device, info->surface, &present_mode_count, present_modes));
+const char *zvar_get_counter_name(zvar_counter_t counter)
+{
+    return counter_names[counter];
+}
 
-        uint32_t present_mode_pref_count = info->present_mode_pref_count;
-        VkPresentModeKHR *present_mode_prefs = info->present_mode_prefs;
+void zvar_get_instrumentation(zvar_instrumentation_t *snapshot)
+{
+    // NOTE: Nothing but uint64_t fields.
+    const uint64_t *src = (const uint64_t *)&instrumentation;
+    uint64_t *dst = (uint64_t *)snapshot;
 
-        if (present_mode_prefs == ZVAR_VSYNC_DEFAULT_PRESENT_MODE) {
-            present_mode_pref_count = lengthof(default_vsync_present_mode_prefs);
-            present_mode_prefs      = default_vsync_present_mode_prefs;
+    for (size_t i = 0; i < sizeof(zvar_instrumentation_t) / sizeof(uint64_t); ++i) {
+        dst[i] = zvar_atomic_load(src + i);
+    }
+}
+
+void zvar_reset_instrumentation(void)
+{
+    uint64_t *counters = (uint64_t *)&instrumentation;
+
+    for (size_t i = 0; i < sizeof(zvar_instrumentation_t) / sizeof(uint64_t); ++i) {
+        zvar_atomic_exchange(counters + i, 0);
+    }
+}
+
+
+/* Per-thread scratch arena.
+ * Memory comes in chunks that are bumped through, so earlier allocations stay valid while the arena grows.
+ * Every user saves the arena on entry and restores it before returning, nested users can't clobber each other.
+ */
+
+#ifdef _MSC_VER
+    #define zvar_thread_local __declspec(thread)
+#else
+    #define zvar_thread_local _Thread_local
+#endif
+
+#define ZVAR_SCRATCH_CHUNK_SIZE   (64 * 1024)
+#define ZVAR_SCRATCH_ALIGNMENT    16
+
+typedef struct zvar_scratch_chunk zvar_scratch_chunk_t;
+
+struct zvar_scratch_chunk
+{
+    zvar_scratch_chunk_t *prev;
+    size_t capacity;
+    size_t used;
+};
+
+#define ZVAR_SCRATCH_HEADER_SIZE ((sizeof(zvar_scratch_chunk_t) + ZVAR_SCRATCH_ALIGNMENT - 1) & ~(size_t)(ZVAR_SCRATCH_ALIGNMENT - 1))
+
+typedef struct
+{
+    zvar_scratch_chunk_t *chunk;
+    size_t used;
+} zvar_scratch_mark_t;
+
+static zvar_thread_local zvar_scratch_chunk_t *scratch;
+/* Biggest chunk popped so far, kept so the steady state doesn't touch the heap. */
+static zvar_thread_local zvar_scratch_chunk_t *scratch_spare;
+
+static void *zvar_get_scratch(size_t size)
+{
+    size = (size + ZVAR_SCRATCH_ALIGNMENT - 1) & ~(size_t)(ZVAR_SCRATCH_ALIGNMENT - 1);
+
+    if (!scratch || scratch->used + size > scratch->capacity) {
+        zvar_scratch_chunk_t *chunk = scratch_spare;
+
+        if (chunk && chunk->capacity >= size) {
+            scratch_spare = NULL;
+        }
+        else {
+            size_t capacity = size > ZVAR_SCRATCH_CHUNK_SIZE ? size : ZVAR_SCRATCH_CHUNK_SIZE;
+
+            chunk = zvar_realloc(NULL, ZVAR_SCRATCH_HEADER_SIZE + capacity);
+            chunk->capacity = capacity;
+        }
+
+        chunk->prev = scratch;
+        chunk->used = 0;
+
+        scratch = chunk;
+    }
+
+    void *res = (uint8_t *)scratch + ZVAR_SCRATCH_HEADER_SIZE + scratch->used;
+    scratch->used += size;
+
+#ifdef ZVAR_INSTRUMENT
+    uint64_t scratch_size = 0;
+
+    for (zvar_scratch_chunk_t *chunk = scratch; chunk; chunk = chunk->prev) {
+        scratch_size += chunk->used;
+    }
+
+    zvar_atomic_max(&instrumentation.peak_scratch_size, scratch_size);
+#endif
+
+    return res;
+}
+
+static zvar_scratch_mark_t zvar_save_scratch(void)
+{
+    return (zvar_scratch_mark_t) {
+        .chunk = scratch,
+        .used = scratch ? scratch->used : 0,
+    };
+}
+
+static void zvar_restore_scratch(zvar_scratch_mark_t mark)
+{
+    while (scratch != mark.chunk) {
+        zvar_scratch_chunk_t *chunk = scratch;
+        scratch = chunk->prev;
+
+        if (!scratch_spare || scratch_spare->capacity < chunk->capacity) {
+            free(scratch_spare);
+            scratch_spare = chunk;
+        }
+        else {
+            free(chunk);
+        }
+    }
+
+    if (scratch) {
+        scratch->used = mark.used;
+    }
+}
+
+void zvar_free_thread_scratch(void)
+{
+    zvar_restore_scratch((zvar_scratch_mark_t) {0});
+
+    free(scratch_spare);
+    scratch_spare = NULL;
+}
+
+
+/* Per instance and per device state.
+ * Every dispatchable handle starts with the loader's dispatch table pointer, which an instance shares with its physical devices
+ * and a device with its queues and command buffers. Records are keyed by it, so any of those handles finds the state it belongs to.
+ */
+
+typedef struct
+{
+    void *dispatch_key;
+    VkInstance instance;
+    const VkAllocationCallbacks *allocation_callbacks;
+
+    /* What it was created with, caps the version of its devices. */
+    uint32_t api_version;
+    bool has_properties2_extension;
+} zvar_instance_record_t;
+
+typedef struct
+{
+    void *dispatch_key;
+    VkDevice device;
+    const VkAllocationCallbacks *allocation_callbacks;
+    VolkDeviceTable table;
+
+    /* Its feature got turned on, through the extension or Vulkan 1.3. */
+    bool synchronization2;
+} zvar_device_record_t;
+
+static long records_lock;
+
+// NOTE: Records are allocated one by one, pointers to them stay valid until their instance or device is destroyed.
+static uint32_t instance_record_count, instance_record_capacity;
+static zvar_instance_record_t **instance_records;
+
+static uint32_t device_record_count, device_record_capacity;
+static zvar_device_record_t **device_records;
+
+
+static void *zvar_get_dispatch_key(const void *handle)
+{
+    return *(void *const *)handle;
+}
+
+
+/* NULL for handles of instances zvar didn't create. */
+static zvar_instance_record_t *zvar_find_instance_record(const void *handle)
+{
+    if (!handle)
+        return NULL;
+
+    void *dispatch_key = zvar_get_dispatch_key(handle);
+    zvar_instance_record_t *res = NULL;
+
+    zvar_lock(&records_lock);
+
+    for (uint32_t i = 0; i < instance_record_count; ++i) {
+        if (instance_records[i]->dispatch_key == dispatch_key) {
+            res = instance_records[i];
+            break;
+        }
+    }
+
+    zvar_unlock(&records_lock);
+
+    return res;
+}
+
+
+/* NULL for handles of devices zvar didn't create. */
+static zvar_device_record_t *zvar_find_device_record(const void *handle)
+{
+    if (!handle)
+        return NULL;
+
+    void *dispatch_key = zvar_get_dispatch_key(handle);
+    zvar_device_record_t *res = NULL;
+
+    zvar_lock(&records_lock);
+
+    for (uint32_t i = 0; i < device_record_count; ++i) {
+        if (device_records[i]->dispatch_key == dispatch_key) {
+            res = device_records[i];
+            break;
+        }
+    }
+
+    zvar_unlock(&records_lock);
+
+    return res;
+}
+
+
+const VkAllocationCallbacks *zvar_get_instance_allocation_callbacks(VkInstance instance)
+{
+    zvar_instance_record_t *record = zvar_find_instance_record(instance);
+
+    return record ? record->allocation_callbacks : NULL;
+}
+
+const VkAllocationCallbacks *zvar_get_device_allocation_callbacks(VkDevice device)
+{
+    zvar_device_record_t *record = zvar_find_device_record(device);
+
+    return record ? record->allocation_callbacks : NULL;
+}
+
+
+// NOTE: Bumped whenever a device record goes away, a thread's cached record is only trusted while it didn't change.
+static uint64_t device_record_generation;
+
+static zvar_thread_local struct
+{
+    void *dispatch_key;
+    uint64_t generation;
+    zvar_device_record_t *record;
+} device_record_cache;
+
+
+/* The entry points of the device a VkDevice, VkQueue or VkCommandBuffer belongs to. */
+static const VolkDeviceTable *zvar_get_device_table(const void *handle)
+{
+    void *dispatch_key = zvar_get_dispatch_key(handle);
+    uint64_t generation = zvar_atomic_load(&device_record_generation);
+
+    if (device_record_cache.record && device_record_cache.dispatch_key == dispatch_key && device_record_cache.generation == generation)
+        return &device_record_cache.record->table;
+
+    zvar_device_record_t *record = zvar_find_device_record(handle);
+
+    if (!record) {
+        fprintf(stderr, "Device handles must come from zvar_create_device!\n");
+        exit(1);
+    }
+
+    device_record_cache.dispatch_key = dispatch_key;
+    device_record_cache.generation = generation;
+    device_record_cache.record = record;
+
+    return &record->table;
+}
+
+#define zvar_vk(handle, function) (zvar_get_device_table(handle)->function)
+
+
+VkCommandPool zvar_create_command_pool(VkDevice device, VkCommandPoolCreateFlags flags, uint32_t queue_family_index)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_COMMAND_POOL);
+
+    VkCommandPoolCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = flags,
+        .queueFamilyIndex = queue_family_index,
+    };
+
+    VkCommandPool res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateCommandPool)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_COMMAND_POOL);
+    return res;
+}
+
+
+void zvar_allocate_command_buffers(VkDevice device, VkCommandPool command_pool, VkCommandBufferLevel secondary, uint32_t count, VkCommandBuffer *command_buffers)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_ALLOCATE_COMMAND_BUFFERS);
+
+    VkCommandBufferAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = command_pool,
+        .level = secondary,
+        .commandBufferCount = count,
+    };
+
+    ZVAR_CHECK(zvar_vk(device, vkAllocateCommandBuffers)(device, &allocate_info, command_buffers));
+
+    zvar_instrument_end(ZVAR_COUNTER_ALLOCATE_COMMAND_BUFFERS);
+}
+
+
+VkSemaphore zvar_create_semaphore(VkDevice device)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_SEMAPHORE);
+
+    VkSemaphoreCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    };
+
+    VkSemaphore res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateSemaphore)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_SEMAPHORE);
+    return res;
+}
+
+
+VkFence zvar_create_fence(VkDevice device, VkFenceCreateFlags signaled)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_FENCE);
+
+    VkFenceCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = signaled,
+    };
+
+    VkFence res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateFence)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_FENCE);
+    return res;
+}
+
+
+VkShaderModule zvar_create_shader_module(VkDevice device, size_t size, void *code)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_SHADER_MODULE);
+
+    VkShaderModuleCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = size,
+        .pCode = (uint32_t *)code,
+    };
+
+    VkShaderModule res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateShaderModule)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_SHADER_MODULE);
+    return res;
+}
+
+
+VkBuffer zvar_create_buffer_exclusive(VkDevice device, VkBufferCreateFlags flags, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_BUFFER);
+
+    VkBufferCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .flags = flags,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    VkBuffer res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateBuffer)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_BUFFER);
+    return res;
+}
+
+
+VkMemoryRequirements zvar_get_buffer_memory_requirements(VkDevice device, VkBuffer buffer)
+{
+    VkMemoryRequirements res;
+
+    zvar_vk(device, vkGetBufferMemoryRequirements)(device, buffer, &res);
+
+    return res;
+}
+
+
+VkMemoryRequirements zvar_get_image_memory_requirements(VkDevice device, VkImage image)
+{
+    VkMemoryRequirements res;
+
+    zvar_vk(device, vkGetImageMemoryRequirements)(device, image, &res);
+
+    return res;
+}
+
+
+VkCommandBuffer zvar_begin_one_off_command_buffer(VkDevice device, VkCommandPool command_pool)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_BEGIN_ONE_OFF_COMMAND_BUFFER);
+
+    VkCommandBuffer res = VK_NULL_HANDLE;
+
+    zvar_allocate_command_buffers(device, command_pool, false, 1, &res);
+
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    ZVAR_CHECK(zvar_vk(res, vkBeginCommandBuffer)(res, &begin_info));
+
+    zvar_instrument_end(ZVAR_COUNTER_BEGIN_ONE_OFF_COMMAND_BUFFER);
+    return res;
+}
+
+
+void zvar_finish_one_off_command_buffer(VkDevice device, VkCommandPool command_pool, VkQueue queue, VkCommandBuffer command_buffer)
+{
+    zvar_finish_pooled_one_off_command_buffer(device, command_pool, queue, command_buffer, NULL);
+}
+
+
+void zvar_finish_pooled_one_off_command_buffer(VkDevice device, VkCommandPool command_pool, VkQueue queue, VkCommandBuffer command_buffer, zvar_fence_pool_t *fence_pool)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_FINISH_ONE_OFF_COMMAND_BUFFER);
+
+    ZVAR_CHECK(zvar_vk(command_buffer, vkEndCommandBuffer)(command_buffer));
+
+    VkFence fence = fence_pool ? zvar_acquire_fence(fence_pool) : zvar_create_fence(device, false);
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+    };
+
+    ZVAR_CHECK(zvar_vk(queue, vkQueueSubmit)(queue, 1, &submit_info, fence));
+
+    ZVAR_CHECK(zvar_vk(device, vkWaitForFences)(device, 1, &fence, false, ~0ull));
+
+    if (fence_pool) {
+        zvar_release_fence(fence_pool, fence);
+    }
+    else {
+        zvar_vk(device, vkDestroyFence)(device, fence, zvar_get_device_allocation_callbacks(device));
+    }
+
+    zvar_vk(device, vkFreeCommandBuffers)(device, command_pool, 1, &command_buffer);
+
+    zvar_instrument_end(ZVAR_COUNTER_FINISH_ONE_OFF_COMMAND_BUFFER);
+}
+
+
+static VkImage zvar_create_2d_image(VkDevice device, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits samples, VkImageUsageFlags usage)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_IMAGE);
+
+    VkImage res = VK_NULL_HANDLE;
+
+    VkImageCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = {
+            .width  = width,
+            .height = height,
+            .depth = 1,
+        },
+        .mipLevels = mip_levels,
+        .arrayLayers = 1,
+        .samples = samples,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateImage)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_IMAGE);
+    return res;
+}
+
+
+VkImage zvar_create_2d_image_exclusive(VkDevice device, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, VkImageUsageFlags usage)
+{
+    return zvar_create_2d_image(device, format, width, height, mip_levels, VK_SAMPLE_COUNT_1_BIT, usage);
+}
+
+
+VkImage zvar_create_2d_attachment_image(VkDevice device, VkFormat format, uint32_t width, uint32_t height, VkSampleCountFlagBits samples, VkImageUsageFlags usage)
+{
+    return zvar_create_2d_image(device, format, width, height, 1, samples, usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+}
+
+
+VkDeviceMemory zvar_allocate_memory(VkDevice device, uint32_t memory_type, VkDeviceSize size)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_ALLOCATE_MEMORY);
+
+    VkMemoryAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memory_type,
+    };
+
+    VkDeviceMemory res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkAllocateMemory)(device, &allocate_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_memory(memory_type, size);
+    zvar_instrument_end(ZVAR_COUNTER_ALLOCATE_MEMORY);
+    return res;
+}
+
+
+VkImageView zvar_create_2d_image_view(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect_mask, uint32_t level_count)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_IMAGE_VIEW);
+
+    VkImageViewCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .components = { // NOTE: Optional.
+            .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+            .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+            .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+            .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+        },
+        .subresourceRange = {
+            .aspectMask = aspect_mask,
+            .baseMipLevel = 0,
+            .levelCount = level_count,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+
+    VkImageView res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(device, vkCreateImageView)(device, &create_info, zvar_get_device_allocation_callbacks(device), &res));
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_IMAGE_VIEW);
+    return res;
+}
+
+int32_t zvar_find_memory_type(VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t supported_type_mask, VkMemoryPropertyFlags required_properties)
+{
+    uint32_t type_count = memory_properties->memoryTypeCount;
+
+    for (uint32_t index = 0; index < type_count; ++index) {
+        if (!(supported_type_mask & (1 << index)))
+            continue;
+
+        VkMemoryPropertyFlags properties = memory_properties->memoryTypes[index].propertyFlags;
+
+        if ((properties & required_properties) == required_properties)
+            return (int32_t)index;
+    }
+
+    return -1;
+}
+
+
+int32_t zvar_find_attachment_memory_type(VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t supported_type_mask)
+{
+    // NOTE: Only tilers tend to have lazily allocated memory, everything else gets plain device local memory.
+    int32_t res = zvar_find_memory_type(memory_properties, supported_type_mask, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+    if (res < 0) {
+        res = zvar_find_memory_type(memory_properties, supported_type_mask, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    return res;
+}
+
+
+/* Device memory sub-allocator.
+ *
+ * Every block is a single VkDeviceMemory managed by a TLSF (two-level segregated fit) allocator.
+ * The device memory is not host addressable, so the nodes describing the ranges live in a side array
+ * and are linked by index. Free nodes are always coalesced with free physical neighbours.
+ *
+ * When bufferImageGranularity is bigger than one, linear resources and optimal images are placed
+ * into separate blocks so they can never share a granularity page.
+ */
+
+#define ZVAR_TLSF_SL_LOG2   5
+#define ZVAR_TLSF_SL_COUNT  (1u << ZVAR_TLSF_SL_LOG2)
+#define ZVAR_TLSF_FL_COUNT  (64 - ZVAR_TLSF_SL_LOG2 + 1)
+#define ZVAR_TLSF_SMALL     ((VkDeviceSize)ZVAR_TLSF_SL_COUNT)
+
+typedef struct
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+
+    uint32_t prev_physical, next_physical;
+    /* Also links unused nodes together. */
+    uint32_t prev_free, next_free;
+
+    bool free;
+} zvar_tlsf_node_t;
+
+struct zvar_memory_block
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void *mapped;
+
+    uint32_t memory_type;
+    bool optimal;
+
+    uint32_t allocation_count;
+
+    uint32_t node_count, node_capacity;
+    zvar_tlsf_node_t *nodes;
+    uint32_t unused_nodes;
+
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmaps[ZVAR_TLSF_FL_COUNT];
+    uint32_t free_heads[ZVAR_TLSF_FL_COUNT][ZVAR_TLSF_SL_COUNT];
+};
+
+
+static void zvar_tlsf_mapping(VkDeviceSize size, uint32_t *fl, uint32_t *sl)
+{
+    if (size < ZVAR_TLSF_SMALL) {
+        *fl = 0;
+        *sl = (uint32_t)size;
+        return;
+    }
+
+    uint32_t log2 = zvar_bit_scan_reverse(size);
+
+    *sl = (uint32_t)(size >> (log2 - ZVAR_TLSF_SL_LOG2)) ^ ZVAR_TLSF_SL_COUNT;
+    *fl = log2 - ZVAR_TLSF_SL_LOG2 + 1;
+}
+
+
+static uint32_t zvar_tlsf_new_node(zvar_memory_block_t *block)
+{
+    if (block->unused_nodes != ZVAR_NO_INDEX) {
+        uint32_t index = block->unused_nodes;
+        block->unused_nodes = block->nodes[index].next_free;
+        return index;
+    }
+
+    if (block->node_count == block->node_capacity) {
+        block->node_capacity = block->node_capacity ? block->node_capacity * 2 : 64;
+        block->nodes = zvar_realloc(block->nodes, block->node_capacity * sizeof(zvar_tlsf_node_t));
+    }
+
+    return block->node_count++;
+}
+
+
+static void zvar_tlsf_release_node(zvar_memory_block_t *block, uint32_t index)
+{
+    block->nodes[index].next_free = block->unused_nodes;
+    block->unused_nodes = index;
+}
+
+
+static void zvar_tlsf_insert_free(zvar_memory_block_t *block, uint32_t index)
+{
+    zvar_tlsf_node_t *node = block->nodes + index;
+
+    uint32_t fl, sl;
+    zvar_tlsf_mapping(node->size, &fl, &sl);
+
+    uint32_t head = block->free_heads[fl][sl];
+
+    node->free = true;
+    node->prev_free = ZVAR_NO_INDEX;
+    node->next_free = head;
+
+    if (head != ZVAR_NO_INDEX) {
+        block->nodes[head].prev_free = index;
+    }
+
+    block->free_heads[fl][sl] = index;
+    block->sl_bitmaps[fl] |= 1u << sl;
+    block->fl_bitmap |= 1ull << fl;
+}
+
+
+static void zvar_tlsf_remove_free(zvar_memory_block_t *block, uint32_t index)
+{
+    zvar_tlsf_node_t *node = block->nodes + index;
+
+    uint32_t fl, sl;
+    zvar_tlsf_mapping(node->size, &fl, &sl);
+
+    if (node->prev_free != ZVAR_NO_INDEX) {
+        block->nodes[node->prev_free].next_free = node->next_free;
+    }
+    else {
+        block->free_heads[fl][sl] = node->next_free;
+
+        if (node->next_free == ZVAR_NO_INDEX) {
+            block->sl_bitmaps[fl] &= ~(1u << sl);
+
+            if (!block->sl_bitmaps[fl]) {
+                block->fl_bitmap &= ~(1ull << fl);
+            }
+        }
+    }
+
+    if (node->next_free != ZVAR_NO_INDEX) {
+        block->nodes[node->next_free].prev_free = node->prev_free;
+    }
+
+    node->free = false;
+}
+
+
+/* Returns the head of the first non-empty list whose every node is at least `size` big. */
+static uint32_t zvar_tlsf_find_free(zvar_memory_block_t *block, VkDeviceSize size)
+{
+    // round up to the next list so the first node fits
+    if (size >= ZVAR_TLSF_SMALL) {
+        size += ((VkDeviceSize)1 << (zvar_bit_scan_reverse(size) - ZVAR_TLSF_SL_LOG2)) - 1;
+    }
+
+    uint32_t fl, sl;
+    zvar_tlsf_mapping(size, &fl, &sl);
+
+    if (fl >= ZVAR_TLSF_FL_COUNT)
+        return ZVAR_NO_INDEX;
+
+    uint32_t sl_map = block->sl_bitmaps[fl] & (~0u << sl);
+
+    if (!sl_map) {
+        uint64_t fl_map = fl + 1 < 64 ? block->fl_bitmap & (~0ull << (fl + 1)) : 0;
+
+        if (!fl_map)
+            return ZVAR_NO_INDEX;
+
+        fl = zvar_bit_scan_forward(fl_map);
+        sl_map = block->sl_bitmaps[fl];
+    }
+
+    sl = zvar_bit_scan_forward(sl_map);
+
+    return block->free_heads[fl][sl];
+}
+
+
+static bool zvar_tlsf_fits(zvar_tlsf_node_t *node, VkDeviceSize size, VkDeviceSize alignment)
+{
+    VkDeviceSize padding = zvar_align_up(node->offset, alignment) - node->offset;
+
+    return padding + size <= node->size;
+}
+
+
+static uint32_t zvar_memory_block_allocate(zvar_memory_block_t *block, VkDeviceSize size, VkDeviceSize alignment)
+{
+    uint32_t index = zvar_tlsf_find_free(block, size);
+
+    if (index != ZVAR_NO_INDEX && !zvar_tlsf_fits(block->nodes + index, size, alignment)) {
+        // Worst case padding, any node found this way fits.
+        index = zvar_tlsf_find_free(block, size + alignment - 1);
+    }
+
+    if (index == ZVAR_NO_INDEX)
+        return ZVAR_NO_INDEX;
+
+    zvar_tlsf_remove_free(block, index);
+
+    VkDeviceSize offset  = block->nodes[index].offset;
+    VkDeviceSize padding = zvar_align_up(offset, alignment) - offset;
+
+    // split off the alignment padding in front
+    if (padding) {
+        uint32_t front = zvar_tlsf_new_node(block);
+        zvar_tlsf_node_t *node = block->nodes + index;
+
+        block->nodes[front] = (zvar_tlsf_node_t) {
+            .offset = node->offset,
+            .size = padding,
+            .prev_physical = node->prev_physical,
+            .next_physical = index,
+        };
+
+        if (node->prev_physical != ZVAR_NO_INDEX) {
+            block->nodes[node->prev_physical].next_physical = front;
+        }
+
+        node->prev_physical = front;
+        node->offset += padding;
+        node->size   -= padding;
+
+        zvar_tlsf_insert_free(block, front);
+    }
+
+    // split off the remainder behind
+    if (block->nodes[index].size > size) {
+        uint32_t back = zvar_tlsf_new_node(block);
+        zvar_tlsf_node_t *node = block->nodes + index;
+
+        block->nodes[back] = (zvar_tlsf_node_t) {
+            .offset = node->offset + size,
+            .size = node->size - size,
+            .prev_physical = index,
+            .next_physical = node->next_physical,
+        };
+
+        if (node->next_physical != ZVAR_NO_INDEX) {
+            block->nodes[node->next_physical].prev_physical = back;
+        }
+
+        node->next_physical = back;
+        node->size = size;
+
+        zvar_tlsf_insert_free(block, back);
+    }
+
+    block->allocation_count++;
+
+    return index;
+}
+
+
+static void zvar_memory_block_free(zvar_memory_block_t *block, uint32_t index)
+{
+    zvar_tlsf_node_t *nodes = block->nodes;
+
+    uint32_t prev = nodes[index].prev_physical;
+
+    if (prev != ZVAR_NO_INDEX && nodes[prev].free) {
+        zvar_tlsf_remove_free(block, prev);
+
+        nodes[prev].size += nodes[index].size;
+        nodes[prev].next_physical = nodes[index].next_physical;
+
+        if (nodes[index].next_physical != ZVAR_NO_INDEX) {
+            nodes[nodes[index].next_physical].prev_physical = prev;
+        }
+
+        zvar_tlsf_release_node(block, index);
+        index = prev;
+    }
+
+    uint32_t next = nodes[index].next_physical;
+
+    if (next != ZVAR_NO_INDEX && nodes[next].free) {
+        zvar_tlsf_remove_free(block, next);
+
+        nodes[index].size += nodes[next].size;
+        nodes[index].next_physical = nodes[next].next_physical;
+
+        if (nodes[next].next_physical != ZVAR_NO_INDEX) {
+            nodes[nodes[next].next_physical].prev_physical = index;
+        }
+
+        zvar_tlsf_release_node(block, next);
+    }
+
+    zvar_tlsf_insert_free(block, index);
+
+    block->allocation_count--;
+}
+
+
+static zvar_memory_block_t *zvar_create_memory_block(zvar_allocator_t *allocator, uint32_t memory_type, VkDeviceSize size, bool optimal)
+{
+    VkMemoryAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memory_type,
+    };
+
+    VkDeviceMemory memory;
+
+    if (zvar_vk(allocator->device, vkAllocateMemory)(allocator->device, &allocate_info, zvar_get_device_allocation_callbacks(allocator->device), &memory) != VK_SUCCESS)
+        return NULL;
+
+    zvar_instrument_memory(memory_type, size);
+
+    void *mapped = NULL;
+
+    if (allocator->memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        ZVAR_CHECK(zvar_vk(allocator->device, vkMapMemory)(allocator->device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    }
+
+    zvar_memory_block_t *block = zvar_realloc(NULL, sizeof(zvar_memory_block_t));
+
+    *block = (zvar_memory_block_t) {
+        .memory = memory,
+        .size = size,
+        .mapped = mapped,
+        .memory_type = memory_type,
+        .optimal = optimal,
+        .unused_nodes = ZVAR_NO_INDEX,
+    };
+
+    memset(block->free_heads, 0xFF, sizeof(block->free_heads));
+
+    uint32_t index = zvar_tlsf_new_node(block);
+
+    block->nodes[index] = (zvar_tlsf_node_t) {
+        .offset = 0,
+        .size = size,
+        .prev_physical = ZVAR_NO_INDEX,
+        .next_physical = ZVAR_NO_INDEX,
+    };
+
+    zvar_tlsf_insert_free(block, index);
+
+    if (allocator->block_count == allocator->block_capacity) {
+        allocator->block_capacity = allocator->block_capacity ? allocator->block_capacity * 2 : 16;
+        allocator->blocks = zvar_realloc(allocator->blocks, allocator->block_capacity * sizeof(zvar_memory_block_t *));
+    }
+
+    allocator->blocks[allocator->block_count++] = block;
+    allocator->reserved_bytes += size;
+
+    return block;
+}
+
+
+static void zvar_destroy_memory_block(zvar_allocator_t *allocator, zvar_memory_block_t *block)
+{
+    for (uint32_t i = 0; i < allocator->block_count; ++i) {
+        if (allocator->blocks[i] == block) {
+            allocator->blocks[i] = allocator->blocks[--allocator->block_count];
+            break;
+        }
+    }
+
+    allocator->reserved_bytes -= block->size;
+
+    // NOTE: Freeing implicitly unmaps.
+    zvar_vk(allocator->device, vkFreeMemory)(allocator->device, block->memory, zvar_get_device_allocation_callbacks(allocator->device));
+
+    free(block->nodes);
+    free(block);
+}
+
+
+bool zvar_create_allocator(const zvar_allocator_create_info_t *info, zvar_allocator_t *allocator)
+{
+    const zvar_device_capabilities_t *capabilities = zvar_get_device_capabilities(info->physical_device);
+
+    *allocator = (zvar_allocator_t) {
+        .device = info->device,
+        .memory_properties = capabilities->memory_properties,
+        .buffer_image_granularity = capabilities->properties.limits.bufferImageGranularity,
+        .non_coherent_atom_size = capabilities->properties.limits.nonCoherentAtomSize,
+        .block_size = info->block_size ? info->block_size : ZVAR_DEFAULT_MEMORY_BLOCK_SIZE,
+    };
+
+    return true;
+}
+
+
+void zvar_destroy_allocator(zvar_allocator_t *allocator)
+{
+    while (allocator->block_count) {
+        zvar_destroy_memory_block(allocator, allocator->blocks[allocator->block_count - 1]);
+    }
+
+    free(allocator->blocks);
+
+    *allocator = (zvar_allocator_t) {0};
+}
+
+
+static bool zvar_suballocate_from_type(zvar_allocator_t *allocator, uint32_t memory_type, VkDeviceSize size, VkDeviceSize alignment, bool optimal, zvar_allocation_t *allocation)
+{
+    VkMemoryPropertyFlags properties = allocator->memory_properties.memoryTypes[memory_type].propertyFlags;
+
+    // Flushing and invalidation work in whole atoms, keep them from spilling into neighbours.
+    if ((properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        if (alignment < allocator->non_coherent_atom_size) {
+            alignment = allocator->non_coherent_atom_size;
+        }
+
+        size = zvar_align_up(size, allocator->non_coherent_atom_size);
+    }
+
+    // dedicated allocation
+    if (size > allocator->block_size / 2) {
+        VkMemoryAllocateInfo allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = size,
+            .memoryTypeIndex = memory_type,
+        };
+
+        VkDeviceMemory memory;
+
+        if (zvar_vk(allocator->device, vkAllocateMemory)(allocator->device, &allocate_info, zvar_get_device_allocation_callbacks(allocator->device), &memory) != VK_SUCCESS)
+            return false;
+
+        zvar_instrument_memory(memory_type, size);
+
+        void *mapped = NULL;
+
+        if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            ZVAR_CHECK(zvar_vk(allocator->device, vkMapMemory)(allocator->device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+        }
+
+        *allocation = (zvar_allocation_t) {
+            .memory = memory,
+            .offset = 0,
+            .size = size,
+            .mapped = mapped,
+            .memory_type = memory_type,
+            .block = NULL,
+            .node = ZVAR_NO_INDEX,
+        };
+
+        allocator->dedicated_count++;
+        allocator->reserved_bytes += size;
+        return true;
+    }
+
+    zvar_memory_block_t *block = NULL;
+    uint32_t node = ZVAR_NO_INDEX;
+
+    for (uint32_t i = 0; i < allocator->block_count; ++i) {
+        zvar_memory_block_t *b = allocator->blocks[i];
+
+        if (b->memory_type != memory_type || b->optimal != optimal)
+            continue;
+
+        node = zvar_memory_block_allocate(b, size, alignment);
+
+        if (node != ZVAR_NO_INDEX) {
+            block = b;
+            break;
+        }
+    }
+
+    if (!block) {
+        // Back off to smaller blocks when the heap is getting full.
+        VkDeviceSize block_size = allocator->block_size;
+
+        while (!block && block_size >= size + alignment) {
+            block = zvar_create_memory_block(allocator, memory_type, block_size, optimal);
+            block_size /= 2;
+        }
+
+        if (!block)
+            return false;
+
+        node = zvar_memory_block_allocate(block, size, alignment);
+    }
+
+    zvar_tlsf_node_t *n = block->nodes + node;
+
+    *allocation = (zvar_allocation_t) {
+        .memory = block->memory,
+        .offset = n->offset,
+        .size = n->size,
+        .mapped = block->mapped ? (uint8_t *)block->mapped + n->offset : NULL,
+        .memory_type = memory_type,
+        .block = block,
+        .node = node,
+    };
+
+    return true;
+}
+
+
+bool zvar_suballocate_memory(zvar_allocator_t *allocator, const VkMemoryRequirements *requirements, VkMemoryPropertyFlags required_properties, bool optimal_image, zvar_allocation_t *allocation)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_SUBALLOCATE_MEMORY);
+
+    // No reason to separate the resources when the granularity can't be violated.
+    bool optimal = allocator->buffer_image_granularity > 1 ? optimal_image : false;
+
+    VkDeviceSize alignment = requirements->alignment ? requirements->alignment : 1;
+
+    uint32_t type_count = allocator->memory_properties.memoryTypeCount;
+
+    for (uint32_t memory_type = 0; memory_type < type_count; ++memory_type) {
+        if (!(requirements->memoryTypeBits & (1u << memory_type)))
+            continue;
+
+        VkMemoryPropertyFlags properties = allocator->memory_properties.memoryTypes[memory_type].propertyFlags;
+
+        if ((properties & required_properties) != required_properties)
+            continue;
+
+        if (zvar_suballocate_from_type(allocator, memory_type, requirements->size, alignment, optimal, allocation)) {
+            allocator->allocation_count++;
+            allocator->used_bytes += allocation->size;
+            zvar_instrument_end(ZVAR_COUNTER_SUBALLOCATE_MEMORY);
+            return true;
+        }
+    }
+
+    zvar_instrument_end(ZVAR_COUNTER_SUBALLOCATE_MEMORY);
+    return false;
+}
+
+
+void zvar_free_suballocation(zvar_allocator_t *allocator, zvar_allocation_t *allocation)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_FREE_SUBALLOCATION);
+
+    if (allocation->memory == VK_NULL_HANDLE) {
+        zvar_instrument_end(ZVAR_COUNTER_FREE_SUBALLOCATION);
+        return;
+    }
+
+    allocator->allocation_count--;
+    allocator->used_bytes -= allocation->size;
+
+    zvar_memory_block_t *block = allocation->block;
+
+    if (!block) {
+        zvar_vk(allocator->device, vkFreeMemory)(allocator->device, allocation->memory, zvar_get_device_allocation_callbacks(allocator->device));
+
+        allocator->dedicated_count--;
+        allocator->reserved_bytes -= allocation->size;
+    }
+    else {
+        zvar_memory_block_free(block, allocation->node);
+
+        // Keep at most one empty block per memory type around so freeing and allocating in a loop doesn't thrash.
+        if (block->allocation_count == 0) {
+            for (uint32_t i = 0; i < allocator->block_count; ++i) {
+                zvar_memory_block_t *b = allocator->blocks[i];
+
+                if (b != block && b->allocation_count == 0 && b->memory_type == block->memory_type && b->optimal == block->optimal) {
+                    zvar_destroy_memory_block(allocator, block);
+                    break;
+                }
+            }
+        }
+    }
+
+    *allocation = (zvar_allocation_t) {0};
+
+    zvar_instrument_end(ZVAR_COUNTER_FREE_SUBALLOCATION);
+}
+
+
+bool zvar_allocate_buffer_memory(zvar_allocator_t *allocator, VkBuffer buffer, VkMemoryPropertyFlags required_properties, zvar_allocation_t *allocation)
+{
+    VkMemoryRequirements requirements = zvar_get_buffer_memory_requirements(allocator->device, buffer);
+
+    if (!zvar_suballocate_memory(allocator, &requirements, required_properties, false, allocation))
+        return false;
+
+    ZVAR_CHECK(zvar_vk(allocator->device, vkBindBufferMemory)(allocator->device, buffer, allocation->memory, allocation->offset));
+
+    return true;
+}
+
+
+bool zvar_allocate_image_memory(zvar_allocator_t *allocator, VkImage image, VkMemoryPropertyFlags required_properties, zvar_allocation_t *allocation)
+{
+    VkMemoryRequirements requirements = zvar_get_image_memory_requirements(allocator->device, image);
+
+    // NOTE: zvar only creates optimally tiled images.
+    if (!zvar_suballocate_memory(allocator, &requirements, required_properties, true, allocation))
+        return false;
+
+    ZVAR_CHECK(zvar_vk(allocator->device, vkBindImageMemory)(allocator->device, image, allocation->memory, allocation->offset));
+
+    return true;
+}
+
+
+static uint32_t zvar_add_upload_batch(zvar_upload_context_t *context)
+{
+    if (context->batch_count == context->batch_capacity) {
+        context->batch_capacity = context->batch_capacity ? context->batch_capacity * 2 : 4;
+        context->batches = zvar_realloc(context->batches, context->batch_capacity * sizeof(zvar_upload_batch_t));
+    }
+
+    zvar_upload_batch_t *batch = context->batches + context->batch_count;
+
+    *batch = (zvar_upload_batch_t) {
+        .fence = zvar_create_fence(context->device, 0),
+    };
+
+    zvar_allocate_command_buffers(context->device, context->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &batch->command_buffer);
+
+    return context->batch_count++;
+}
+
+
+void zvar_create_upload_context(const zvar_upload_context_create_info_t *info, zvar_upload_context_t *context)
+{
+    *context = (zvar_upload_context_t) {
+        .device = info->device,
+        .queue = info->queue,
+        .recording_batch = ZVAR_NO_INDEX,
+    };
+
+    context->command_pool = zvar_create_command_pool(info->device,
+                                                     VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                                                     info->queue_family_index);
+
+    uint32_t batch_count = info->initial_batch_count ? info->initial_batch_count : 4;
+
+    for (uint32_t i = 0; i < batch_count; ++i) {
+        zvar_add_upload_batch(context);
+    }
+}
+
+
+void zvar_destroy_upload_context(zvar_upload_context_t *context)
+{
+    if (context->recording_batch != ZVAR_NO_INDEX) {
+        zvar_submit_uploads(context);
+    }
+
+    zvar_wait_for_upload(context, context->last_ticket);
+
+    for (uint32_t i = 0; i < context->batch_count; ++i) {
+        zvar_vk(context->device, vkDestroyFence)(context->device, context->batches[i].fence, zvar_get_device_allocation_callbacks(context->device));
+    }
+
+    // NOTE: Frees the command buffers as well.
+    zvar_vk(context->device, vkDestroyCommandPool)(context->device, context->command_pool, zvar_get_device_allocation_callbacks(context->device));
+
+    free(context->batches);
+
+    *context = (zvar_upload_context_t) {0};
+}
+
+
+uint64_t zvar_get_completed_upload_ticket(zvar_upload_context_t *context)
+{
+    // NOTE: Fences of one queue aren't guaranteed to signal in order,
+    //       so the oldest batch still in flight decides.
+    uint64_t oldest_pending = context->last_ticket + 1;
+
+    for (uint32_t i = 0; i < context->batch_count; ++i) {
+        zvar_upload_batch_t *batch = context->batches + i;
+
+        if (!batch->pending)
+            continue;
+
+        VkResult res = zvar_vk(context->device, vkGetFenceStatus)(context->device, batch->fence);
+
+        if (res == VK_SUCCESS) {
+            ZVAR_CHECK(zvar_vk(context->device, vkResetFences)(context->device, 1, &batch->fence));
+            batch->pending = false;
+            continue;
+        }
+
+        if (res != VK_NOT_READY) {
+            ZVAR_CHECK(res);
+        }
+
+        if (batch->ticket < oldest_pending) {
+            oldest_pending = batch->ticket;
+        }
+    }
+
+    context->completed_ticket = oldest_pending - 1;
+
+    return context->completed_ticket;
+}
+
+
+bool zvar_is_upload_complete(zvar_upload_context_t *context, uint64_t ticket)
+{
+    if (ticket <= context->completed_ticket)
+        return true;
+
+    return ticket <= zvar_get_completed_upload_ticket(context);
+}
+
+
+void zvar_wait_for_upload(zvar_upload_context_t *context, uint64_t ticket)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_WAIT_FOR_UPLOAD);
+
+    if (zvar_is_upload_complete(context, ticket)) {
+        zvar_instrument_end(ZVAR_COUNTER_WAIT_FOR_UPLOAD);
+        return;
+    }
+
+    for (uint32_t i = 0; i < context->batch_count; ++i) {
+        zvar_upload_batch_t *batch = context->batches + i;
+
+        if (batch->pending && batch->ticket <= ticket) {
+            ZVAR_CHECK(zvar_vk(context->device, vkWaitForFences)(context->device, 1, &batch->fence, VK_TRUE, ~0ull));
+        }
+    }
+
+    zvar_get_completed_upload_ticket(context);
+
+    zvar_instrument_end(ZVAR_COUNTER_WAIT_FOR_UPLOAD);
+}
+
+
+VkCommandBuffer zvar_get_upload_command_buffer(zvar_upload_context_t *context)
+{
+    if (context->recording_batch != ZVAR_NO_INDEX)
+        return context->batches[context->recording_batch].command_buffer;
+
+    zvar_get_completed_upload_ticket(context);
+
+    uint32_t index = 0;
+
+    for (; index < context->batch_count; ++index) {
+        if (!context->batches[index].pending)
+            break;
+    }
+
+    // Everything is in flight, grow instead of stalling.
+    if (index == context->batch_count) {
+        index = zvar_add_upload_batch(context);
+    }
+
+    zvar_upload_batch_t *batch = context->batches + index;
+
+    ZVAR_CHECK(zvar_vk(batch->command_buffer, vkResetCommandBuffer)(batch->command_buffer, 0));
+
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    ZVAR_CHECK(zvar_vk(batch->command_buffer, vkBeginCommandBuffer)(batch->command_buffer, &begin_info));
+
+    context->recording_batch = index;
+    context->recorded_command_count = 0;
+
+    return batch->command_buffer;
+}
+
+
+void zvar_upload_buffer(zvar_upload_context_t *context, VkBuffer src, VkDeviceSize src_offset, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size)
+{
+    VkCommandBuffer command_buffer = zvar_get_upload_command_buffer(context);
+
+    VkBufferCopy region = {
+        .srcOffset = src_offset,
+        .dstOffset = dst_offset,
+        .size = size,
+    };
+
+    zvar_vk(command_buffer, vkCmdCopyBuffer)(command_buffer, src, dst, 1, &region);
+
+    context->recorded_command_count++;
+}
+
+
+void zvar_upload_2d_image(zvar_upload_context_t *context, VkBuffer src, VkDeviceSize src_offset, VkImage dst, VkImageAspectFlags aspect_mask, uint32_t width, uint32_t height, VkImageLayout final_layout)
+{
+    VkCommandBuffer command_buffer = zvar_get_upload_command_buffer(context);
+
+    VkImageSubresourceRange range = {
+        .aspectMask = aspect_mask,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    VkImageMemoryBarrier to_transfer = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = dst,
+        .subresourceRange = range,
+    };
+
+    zvar_vk(command_buffer, vkCmdPipelineBarrier)(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, NULL, 0, NULL, 1, &to_transfer);
+
+    VkBufferImageCopy region = {
+        .bufferOffset = src_offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = aspect_mask,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { width, height, 1 },
+    };
+
+    zvar_vk(command_buffer, vkCmdCopyBufferToImage)(command_buffer, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    if (final_layout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        VkImageMemoryBarrier to_final = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = 0,
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = final_layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = dst,
+            .subresourceRange = range,
+        };
+
+        // NOTE: Visibility for the consumer is provided by the semaphore or fence wait that follows the submission.
+        zvar_vk(command_buffer, vkCmdPipelineBarrier)(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                             0, NULL, 0, NULL, 1, &to_final);
+    }
+
+    context->recorded_command_count++;
+}
+
+
+uint64_t zvar_submit_uploads(zvar_upload_context_t *context)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_SUBMIT_UPLOADS);
+
+    if (context->recording_batch == ZVAR_NO_INDEX) {
+        zvar_instrument_end(ZVAR_COUNTER_SUBMIT_UPLOADS);
+        return context->last_ticket;
+    }
+
+    zvar_upload_batch_t *batch = context->batches + context->recording_batch;
+
+    ZVAR_CHECK(zvar_vk(batch->command_buffer, vkEndCommandBuffer)(batch->command_buffer));
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch->command_buffer,
+    };
+
+    ZVAR_CHECK(zvar_vk(context->queue, vkQueueSubmit)(context->queue, 1, &submit_info, batch->fence));
+
+    batch->ticket  = ++context->last_ticket;
+    batch->pending = true;
+
+    context->recording_batch = ZVAR_NO_INDEX;
+
+    zvar_instrument_end(ZVAR_COUNTER_SUBMIT_UPLOADS);
+    return batch->ticket;
+}
+
+
+bool zvar_create_staging_ring(const zvar_staging_ring_create_info_t *info, zvar_staging_ring_t *ring)
+{
+    zvar_allocator_t *allocator = info->allocator;
+
+    *ring = (zvar_staging_ring_t) {
+        .device = allocator->device,
+        .allocator = allocator,
+        .atom_size = allocator->non_coherent_atom_size,
+        .timeline_semaphore = info->timeline_semaphore,
+        .upload_context = info->upload_context,
+    };
+
+    VkDeviceSize size = zvar_align_up(info->size, ring->atom_size);
+
+    ring->buffer = zvar_create_buffer_exclusive(ring->device, 0, size, info->usage ? info->usage : VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+    // prefer coherent memory so nothing has to be flushed
+    if (!zvar_allocate_buffer_memory(allocator, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->allocation)
+     && !zvar_allocate_buffer_memory(allocator, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &ring->allocation))
+    {
+        zvar_vk(ring->device, vkDestroyBuffer)(ring->device, ring->buffer, zvar_get_device_allocation_callbacks(ring->device));
+        return false;
+    }
+
+    VkMemoryPropertyFlags properties = allocator->memory_properties.memoryTypes[ring->allocation.memory_type].propertyFlags;
+
+    ring->coherent = properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    ring->mapped = ring->allocation.mapped;
+    ring->size = size;
+
+    return true;
+}
+
+
+void zvar_destroy_staging_ring(zvar_staging_ring_t *ring)
+{
+    zvar_vk(ring->device, vkDestroyBuffer)(ring->device, ring->buffer, zvar_get_device_allocation_callbacks(ring->device));
+    zvar_free_suballocation(ring->allocator, &ring->allocation);
+
+    free(ring->fences);
+
+    *ring = (zvar_staging_ring_t) {0};
+}
+
+
+void zvar_retire_staging_ring(zvar_staging_ring_t *ring, uint64_t completed_value)
+{
+    while (ring->fence_count) {
+        zvar_staging_fence_t *fence = ring->fences + ring->fence_first;
+
+        if (fence->value > completed_value)
+            break;
+
+        ring->tail = fence->end;
+        ring->fence_first = (ring->fence_first + 1) % ring->fence_capacity;
+        ring->fence_count--;
+    }
+}
+
+
+void zvar_reclaim_staging_ring(zvar_staging_ring_t *ring)
+{
+    if (!ring->fence_count)
+        return;
+
+    uint64_t completed_value;
+
+    if (ring->timeline_semaphore) {
+        ZVAR_CHECK(zvar_vk(ring->device, vkGetSemaphoreCounterValue)(ring->device, ring->timeline_semaphore, &completed_value));
+    }
+    else if (ring->upload_context) {
+        completed_value = zvar_get_completed_upload_ticket(ring->upload_context);
+    }
+    else return;
+
+    zvar_retire_staging_ring(ring, completed_value);
+}
+
+
+bool zvar_allocate_staging_slice(zvar_staging_ring_t *ring, VkDeviceSize size, VkDeviceSize alignment, zvar_staging_slice_t *slice)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_ALLOCATE_STAGING_SLICE);
+
+    if (!ring->coherent) {
+        // Slices have to start and end on atoms so flushing one never touches another.
+        if (alignment < ring->atom_size) {
+            alignment = ring->atom_size;
+        }
+
+        size = zvar_align_up(size, ring->atom_size);
+    }
+
+    if (size > ring->size) {
+        zvar_instrument_end(ZVAR_COUNTER_ALLOCATE_STAGING_SLICE);
+        return false;
+    }
+
+    uint64_t position = ring->head % ring->size;
+    uint64_t start = zvar_align_up(position, alignment ? alignment : 1);
+    uint64_t head = ring->head + (start - position);
+
+    // Doesn't fit before the end, the rest of the lap is wasted.
+    if (start + size > ring->size) {
+        head = ring->head + (ring->size - position);
+        start = 0;
+    }
+
+    if (head + size - ring->tail > ring->size) {
+        zvar_reclaim_staging_ring(ring);
+
+        if (head + size - ring->tail > ring->size) {
+            zvar_instrument_end(ZVAR_COUNTER_ALLOCATE_STAGING_SLICE);
+            return false;
+        }
+    }
+
+    ring->head = head + size;
+
+    *slice = (zvar_staging_slice_t) {
+        .buffer = ring->buffer,
+        .offset = start,
+        .size = size,
+        .mapped = ring->mapped + start,
+    };
+
+    zvar_instrument_end(ZVAR_COUNTER_ALLOCATE_STAGING_SLICE);
+    return true;
+}
+
+
+static void zvar_flush_staging_range(zvar_staging_ring_t *ring, uint64_t begin, uint64_t end)
+{
+    if (begin == end)
+        return;
+
+    VkMappedMemoryRange range = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = ring->allocation.memory,
+        .offset = ring->allocation.offset + begin,
+        .size = end - begin,
+    };
+
+    ZVAR_CHECK(zvar_vk(ring->device, vkFlushMappedMemoryRanges)(ring->device, 1, &range));
+}
+
+
+void zvar_fence_staging_ring(zvar_staging_ring_t *ring, uint64_t value)
+{
+    if (ring->head == ring->fenced)
+        return;
+
+    if (!ring->coherent) {
+        uint64_t begin = ring->fenced % ring->size;
+        uint64_t end   = ring->head   % ring->size;
+
+        if (ring->head - ring->fenced >= ring->size || end <= begin) {
+            // wrapped around
+            zvar_flush_staging_range(ring, begin, ring->size);
+            zvar_flush_staging_range(ring, 0, end);
+        }
+        else {
+            zvar_flush_staging_range(ring, begin, end);
+        }
+    }
+
+    if (ring->fence_count == ring->fence_capacity) {
+        uint32_t capacity = ring->fence_capacity ? ring->fence_capacity * 2 : 16;
+        zvar_staging_fence_t *fences = zvar_realloc(NULL, capacity * sizeof(zvar_staging_fence_t));
+
+        for (uint32_t i = 0; i < ring->fence_count; ++i) {
+            fences[i] = ring->fences[(ring->fence_first + i) % ring->fence_capacity];
+        }
+
+        free(ring->fences);
+
+        ring->fences = fences;
+        ring->fence_first = 0;
+        ring->fence_capacity = capacity;
+    }
+
+    ring->fences[(ring->fence_first + ring->fence_count) % ring->fence_capacity] = (zvar_staging_fence_t) {
+        .value = value,
+        .end = ring->head,
+    };
+
+    ring->fence_count++;
+    ring->fenced = ring->head;
+}
+
+
+void zvar_create_fence_pool(VkDevice device, zvar_fence_pool_t *pool)
+{
+    *pool = (zvar_fence_pool_t) {
+        .device = device,
+    };
+}
+
+
+void zvar_destroy_fence_pool(zvar_fence_pool_t *pool)
+{
+    for (uint32_t i = 0; i < pool->ready_count; ++i) {
+        zvar_vk(pool->device, vkDestroyFence)(pool->device, pool->ready[i], zvar_get_device_allocation_callbacks(pool->device));
+    }
+
+    for (uint32_t i = 0; i < pool->signaled_count; ++i) {
+        zvar_vk(pool->device, vkDestroyFence)(pool->device, pool->signaled[i], zvar_get_device_allocation_callbacks(pool->device));
+    }
+
+    for (uint32_t i = 0; i < pool->pending_count; ++i) {
+        zvar_vk(pool->device, vkDestroyFence)(pool->device, pool->pending[i], zvar_get_device_allocation_callbacks(pool->device));
+    }
+
+    free(pool->ready);
+    free(pool->signaled);
+    free(pool->pending);
+
+    *pool = (zvar_fence_pool_t) {0};
+}
+
+
+VkFence zvar_acquire_fence(zvar_fence_pool_t *pool)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_ACQUIRE_FENCE);
+
+    if (!pool->ready_count && !pool->signaled_count) {
+        // move the ones that finished since to the signaled list
+        for (uint32_t i = 0; i < pool->pending_count;) {
+            VkResult res = zvar_vk(pool->device, vkGetFenceStatus)(pool->device, pool->pending[i]);
+
+            if (res == VK_SUCCESS) {
+                zvar_array_push(pool->signaled, pool->signaled_count, pool->signaled_capacity, pool->pending[i]);
+                pool->pending[i] = pool->pending[--pool->pending_count];
+                continue;
+            }
+
+            if (res != VK_NOT_READY) {
+                ZVAR_CHECK(res);
+            }
+
+            ++i;
+        }
+    }
+
+    if (!pool->ready_count && pool->signaled_count) {
+        // one call for all of them
+        ZVAR_CHECK(zvar_vk(pool->device, vkResetFences)(pool->device, pool->signaled_count, pool->signaled));
+
+        for (uint32_t i = 0; i < pool->signaled_count; ++i) {
+            zvar_array_push(pool->ready, pool->ready_count, pool->ready_capacity, pool->signaled[i]);
+        }
+
+        pool->signaled_count = 0;
+    }
+
+    if (pool->ready_count) {
+        pool->reused_count++;
+        zvar_instrument_end(ZVAR_COUNTER_ACQUIRE_FENCE);
+        return pool->ready[--pool->ready_count];
+    }
+
+    pool->created_count++;
+    VkFence fence = zvar_create_fence(pool->device, 0);
+
+    zvar_instrument_end(ZVAR_COUNTER_ACQUIRE_FENCE);
+
+    return fence;
+}
+
+
+void zvar_release_fence(zvar_fence_pool_t *pool, VkFence fence)
+{
+    zvar_array_push(pool->signaled, pool->signaled_count, pool->signaled_capacity, fence);
+}
+
+
+void zvar_release_pending_fence(zvar_fence_pool_t *pool, VkFence fence)
+{
+    zvar_array_push(pool->pending, pool->pending_count, pool->pending_capacity, fence);
+}
+
+
+void zvar_create_semaphore_pool(VkDevice device, zvar_semaphore_pool_t *pool)
+{
+    *pool = (zvar_semaphore_pool_t) {
+        .device = device,
+    };
+}
+
+
+void zvar_destroy_semaphore_pool(zvar_semaphore_pool_t *pool)
+{
+    for (uint32_t i = 0; i < pool->ready_count; ++i) {
+        zvar_vk(pool->device, vkDestroySemaphore)(pool->device, pool->ready[i], zvar_get_device_allocation_callbacks(pool->device));
+    }
+
+    free(pool->ready);
+
+    *pool = (zvar_semaphore_pool_t) {0};
+}
+
+
+VkSemaphore zvar_acquire_semaphore(zvar_semaphore_pool_t *pool)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_ACQUIRE_SEMAPHORE);
+
+    if (pool->ready_count) {
+        pool->reused_count++;
+        zvar_instrument_end(ZVAR_COUNTER_ACQUIRE_SEMAPHORE);
+        return pool->ready[--pool->ready_count];
+    }
+
+    pool->created_count++;
+    VkSemaphore semaphore = zvar_create_semaphore(pool->device);
+
+    zvar_instrument_end(ZVAR_COUNTER_ACQUIRE_SEMAPHORE);
+
+    return semaphore;
+}
+
+
+void zvar_release_semaphore(zvar_semaphore_pool_t *pool, VkSemaphore semaphore)
+{
+    zvar_array_push(pool->ready, pool->ready_count, pool->ready_capacity, semaphore);
+}
+
+
+static bool zvar_create_frame_loop_clique(zvar_frame_loop_t *loop)
+{
+    if (loop->framebuffers) {
+        return zvar_create_swapchain_clique(&loop->swapchain_info,
+                                            &loop->swapchain, &loop->width, &loop->height, &loop->image_count, loop->views, loop->framebuffers,
+                                            &loop->color_image, &loop->color_view,
+                                            &loop->depth_image, &loop->depth_memory, &loop->depth_memory_size, &loop->depth_view);
+    }
+
+    return zvar_create_dynamic_swapchain_clique(&loop->swapchain_info,
+                                                &loop->swapchain, &loop->width, &loop->height, &loop->image_count, loop->images, loop->views,
+                                                &loop->color_image, &loop->color_view,
+                                                &loop->depth_image, &loop->depth_memory, &loop->depth_memory_size, &loop->depth_view);
+}
+
+
+static bool zvar_recreate_frame_loop_clique(zvar_frame_loop_t *loop)
+{
+    // NOTE: Recreation is rare enough for a full idle to be the simplest safe option.
+    //       The old clique is retired by zvar_create_swapchain_clique.
+    ZVAR_CHECK(zvar_vk(loop->swapchain_info.device, vkDeviceWaitIdle)(loop->swapchain_info.device));
+
+    if (!zvar_create_frame_loop_clique(loop))
+    {
+        loop->needs_recreation = true;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < loop->image_count; ++i) {
+        loop->image_fences[i] = VK_NULL_HANDLE;
+    }
+
+    loop->needs_recreation = false;
+    loop->recreation_count++;
+
+    return true;
+}
+
+
+void zvar_create_frame_loop(const zvar_frame_loop_create_info_t *info, zvar_frame_loop_t *loop)
+{
+    VkDevice device = info->swapchain_info.device;
+    uint32_t max_image_count = info->swapchain_info.maximum_image_count;
+    uint32_t frame_count = info->frames_in_flight ? info->frames_in_flight : 2;
+
+    *loop = (zvar_frame_loop_t) {
+        .swapchain_info = info->swapchain_info,
+        .graphics_queue = info->graphics_queue,
+        .present_queue = info->present_queue,
+        .width = info->width,
+        .height = info->height,
+        .frame_count = frame_count,
+    };
+
+    // Everything is sized upfront so the loop itself never allocates.
+    loop->views           = zvar_realloc(NULL, max_image_count * sizeof(VkImageView));
+    loop->render_finished = zvar_realloc(NULL, max_image_count * sizeof(VkSemaphore));
+    loop->image_fences    = zvar_realloc(NULL, max_image_count * sizeof(VkFence));
+    loop->frames          = zvar_realloc(NULL, frame_count * sizeof(zvar_frame_t));
+
+    // NOTE: Without a render pass the frames render with dynamic rendering, which needs the images instead of framebuffers.
+    if (info->swapchain_info.render_pass != VK_NULL_HANDLE) {
+        loop->framebuffers = zvar_realloc(NULL, max_image_count * sizeof(VkFramebuffer));
+    }
+    else {
+        loop->images = zvar_realloc(NULL, max_image_count * sizeof(VkImage));
+    }
+
+    for (uint32_t i = 0; i < max_image_count; ++i) {
+        loop->render_finished[i] = zvar_create_semaphore(device);
+        loop->image_fences[i] = VK_NULL_HANDLE;
+    }
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        zvar_frame_t *frame = loop->frames + i;
+
+        frame->command_pool = zvar_create_command_pool(device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, info->graphics_queue_family_index);
+        zvar_allocate_command_buffers(device, frame->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &frame->command_buffer);
+        frame->image_acquired = zvar_create_semaphore(device);
+        // Signaled so the first wait on every slot passes.
+        frame->in_flight = zvar_create_fence(device, VK_FENCE_CREATE_SIGNALED_BIT);
+    }
+
+    if (!zvar_create_frame_loop_clique(loop))
+    {
+        loop->needs_recreation = true;
+    }
+}
+
+
+void zvar_destroy_frame_loop(zvar_frame_loop_t *loop)
+{
+    VkDevice device = loop->swapchain_info.device;
+
+    ZVAR_CHECK(zvar_vk(device, vkDeviceWaitIdle)(device));
+
+    if (loop->swapchain) {
+        for (uint32_t i = 0; i < loop->image_count; ++i) {
+            if (loop->framebuffers) {
+                zvar_vk(device, vkDestroyFramebuffer)(device, loop->framebuffers[i], zvar_get_device_allocation_callbacks(device));
+            }
+
+            zvar_vk(device, vkDestroyImageView)(device, loop->views[i], zvar_get_device_allocation_callbacks(device));
+        }
+
+        if (loop->color_image != VK_NULL_HANDLE) {
+            zvar_vk(device, vkDestroyImageView)(device, loop->color_view, zvar_get_device_allocation_callbacks(device));
+            zvar_vk(device, vkDestroyImage)(device, loop->color_image, zvar_get_device_allocation_callbacks(device));
+        }
+
+        zvar_vk(device, vkDestroyImageView)(device, loop->depth_view, zvar_get_device_allocation_callbacks(device));
+        zvar_vk(device, vkDestroyImage)(device, loop->depth_image, zvar_get_device_allocation_callbacks(device));
+        zvar_vk(device, vkFreeMemory)(device, loop->depth_memory, zvar_get_device_allocation_callbacks(device));
+
+        zvar_vk(device, vkDestroySwapchainKHR)(device, loop->swapchain, zvar_get_device_allocation_callbacks(device));
+    }
+
+    for (uint32_t i = 0; i < loop->swapchain_info.maximum_image_count; ++i) {
+        zvar_vk(device, vkDestroySemaphore)(device, loop->render_finished[i], zvar_get_device_allocation_callbacks(device));
+    }
+
+    for (uint32_t i = 0; i < loop->frame_count; ++i) {
+        zvar_frame_t *frame = loop->frames + i;
+
+        zvar_vk(device, vkDestroyCommandPool)(device, frame->command_pool, zvar_get_device_allocation_callbacks(device));
+        zvar_vk(device, vkDestroySemaphore)(device, frame->image_acquired, zvar_get_device_allocation_callbacks(device));
+        zvar_vk(device, vkDestroyFence)(device, frame->in_flight, zvar_get_device_allocation_callbacks(device));
+    }
+
+    free(loop->images);
+    free(loop->views);
+    free(loop->framebuffers);
+    free(loop->render_finished);
+    free(loop->image_fences);
+    free(loop->frames);
+
+    *loop = (zvar_frame_loop_t) {0};
+}
+
+
+void zvar_invalidate_frame_loop(zvar_frame_loop_t *loop)
+{
+    loop->needs_recreation = true;
+}
+
+
+VkCommandBuffer zvar_begin_frame(zvar_frame_loop_t *loop, uint32_t width, uint32_t height)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_BEGIN_FRAME);
+
+    VkDevice device = loop->swapchain_info.device;
+
+    if (loop->needs_recreation) {
+        loop->width  = width;
+        loop->height = height;
+
+        if (!zvar_recreate_frame_loop_clique(loop)) {
+            zvar_instrument_end(ZVAR_COUNTER_BEGIN_FRAME);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    zvar_frame_t *frame = loop->frames + loop->frame_index;
+
+    ZVAR_CHECK(zvar_vk(device, vkWaitForFences)(device, 1, &frame->in_flight, VK_TRUE, ~0ull));
+
+    VkResult res = zvar_vk(device, vkAcquireNextImageKHR)(device, loop->swapchain, ~0ull, frame->image_acquired, VK_NULL_HANDLE, &loop->image_index);
+
+    if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+        loop->width  = width;
+        loop->height = height;
+
+        if (!zvar_recreate_frame_loop_clique(loop)) {
+            zvar_instrument_end(ZVAR_COUNTER_BEGIN_FRAME);
+            return VK_NULL_HANDLE;
+        }
+
+        res = zvar_vk(device, vkAcquireNextImageKHR)(device, loop->swapchain, ~0ull, frame->image_acquired, VK_NULL_HANDLE, &loop->image_index);
+
+        if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+            loop->needs_recreation = true;
+            zvar_instrument_end(ZVAR_COUNTER_BEGIN_FRAME);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    if (res == VK_SUBOPTIMAL_KHR) {
+        // Still presentable, recreate after this frame.
+        loop->needs_recreation = true;
+    }
+    else {
+        ZVAR_CHECK(res);
+    }
+
+    // More images than frames in flight, the image may still be used by an older frame.
+    VkFence *image_fence = loop->image_fences + loop->image_index;
+
+    if (*image_fence != VK_NULL_HANDLE && *image_fence != frame->in_flight) {
+        ZVAR_CHECK(zvar_vk(device, vkWaitForFences)(device, 1, image_fence, VK_TRUE, ~0ull));
+    }
+
+    *image_fence = frame->in_flight;
+
+    // NOTE: Reset only after a successful acquire, bailing out earlier leaves the fence signaled.
+    ZVAR_CHECK(zvar_vk(device, vkResetFences)(device, 1, &frame->in_flight));
+    ZVAR_CHECK(zvar_vk(device, vkResetCommandPool)(device, frame->command_pool, 0));
+
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    ZVAR_CHECK(zvar_vk(frame->command_buffer, vkBeginCommandBuffer)(frame->command_buffer, &begin_info));
+
+    zvar_instrument_end(ZVAR_COUNTER_BEGIN_FRAME);
+    return frame->command_buffer;
+}
+
+
+void zvar_end_frame(zvar_frame_loop_t *loop)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_END_FRAME);
+
+    zvar_frame_t *frame = loop->frames + loop->frame_index;
+    VkSemaphore render_finished = loop->render_finished[loop->image_index];
+
+    ZVAR_CHECK(zvar_vk(frame->command_buffer, vkEndCommandBuffer)(frame->command_buffer));
+
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &frame->image_acquired,
+        .pWaitDstStageMask = &(VkPipelineStageFlags){ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
+        .commandBufferCount = 1,
+        .pCommandBuffers = &frame->command_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &render_finished,
+    };
+
+    ZVAR_CHECK(zvar_vk(loop->graphics_queue, vkQueueSubmit)(loop->graphics_queue, 1, &submit_info, frame->in_flight));
+
+    VkPresentInfoKHR present_info = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &render_finished,
+        .swapchainCount = 1,
+        .pSwapchains = &loop->swapchain,
+        .pImageIndices = &loop->image_index,
+    };
+
+    VkResult res = zvar_vk(loop->present_queue, vkQueuePresentKHR)(loop->present_queue, &present_info);
+
+    if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR) {
+        loop->needs_recreation = true;
+    }
+    else {
+        ZVAR_CHECK(res);
+    }
+
+    loop->frame_index = (loop->frame_index + 1) % loop->frame_count;
+    loop->frame_number++;
+
+    zvar_instrument_end(ZVAR_COUNTER_END_FRAME);
+}
+
+/* `images` and `framebuffers` can be NULL, no framebuffers get created or retired then. */
+// TODO: Make depth parameters nullable.
+static bool zvar_create_swapchain_clique_images(const zvar_swapchain_create_info_t *info,
+                                                VkSwapchainKHR *swapchain, uint32_t *width, uint32_t *height, uint32_t *image_count,
+                                                VkImage *images, VkImageView *views, VkFramebuffer *framebuffers,
+                                                VkImage *color_image, VkImageView *color_view,
+                                                VkImage *depth_image, VkDeviceMemory *depth_memory, VkDeviceSize *depth_memory_size, VkImageView *depth_view)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_SWAPCHAIN_CLIQUE);
+
+    // create swapchain
+    {
+        zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+        VkSwapchainKHR old_swapchain = *swapchain;
+
+        VkSurfaceCapabilitiesKHR surface_capabilities;
+        ZVAR_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(info->physical_device, info->surface, &surface_capabilities));
+
+        uint32_t present_mode_count;
+        ZVAR_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(info->physical_device, info->surface, &present_mode_count, NULL));
+        VkPresentModeKHR *present_modes = zvar_get_scratch(present_mode_count * sizeof(VkPresentModeKHR));
+        ZVAR_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(info->physical_device, info->surface, &present_mode_count, present_modes));
+
+        uint32_t present_mode_pref_count = info->present_mode_pref_count;
+        VkPresentModeKHR *present_mode_prefs = info->present_mode_prefs;
+
+        if (present_mode_prefs == ZVAR_VSYNC_DEFAULT_PRESENT_MODE) {
+            present_mode_pref_count = lengthof(default_vsync_present_mode_prefs);
+            present_mode_prefs      = default_vsync_present_mode_prefs;
+        }
+        else if (present_mode_prefs == ZVAR_NOSYNC_DEFAULT_PRESENT_MODE) {
+            present_mode_pref_count = lengthof(default_nosync_present_mode_prefs);
+            present_mode_prefs      = default_nosync_present_mode_prefs;
+        }
+
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+
+        for (uint32_t pi = 0; pi < present_mode_pref_count; ++pi) {
+            VkPresentModeKHR p = present_mode_prefs[pi];
+
+            for (uint32_t i = 0; i < present_mode_count; ++i) {
+                if (present_modes[i] == p) {
+                    present_mode = p;
+                    break;
+                }
+            }
+
+            if (present_mode == p)
+                break;
+        }
+
+        VkExtent2D swapchain_extent = surface_capabilities.currentExtent;
+
+        // In this case width == height.
+        if (surface_capabilities.currentExtent.width == 0xFFFFFFFF) {
+            swapchain_extent = (VkExtent2D) {
+                .width  = *width,
+                .height = *height,
+            };
+
+            if (swapchain_extent.width < surface_capabilities.minImageExtent.width) {
+                swapchain_extent.width = surface_capabilities.minImageExtent.width;
+            }
+            else if (swapchain_extent.width > surface_capabilities.maxImageExtent.width) {
+                swapchain_extent.width = surface_capabilities.maxImageExtent.width;
+            }
+
+            if (swapchain_extent.height < surface_capabilities.minImageExtent.height) {
+                swapchain_extent.height = surface_capabilities.minImageExtent.height;
+            }
+            else if (swapchain_extent.height > surface_capabilities.maxImageExtent.height) {
+                swapchain_extent.height = surface_capabilities.maxImageExtent.height;
+            }
+        }
+        else {
+            *width  = swapchain_extent.width;
+            *height = swapchain_extent.height;
+        }
+
+        if (surface_capabilities.currentExtent.width == 0 || surface_capabilities.currentExtent.height == 0) {
+            zvar_restore_scratch(scratch_mark);
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_SWAPCHAIN_CLIQUE);
+            return false;
+        }
+
+        // Retire the previous clique, its swapchain goes once the new one exists and its depth memory is kept.
+        if (old_swapchain != VK_NULL_HANDLE) {
+            for (uint32_t i = 0; i < *image_count; ++i) {
+                if (framebuffers) {
+                    zvar_vk(info->device, vkDestroyFramebuffer)(info->device, framebuffers[i], zvar_get_device_allocation_callbacks(info->device));
+                }
+
+                zvar_vk(info->device, vkDestroyImageView)(info->device, views[i], zvar_get_device_allocation_callbacks(info->device));
+            }
+
+            if (color_image && *color_image != VK_NULL_HANDLE) {
+                zvar_vk(info->device, vkDestroyImageView)(info->device, *color_view, zvar_get_device_allocation_callbacks(info->device));
+                zvar_vk(info->device, vkDestroyImage)(info->device, *color_image, zvar_get_device_allocation_callbacks(info->device));
+            }
+
+            zvar_vk(info->device, vkDestroyImageView)(info->device, *depth_view, zvar_get_device_allocation_callbacks(info->device));
+            zvar_vk(info->device, vkDestroyImage)(info->device, *depth_image, zvar_get_device_allocation_callbacks(info->device));
+        }
+        else {
+            *depth_memory = VK_NULL_HANDLE;
+            *depth_memory_size = 0;
+        }
+
+        uint32_t swapchain_image_count = info->prefered_image_count;
+
+        if (swapchain_image_count < surface_capabilities.minImageCount) {
+            swapchain_image_count = surface_capabilities.minImageCount;
+        }
+
+        if (surface_capabilities.maxImageCount && swapchain_image_count > surface_capabilities.maxImageCount) {
+            swapchain_image_count = surface_capabilities.maxImageCount;
+        }
+
+        assert(swapchain_image_count <= info->maximum_image_count);
+
+        *image_count = swapchain_image_count;
+
+        VkSurfaceTransformFlagBitsKHR surface_transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+
+        if (!(surface_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)) {
+            surface_transform = surface_capabilities.currentTransform;
+        }
+
+        uint32_t composite_alpha_pref_count = info->composite_alpha_pref_count;
+        VkCompositeAlphaFlagBitsKHR *composite_alpha_prefs = info->composite_alpha_prefs;
+
+        if (composite_alpha_prefs == NULL) {
+            composite_alpha_pref_count = lengthof(default_composite_alpha_prefs);
+            composite_alpha_prefs      = default_composite_alpha_prefs;
+        }
+
+        VkCompositeAlphaFlagBitsKHR composite_alpha = 0;
+        for (uint32_t i = 0; i < composite_alpha_pref_count; ++i) {
+            VkCompositeAlphaFlagBitsKHR ca = composite_alpha_prefs[i];
+
+            if (surface_capabilities.supportedCompositeAlpha & ca) {
+                composite_alpha = ca;
+                break;
+            }
+        }
+
+        VkSwapchainCreateInfoKHR swapchain_create_info = {
+            .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+            .surface = info->surface,
+            .minImageCount = swapchain_image_count,
+            .imageFormat = info->surface_format.format,
+            .imageColorSpace = info->surface_format.colorSpace,
+            .imageExtent = swapchain_extent,
+            .imageArrayLayers = 1,
+            .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+            .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .preTransform = surface_transform,
+            .compositeAlpha = composite_alpha,
+            .presentMode = present_mode,
+            .clipped = VK_TRUE,
+            .oldSwapchain = old_swapchain,
+        };
+
+        ZVAR_CHECK(zvar_vk(info->device, vkCreateSwapchainKHR)(info->device, &swapchain_create_info, zvar_get_device_allocation_callbacks(info->device), swapchain));
+
+        if (old_swapchain != VK_NULL_HANDLE) {
+            zvar_vk(info->device, vkDestroySwapchainKHR)(info->device, old_swapchain, zvar_get_device_allocation_callbacks(info->device));
+        }
+
+        zvar_restore_scratch(scratch_mark);
+    }
+
+    // create depth buffer and multisampled color image
+    {
+        VkSampleCountFlagBits samples = info->samples ? info->samples : VK_SAMPLE_COUNT_1_BIT;
+        bool multisampled = samples != VK_SAMPLE_COUNT_1_BIT;
+
+        *depth_image = zvar_create_2d_attachment_image(info->device, info->depth_format, *width, *height, samples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+        VkMemoryRequirements depth_memory_requirements = zvar_get_image_memory_requirements(info->device, *depth_image);
+        VkMemoryRequirements memory_requirements = depth_memory_requirements;
+        VkDeviceSize color_offset = 0;
+
+        if (multisampled) {
+            assert(color_image && color_view);
+
+            assert(zvar_get_device_capabilities(info->physical_device)->properties.limits.framebufferColorSampleCounts & samples);
+            assert(zvar_get_device_capabilities(info->physical_device)->properties.limits.framebufferDepthSampleCounts & samples);
+
+            *color_image = zvar_create_2d_attachment_image(info->device, info->surface_format.format, *width, *height, samples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+
+            VkMemoryRequirements color_memory_requirements = zvar_get_image_memory_requirements(info->device, *color_image);
+
+            // NOTE: The color image goes right behind the depth image, both live exactly as long.
+            color_offset = zvar_align_up(depth_memory_requirements.size, color_memory_requirements.alignment);
+
+            memory_requirements.size = color_offset + color_memory_requirements.size;
+            memory_requirements.memoryTypeBits &= color_memory_requirements.memoryTypeBits;
+        }
+        else if (color_image) {
+            *color_image = VK_NULL_HANDLE;
+            *color_view  = VK_NULL_HANDLE;
+        }
+
+        uint32_t memory_type = zvar_find_attachment_memory_type(info->physical_device_memory_properties, memory_requirements.memoryTypeBits);
+
+        // The new images alias the old memory unless they outgrew it.
+        if (*depth_memory == VK_NULL_HANDLE || memory_requirements.size > *depth_memory_size) {
+            if (*depth_memory != VK_NULL_HANDLE) {
+                zvar_vk(info->device, vkFreeMemory)(info->device, *depth_memory, zvar_get_device_allocation_callbacks(info->device));
+            }
+
+            uint32_t max_dimension = zvar_get_device_capabilities(info->physical_device)->properties.limits.maxImageDimension2D;
+
+            // Leave headroom so dragging the window bigger doesn't allocate on every step.
+            uint32_t reserve_width  = *width  + *width  / 4;
+            uint32_t reserve_height = *height + *height / 4;
+
+            if (reserve_width  < info->depth_reserve_width)  reserve_width  = info->depth_reserve_width;
+            if (reserve_height < info->depth_reserve_height) reserve_height = info->depth_reserve_height;
+            if (reserve_width  > max_dimension) reserve_width  = max_dimension;
+            if (reserve_height > max_dimension) reserve_height = max_dimension;
+
+            // NOTE: Only used to query the size, never bound.
+            VkImage sizing_image = zvar_create_2d_attachment_image(info->device, info->depth_format, reserve_width, reserve_height, samples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+            VkDeviceSize size = zvar_get_image_memory_requirements(info->device, sizing_image).size;
+            zvar_vk(info->device, vkDestroyImage)(info->device, sizing_image, zvar_get_device_allocation_callbacks(info->device));
+
+            if (multisampled) {
+                sizing_image = zvar_create_2d_attachment_image(info->device, info->surface_format.format, reserve_width, reserve_height, samples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+                VkMemoryRequirements sizing_requirements = zvar_get_image_memory_requirements(info->device, sizing_image);
+                zvar_vk(info->device, vkDestroyImage)(info->device, sizing_image, zvar_get_device_allocation_callbacks(info->device));
+
+                size = zvar_align_up(size, sizing_requirements.alignment) + sizing_requirements.size;
+            }
+
+            if (size < memory_requirements.size) {
+                size = memory_requirements.size;
+            }
+
+            *depth_memory = zvar_allocate_memory(info->device, memory_type, size);
+            *depth_memory_size = size;
+        }
+
+        ZVAR_CHECK(zvar_vk(info->device, vkBindImageMemory)(info->device, *depth_image, *depth_memory, 0));
+
+        VkImageAspectFlags depth_aspect_flags = VK_IMAGE_ASPECT_DEPTH_BIT | (info->depth_format == VK_FORMAT_D32_SFLOAT ? 0 : VK_IMAGE_ASPECT_STENCIL_BIT);
+
+        *depth_view = zvar_create_2d_image_view(info->device, *depth_image, info->depth_format, depth_aspect_flags, 1);
+
+        if (multisampled) {
+            ZVAR_CHECK(zvar_vk(info->device, vkBindImageMemory)(info->device, *color_image, *depth_memory, color_offset));
+
+            *color_view = zvar_create_2d_image_view(info->device, *color_image, info->surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+    }
+
+    // retrieve swapchain images and create views
+    {
+        zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+        VkImage *swapchain_images = images ? images : zvar_get_scratch(*image_count * sizeof(VkImage));
+
+        ZVAR_CHECK(zvar_vk(info->device, vkGetSwapchainImagesKHR)(info->device, *swapchain, image_count, swapchain_images));
+
+        for (uint32_t i = 0; i < *image_count; ++i) {
+            views[i] = zvar_create_2d_image_view(info->device, swapchain_images[i], info->surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+
+        zvar_restore_scratch(scratch_mark);
+    }
+
+    // create framebuffers
+    if (framebuffers) {
+        bool multisampled = info->samples > VK_SAMPLE_COUNT_1_BIT;
+
+        for (uint32_t i = 0; i < *image_count; ++i) {
+            VkFramebufferCreateInfo framebuffer_create_info = {
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                .renderPass = info->render_pass,
+                .attachmentCount = multisampled ? 3 : 2,
+                .pAttachments = (VkImageView[3]) {
+                    [0] = multisampled ? *color_view : views[i],
+                    [1] = *depth_view,
+                    [2] = views[i],
+                },
+                .width  = *width,
+                .height = *height,
+                .layers = 1,
+            };
+
+
+            ZVAR_CHECK(zvar_vk(info->device, vkCreateFramebuffer)(info->device, &framebuffer_create_info, zvar_get_device_allocation_callbacks(info->device), framebuffers + i));
+        }
+    }
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_SWAPCHAIN_CLIQUE);
+    return true;
+}
+
+
+bool zvar_create_swapchain_clique(const zvar_swapchain_create_info_t *info,
+                                  VkSwapchainKHR *swapchain, uint32_t *width, uint32_t *height, uint32_t *image_count, VkImageView *views, VkFramebuffer *framebuffers,
+                                  VkImage *color_image, VkImageView *color_view,
+                                  VkImage *depth_image, VkDeviceMemory *depth_memory, VkDeviceSize *depth_memory_size, VkImageView *depth_view)
+{
+    return zvar_create_swapchain_clique_images(info, swapchain, width, height, image_count, NULL, views, framebuffers, color_image, color_view,
+                                               depth_image, depth_memory, depth_memory_size, depth_view);
+}
+
+
+bool zvar_create_dynamic_swapchain_clique(const zvar_swapchain_create_info_t *info,
+                                          VkSwapchainKHR *swapchain, uint32_t *width, uint32_t *height, uint32_t *image_count, VkImage *images, VkImageView *views,
+                                          VkImage *color_image, VkImageView *color_view,
+                                          VkImage *depth_image, VkDeviceMemory *depth_memory, VkDeviceSize *depth_memory_size, VkImageView *depth_view)
+{
+    return zvar_create_swapchain_clique_images(info, swapchain, width, height, image_count, images, views, NULL, color_image, color_view,
+                                               depth_image, depth_memory, depth_memory_size, depth_view);
+}
+
+
+void zvar_begin_rendering(VkCommandBuffer command_buffer, const zvar_rendering_info_t *info)
+{
+    bool has_depth = info->depth_view != VK_NULL_HANDLE;
+    bool has_resolve = info->resolve_view != VK_NULL_HANDLE;
+
+    // NOTE: All come from UNDEFINED since they get cleared or fully resolved into anyway. The depth and multisampled color images
+    //       are shared between frames, so their barriers also wait for the attachment writes of the frame before.
+    VkImageMemoryBarrier barriers[3] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = has_resolve ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = info->color_image,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = info->resolve_image,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = info->depth_image,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (info->depth_format == VK_FORMAT_D32_SFLOAT ? 0 : VK_IMAGE_ASPECT_STENCIL_BIT),
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        },
+    };
+
+    VkPipelineStageFlags depth_stages = has_depth ? VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT : 0;
+
+    uint32_t barrier_count = 1;
+
+    if (has_resolve) {
+        barriers[barrier_count++] = barriers[1];
+    }
+
+    if (has_depth) {
+        barriers[barrier_count++] = barriers[2];
+    }
+
+    zvar_vk(command_buffer, vkCmdPipelineBarrier)(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | depth_stages, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | depth_stages, 0,
+                                  0, NULL, 0, NULL, barrier_count, barriers);
+
+    // NOTE: A resolved color image is only ever read by the resolve at the end of the pass, tilers keep it on chip.
+    VkRenderingAttachmentInfo color_attachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = info->color_view,
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .resolveMode = has_resolve ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE,
+        .resolveImageView = info->resolve_view,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = has_resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue.color = info->clear_color,
+    };
+
+    // NOTE: Nothing reads the depth after the pass, tilers can skip writing it out.
+    VkRenderingAttachmentInfo depth_attachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = info->depth_view,
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue.depthStencil.depth = info->clear_depth,
+    };
+
+    VkRenderingInfo rendering_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea.extent = { info->width, info->height },
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &color_attachment,
+        .pDepthAttachment = has_depth ? &depth_attachment : NULL,
+    };
+
+    // NOTE: The extension's entry point is only there when it got enabled, the core one otherwise.
+    const VolkDeviceTable *table = zvar_get_device_table(command_buffer);
+    PFN_vkCmdBeginRendering begin_rendering = table->vkCmdBeginRenderingKHR ? table->vkCmdBeginRenderingKHR : table->vkCmdBeginRendering;
+
+    begin_rendering(command_buffer, &rendering_info);
+}
+
+
+void zvar_end_rendering(VkCommandBuffer command_buffer, const zvar_rendering_info_t *info)
+{
+    const VolkDeviceTable *table = zvar_get_device_table(command_buffer);
+    PFN_vkCmdEndRendering end_rendering = table->vkCmdEndRenderingKHR ? table->vkCmdEndRenderingKHR : table->vkCmdEndRendering;
+
+    end_rendering(command_buffer);
+
+    if (info->color_final_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+        return;
+
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = 0,
+        .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .newLayout = info->color_final_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = info->resolve_view != VK_NULL_HANDLE ? info->resolve_image : info->color_image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = 1,
+            .layerCount = 1,
+        },
+    };
+
+    VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    // NOTE: Present waits on a semaphore, which already makes the writes visible. Anything else might read the image right after.
+    if (info->color_final_layout != VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        dst_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    zvar_vk(command_buffer, vkCmdPipelineBarrier)(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, dst_stages, 0,
+                                  0, NULL, 0, NULL, 1, &barrier);
+}
+
+void zvar_create_offscreen_clique(const zvar_offscreen_create_info_t *info,
+                                  VkImage *images, VkDeviceMemory *color_memory, VkImageView *views, VkFramebuffer *framebuffers,
+                                  VkImage *depth_image, VkDeviceMemory *depth_memory, VkImageView *depth_view)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_OFFSCREEN_CLIQUE);
+
+    // create color images
+    {
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | info->color_usage;
+
+        for (uint32_t i = 0; i < info->image_count; ++i) {
+            images[i] = zvar_create_2d_image_exclusive(info->device, info->color_format, info->width, info->height, 1, usage);
+        }
+
+        // NOTE: The images are identical, so are their requirements.
+        VkMemoryRequirements requirements = zvar_get_image_memory_requirements(info->device, images[0]);
+        VkDeviceSize stride = zvar_align_up(requirements.size, requirements.alignment);
+
+        uint32_t memory_type = zvar_find_memory_type(info->physical_device_memory_properties, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        *color_memory = zvar_allocate_memory(info->device, memory_type, stride * info->image_count);
+
+        for (uint32_t i = 0; i < info->image_count; ++i) {
+            ZVAR_CHECK(zvar_vk(info->device, vkBindImageMemory)(info->device, images[i], *color_memory, stride * i));
+
+            views[i] = zvar_create_2d_image_view(info->device, images[i], info->color_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+    }
+
+    // create depth buffer
+    if (info->depth_format != VK_FORMAT_UNDEFINED) {
+        *depth_image = zvar_create_2d_attachment_image(info->device, info->depth_format, info->width, info->height, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+        VkMemoryRequirements requirements = zvar_get_image_memory_requirements(info->device, *depth_image);
+
+        uint32_t memory_type = zvar_find_attachment_memory_type(info->physical_device_memory_properties, requirements.memoryTypeBits);
+
+        *depth_memory = zvar_allocate_memory(info->device, memory_type, requirements.size);
+
+        ZVAR_CHECK(zvar_vk(info->device, vkBindImageMemory)(info->device, *depth_image, *depth_memory, 0));
+
+        VkImageAspectFlags depth_aspect_flags = VK_IMAGE_ASPECT_DEPTH_BIT | (info->depth_format == VK_FORMAT_D32_SFLOAT ? 0 : VK_IMAGE_ASPECT_STENCIL_BIT);
+
+        *depth_view = zvar_create_2d_image_view(info->device, *depth_image, info->depth_format, depth_aspect_flags, 1);
+    }
+    else {
+        *depth_image  = VK_NULL_HANDLE;
+        *depth_memory = VK_NULL_HANDLE;
+        *depth_view   = VK_NULL_HANDLE;
+    }
+
+    // create framebuffers
+    if (info->render_pass != VK_NULL_HANDLE) {
+        for (uint32_t i = 0; i < info->image_count; ++i) {
+            VkFramebufferCreateInfo framebuffer_create_info = {
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                .renderPass = info->render_pass,
+                .attachmentCount = *depth_view != VK_NULL_HANDLE ? 2 : 1,
+                .pAttachments = (VkImageView[2]) {
+                    [0] = views[i],
+                    [1] = *depth_view,
+                },
+                .width  = info->width,
+                .height = info->height,
+                .layers = 1,
+            };
+
+            ZVAR_CHECK(zvar_vk(info->device, vkCreateFramebuffer)(info->device, &framebuffer_create_info, zvar_get_device_allocation_callbacks(info->device), framebuffers + i));
+        }
+    }
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_OFFSCREEN_CLIQUE);
+}
+
+
+void zvar_destroy_offscreen_clique(const zvar_offscreen_create_info_t *info,
+                                   VkImage *images, VkDeviceMemory *color_memory, VkImageView *views, VkFramebuffer *framebuffers,
+                                   VkImage *depth_image, VkDeviceMemory *depth_memory, VkImageView *depth_view)
+{
+    for (uint32_t i = 0; i < info->image_count; ++i) {
+        if (info->render_pass != VK_NULL_HANDLE) {
+            zvar_vk(info->device, vkDestroyFramebuffer)(info->device, framebuffers[i], zvar_get_device_allocation_callbacks(info->device));
+            framebuffers[i] = VK_NULL_HANDLE;
+        }
+
+        zvar_vk(info->device, vkDestroyImageView)(info->device, views[i], zvar_get_device_allocation_callbacks(info->device));
+        zvar_vk(info->device, vkDestroyImage)(info->device, images[i], zvar_get_device_allocation_callbacks(info->device));
+
+        views[i]  = VK_NULL_HANDLE;
+        images[i] = VK_NULL_HANDLE;
+    }
+
+    zvar_vk(info->device, vkFreeMemory)(info->device, *color_memory, zvar_get_device_allocation_callbacks(info->device));
+    *color_memory = VK_NULL_HANDLE;
+
+    if (*depth_image != VK_NULL_HANDLE) {
+        zvar_vk(info->device, vkDestroyImageView)(info->device, *depth_view, zvar_get_device_allocation_callbacks(info->device));
+        zvar_vk(info->device, vkDestroyImage)(info->device, *depth_image, zvar_get_device_allocation_callbacks(info->device));
+        zvar_vk(info->device, vkFreeMemory)(info->device, *depth_memory, zvar_get_device_allocation_callbacks(info->device));
+
+        *depth_view   = VK_NULL_HANDLE;
+        *depth_image  = VK_NULL_HANDLE;
+        *depth_memory = VK_NULL_HANDLE;
+    }
+}
+
+
+/* capability snapshot */
+
+#define ZVAR_CAPABILITIES_MAGIC   0x5043565A // "ZVCP"
+#define ZVAR_CAPABILITIES_VERSION 2
+
+// NOTE: The snapshot structs are written as they are in memory, `struct_sizes` catches a build with a different layout.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t struct_sizes;
+    uint32_t reserved;
+    uint64_t data_size;
+    uint64_t data_hash;
+} zvar_capabilities_file_header_t;
+
+#define ZVAR_CAPABILITIES_STRUCT_SIZES \
+    (uint32_t)(sizeof(void *) + sizeof(VkPhysicalDeviceProperties) + sizeof(VkPhysicalDeviceFeatures) + sizeof(VkPhysicalDeviceMemoryProperties))
+
+static long capabilities_lock;
+
+static zvar_instance_capabilities_t *instance_capabilities;
+
+// NOTE: Refreshed instance snapshots are kept around, somebody may still hold a pointer to them.
+static uint32_t retired_instance_capabilities_count, retired_instance_capabilities_capacity;
+static zvar_instance_capabilities_t **retired_instance_capabilities;
+
+static uint32_t device_capabilities_count, device_capabilities_capacity;
+static zvar_device_capabilities_t **device_capabilities;
+
+// NOTE: Same for refreshed device snapshots.
+static uint32_t retired_device_capabilities_count, retired_device_capabilities_capacity;
+static zvar_device_capabilities_t **retired_device_capabilities;
+
+
+static void zvar_init_capability_names(zvar_capability_names_t *names, uint32_t capacity)
+{
+    uint32_t bucket_count = 16;
+
+    while (bucket_count < capacity * 2) {
+        bucket_count *= 2;
+    }
+
+    *names = (zvar_capability_names_t) {
+        .names = zvar_realloc(NULL, (capacity ? capacity : 1) * sizeof(zvar_capability_name_t)),
+        .bucket_count = bucket_count,
+        .buckets = zvar_realloc(NULL, bucket_count * sizeof(uint32_t)),
+    };
+
+    memset(names->buckets, 0xFF, bucket_count * sizeof(uint32_t));
+}
+
+
+static void zvar_free_capability_names(zvar_capability_names_t *names)
+{
+    free(names->names);
+    free(names->buckets);
+
+    *names = (zvar_capability_names_t) {0};
+}
+
+
+/* There has to be room for the name, zvar_init_capability_names sizes the names up front. */
+static void zvar_add_capability_name(zvar_capability_names_t *names, const char *name, uint32_t spec_version)
+{
+    zvar_capability_name_t *entry = names->names + names->count;
+
+    const char *end = memchr(name, 0, VK_MAX_EXTENSION_NAME_SIZE - 1);
+    size_t length = end ? (size_t)(end - name) : VK_MAX_EXTENSION_NAME_SIZE - 1;
+    memcpy(entry->name, name, length);
+    memset(entry->name + length, 0, VK_MAX_EXTENSION_NAME_SIZE - length);
+
+    entry->spec_version = spec_version;
+    entry->hash = zvar_hash_bytes(entry->name, length);
+
+    uint32_t bucket = (uint32_t)entry->hash & (names->bucket_count - 1);
+    entry->next = names->buckets[bucket];
+    names->buckets[bucket] = names->count++;
+}
+
+
+uint32_t zvar_find_capability_name(const zvar_capability_names_t *names, const char *name)
+{
+    if (!names->bucket_count)
+        return ZVAR_NO_INDEX;
+
+    uint64_t hash = zvar_hash_bytes(name, strlen(name));
+
+    uint32_t i = names->buckets[(uint32_t)hash & (names->bucket_count - 1)];
+
+    for (; i != ZVAR_NO_INDEX; i = names->names[i].next) {
+        if (names->names[i].hash == hash && str_eq(names->names[i].name, name))
+            return i;
+    }
+
+    return ZVAR_NO_INDEX;
+}
+
+
+static void zvar_free_instance_capabilities(zvar_instance_capabilities_t *capabilities)
+{
+    zvar_free_capability_names(&capabilities->layers);
+    zvar_free_capability_names(&capabilities->extensions);
+    free(capabilities);
+}
+
+
+static void zvar_free_device_capabilities(zvar_device_capabilities_t *capabilities)
+{
+    zvar_free_capability_names(&capabilities->extensions);
+    free(capabilities->queue_families);
+    free(capabilities);
+}
+
+
+/* The version the device can be used with, the instance caps it. 1.0 for instances zvar didn't create. */
+static uint32_t zvar_get_usable_api_version(VkPhysicalDevice physical_device, uint32_t device_api_version)
+{
+    zvar_instance_record_t *record = zvar_find_instance_record(physical_device);
+
+    if (!record)
+        return VK_API_VERSION_1_0;
+
+    return device_api_version < record->api_version ? device_api_version : record->api_version;
+}
+
+
+/* Core 1.1 entry points need 1.1 on both the instance and the device, otherwise the KHR ones need their extension on the instance.
+ * NULL when neither is there, always for instances zvar didn't create.
+ */
+static PFN_vkGetPhysicalDeviceProperties2 zvar_get_properties2_function(VkPhysicalDevice physical_device, uint32_t device_api_version)
+{
+    zvar_instance_record_t *record = zvar_find_instance_record(physical_device);
+
+    if (!record)
+        return NULL;
+
+    if (zvar_get_usable_api_version(physical_device, device_api_version) >= VK_API_VERSION_1_1 && vkGetPhysicalDeviceProperties2)
+        return vkGetPhysicalDeviceProperties2;
+
+    return record->has_properties2_extension ? vkGetPhysicalDeviceProperties2KHR : NULL;
+}
+
+
+static PFN_vkGetPhysicalDeviceFeatures2 zvar_get_features2_function(VkPhysicalDevice physical_device, uint32_t device_api_version)
+{
+    zvar_instance_record_t *record = zvar_find_instance_record(physical_device);
+
+    if (!record)
+        return NULL;
+
+    if (zvar_get_usable_api_version(physical_device, device_api_version) >= VK_API_VERSION_1_1 && vkGetPhysicalDeviceFeatures2)
+        return vkGetPhysicalDeviceFeatures2;
+
+    return record->has_properties2_extension ? vkGetPhysicalDeviceFeatures2KHR : NULL;
+}
+
+
+static zvar_instance_capabilities_t *zvar_build_instance_capabilities(void)
+{
+    if (volkInitialize() != VK_SUCCESS)
+        return NULL;
+
+    zvar_instance_capabilities_t *capabilities = zvar_realloc(NULL, sizeof(zvar_instance_capabilities_t));
+
+    *capabilities = (zvar_instance_capabilities_t) {
+        .api_version = VK_API_VERSION_1_0,
+    };
+
+    if (vkEnumerateInstanceVersion && vkEnumerateInstanceVersion(&capabilities->api_version) != VK_SUCCESS) {
+        free(capabilities);
+        return NULL;
+    }
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    uint32_t layer_count;
+    uint32_t extension_count;
+    VkLayerProperties *layer_properties = NULL;
+    VkExtensionProperties *extension_properties = NULL;
+
+    bool ok = vkEnumerateInstanceLayerProperties(&layer_count, NULL) == VK_SUCCESS;
+
+    if (ok) {
+        layer_properties = zvar_get_scratch(layer_count * sizeof(VkLayerProperties));
+        ok = vkEnumerateInstanceLayerProperties(&layer_count, layer_properties) == VK_SUCCESS;
+    }
+
+    ok = ok && vkEnumerateInstanceExtensionProperties(NULL, &extension_count, NULL) == VK_SUCCESS;
+
+    if (ok) {
+        extension_properties = zvar_get_scratch(extension_count * sizeof(VkExtensionProperties));
+        ok = vkEnumerateInstanceExtensionProperties(NULL, &extension_count, extension_properties) == VK_SUCCESS;
+    }
+
+    if (!ok) {
+        zvar_restore_scratch(scratch_mark);
+        free(capabilities);
+        return NULL;
+    }
+
+    zvar_init_capability_names(&capabilities->layers, layer_count);
+
+    for (uint32_t i = 0; i < layer_count; ++i) {
+        zvar_add_capability_name(&capabilities->layers, layer_properties[i].layerName, layer_properties[i].specVersion);
+    }
+
+    zvar_init_capability_names(&capabilities->extensions, extension_count);
+
+    for (uint32_t i = 0; i < extension_count; ++i) {
+        zvar_add_capability_name(&capabilities->extensions, extension_properties[i].extensionName, extension_properties[i].specVersion);
+    }
+
+    zvar_restore_scratch(scratch_mark);
+
+    return capabilities;
+}
+
+
+static zvar_device_capabilities_t *zvar_build_device_capabilities(VkPhysicalDevice physical_device, const VkPhysicalDeviceProperties *properties)
+{
+    zvar_device_capabilities_t *capabilities = zvar_realloc(NULL, sizeof(zvar_device_capabilities_t));
+
+    *capabilities = (zvar_device_capabilities_t) {
+        .physical_device = physical_device,
+        .properties = *properties,
+        .instance_key = zvar_get_dispatch_key(physical_device),
+    };
+
+    vkGetPhysicalDeviceFeatures(physical_device, &capabilities->features);
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &capabilities->memory_properties);
+
+    PFN_vkGetPhysicalDeviceProperties2 get_properties = zvar_get_properties2_function(physical_device, properties->apiVersion);
+
+    if (get_properties) {
+        VkPhysicalDeviceIDProperties id_properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+        };
+
+        VkPhysicalDeviceProperties2 properties2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &id_properties,
+        };
+
+        get_properties(physical_device, &properties2);
+
+        memcpy(capabilities->device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+    }
+
+    {
+        zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+        uint32_t extension_count;
+        ZVAR_CHECK(vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, NULL));
+        VkExtensionProperties *extension_properties = zvar_get_scratch(extension_count * sizeof(VkExtensionProperties));
+        ZVAR_CHECK(vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, extension_properties));
+
+        zvar_init_capability_names(&capabilities->extensions, extension_count);
+
+        for (uint32_t i = 0; i < extension_count; ++i) {
+            zvar_add_capability_name(&capabilities->extensions, extension_properties[i].extensionName, extension_properties[i].specVersion);
+        }
+
+        zvar_restore_scratch(scratch_mark);
+    }
+
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &capabilities->queue_family_count, NULL);
+    capabilities->queue_families = zvar_realloc(NULL, (capabilities->queue_family_count + 1) * sizeof(VkQueueFamilyProperties));
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &capabilities->queue_family_count, capabilities->queue_families);
+
+    for (uint32_t format = 0; format < ZVAR_CORE_FORMAT_COUNT; ++format) {
+        vkGetPhysicalDeviceFormatProperties(physical_device, (VkFormat)format, capabilities->format_properties + format);
+    }
+
+    return capabilities;
+}
+
+
+const zvar_instance_capabilities_t *zvar_get_instance_capabilities(void)
+{
+    zvar_lock(&capabilities_lock);
+
+    if (!instance_capabilities) {
+        instance_capabilities = zvar_build_instance_capabilities();
+    }
+
+    const zvar_instance_capabilities_t *res = instance_capabilities;
+
+    zvar_unlock(&capabilities_lock);
+
+    return res;
+}
+
+
+/* Enumerates again in place of a snapshot from the cache file. */
+static const zvar_instance_capabilities_t *zvar_refresh_instance_capabilities(const zvar_instance_capabilities_t *stale)
+{
+    zvar_lock(&capabilities_lock);
+
+    if (instance_capabilities == stale && stale->from_cache) {
+        zvar_instance_capabilities_t *fresh = zvar_build_instance_capabilities();
+
+        if (fresh) {
+            zvar_array_push(retired_instance_capabilities, retired_instance_capabilities_count, retired_instance_capabilities_capacity, instance_capabilities);
+            instance_capabilities = fresh;
+        }
+    }
+
+    const zvar_instance_capabilities_t *res = instance_capabilities;
+
+    zvar_unlock(&capabilities_lock);
+
+    return res;
+}
+
+
+/* Looks `name` up among the layers or the extensions, refreshing a snapshot from the cache file when it is missing. */
+static bool zvar_has_instance_capability(const zvar_instance_capabilities_t **capabilities, bool layer, const char *name)
+{
+    const zvar_instance_capabilities_t *caps = *capabilities;
+
+    if (zvar_find_capability_name(layer ? &caps->layers : &caps->extensions, name) != ZVAR_NO_INDEX)
+        return true;
+
+    if (!caps->from_cache)
+        return false;
+
+    caps = zvar_refresh_instance_capabilities(caps);
+
+    if (caps == *capabilities)
+        return false;
+
+    *capabilities = caps;
+
+    return zvar_find_capability_name(layer ? &caps->layers : &caps->extensions, name) != ZVAR_NO_INDEX;
+}
+
+
+static bool zvar_is_same_physical_device(const VkPhysicalDeviceProperties *a, const VkPhysicalDeviceProperties *b)
+{
+    return a->vendorID == b->vendorID
+        && a->deviceID == b->deviceID
+        && a->driverVersion == b->driverVersion
+        && a->apiVersion == b->apiVersion
+        && memcmp(a->pipelineCacheUUID, b->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+
+const zvar_device_capabilities_t *zvar_get_device_capabilities(VkPhysicalDevice physical_device)
+{
+    // NOTE: A physical device handle may be reused by a later instance, only snapshots bound through the same instance count.
+    void *instance_key = zvar_get_dispatch_key(physical_device);
+
+    zvar_lock(&capabilities_lock);
+
+    for (uint32_t i = 0; i < device_capabilities_count; ++i) {
+        if (device_capabilities[i]->physical_device == physical_device && device_capabilities[i]->instance_key == instance_key) {
+            const zvar_device_capabilities_t *res = device_capabilities[i];
+            zvar_unlock(&capabilities_lock);
+            return res;
+        }
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    // NOTE: Every unbound snapshot goes to the first physical device it matches, so identical GPUs get one each.
+    zvar_device_capabilities_t *res = NULL;
+
+    for (uint32_t i = 0; i < device_capabilities_count; ++i) {
+        zvar_device_capabilities_t *capabilities = device_capabilities[i];
+
+        if (capabilities->physical_device == VK_NULL_HANDLE && zvar_is_same_physical_device(&capabilities->properties, &properties)) {
+            capabilities->physical_device = physical_device;
+            capabilities->instance_key = instance_key;
+            res = capabilities;
+            break;
+        }
+    }
+
+    if (!res) {
+        res = zvar_build_device_capabilities(physical_device, &properties);
+        zvar_array_push(device_capabilities, device_capabilities_count, device_capabilities_capacity, res);
+    }
+
+    zvar_unlock(&capabilities_lock);
+
+    return res;
+}
+
+
+/* Enumerates again in place of a snapshot from the cache file. */
+static const zvar_device_capabilities_t *zvar_refresh_device_capabilities(const zvar_device_capabilities_t *stale)
+{
+    zvar_lock(&capabilities_lock);
+
+    const zvar_device_capabilities_t *res = stale;
+
+    for (uint32_t i = 0; i < device_capabilities_count; ++i) {
+        zvar_device_capabilities_t *capabilities = device_capabilities[i];
+
+        if (capabilities != stale || !capabilities->from_cache || capabilities->physical_device == VK_NULL_HANDLE)
+            continue;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(capabilities->physical_device, &properties);
+
+        zvar_array_push(retired_device_capabilities, retired_device_capabilities_count, retired_device_capabilities_capacity, capabilities);
+        device_capabilities[i] = zvar_build_device_capabilities(capabilities->physical_device, &properties);
+
+        res = device_capabilities[i];
+        break;
+    }
+
+    zvar_unlock(&capabilities_lock);
+
+    return res;
+}
+
+
+/* Looks `name` up among the extensions, refreshing a snapshot from the cache file when it is missing. */
+static bool zvar_has_device_extension(const zvar_device_capabilities_t **capabilities, const char *name)
+{
+    const zvar_device_capabilities_t *caps = *capabilities;
+
+    if (zvar_find_capability_name(&caps->extensions, name) != ZVAR_NO_INDEX)
+        return true;
+
+    if (!caps->from_cache)
+        return false;
+
+    caps = zvar_refresh_device_capabilities(caps);
+
+    if (caps == *capabilities)
+        return false;
+
+    *capabilities = caps;
+
+    return zvar_find_capability_name(&caps->extensions, name) != ZVAR_NO_INDEX;
+}
+
+
+/* Releases the snapshots bound to physical devices of the instance, they get matched again like the ones from the cache file. */
+static void zvar_unbind_device_capabilities(void *instance_key)
+{
+    zvar_lock(&capabilities_lock);
+
+    for (uint32_t i = 0; i < device_capabilities_count; ++i) {
+        zvar_device_capabilities_t *capabilities = device_capabilities[i];
+
+        if (capabilities->physical_device != VK_NULL_HANDLE && capabilities->instance_key == instance_key) {
+            capabilities->physical_device = VK_NULL_HANDLE;
+            capabilities->instance_key = NULL;
+        }
+    }
+
+    zvar_unlock(&capabilities_lock);
+}
+
+
+VkFormatProperties zvar_get_format_properties(VkPhysicalDevice physical_device, VkFormat format)
+{
+    if ((uint32_t)format < ZVAR_CORE_FORMAT_COUNT)
+        return zvar_get_device_capabilities(physical_device)->format_properties[format];
+
+    VkFormatProperties res;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &res);
+
+    return res;
+}
+
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size, capacity;
+} zvar_byte_writer_t;
+
+static void zvar_write_bytes(zvar_byte_writer_t *writer, const void *data, size_t size)
+{
+    if (writer->size + size > writer->capacity) {
+        while (writer->size + size > writer->capacity) {
+            writer->capacity = writer->capacity ? writer->capacity * 2 : 4096;
+        }
+
+        writer->data = zvar_realloc(writer->data, writer->capacity);
+    }
+
+    memcpy(writer->data + writer->size, data, size);
+    writer->size += size;
+}
+
+
+static void zvar_write_u32(zvar_byte_writer_t *writer, uint32_t value)
+{
+    zvar_write_bytes(writer, &value, sizeof(value));
+}
+
+
+static void zvar_write_capability_names(zvar_byte_writer_t *writer, const zvar_capability_names_t *names)
+{
+    zvar_write_u32(writer, names->count);
+
+    for (uint32_t i = 0; i < names->count; ++i) {
+        zvar_write_bytes(writer, names->names[i].name, VK_MAX_EXTENSION_NAME_SIZE);
+        zvar_write_u32(writer, names->names[i].spec_version);
+    }
+}
+
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t size, offset;
+} zvar_byte_reader_t;
+
+static bool zvar_read_bytes(zvar_byte_reader_t *reader, void *data, size_t size)
+{
+    if (size > reader->size - reader->offset)
+        return false;
+
+    memcpy(data, reader->data + reader->offset, size);
+    reader->offset += size;
+
+    return true;
+}
+
+
+static bool zvar_read_capability_names(zvar_byte_reader_t *reader, zvar_capability_names_t *names)
+{
+    uint32_t count;
+
+    if (!zvar_read_bytes(reader, &count, sizeof(count)))
+        return false;
+
+    // NOTE: Rejects counts the file can't hold before allocating for them.
+    if (count > (reader->size - reader->offset) / (VK_MAX_EXTENSION_NAME_SIZE + sizeof(uint32_t)))
+        return false;
+
+    zvar_init_capability_names(names, count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        char name[VK_MAX_EXTENSION_NAME_SIZE];
+        uint32_t spec_version;
+
+        zvar_read_bytes(reader, name, sizeof(name));
+        zvar_read_bytes(reader, &spec_version, sizeof(spec_version));
+
+        name[VK_MAX_EXTENSION_NAME_SIZE - 1] = 0;
+        zvar_add_capability_name(names, name, spec_version);
+    }
+
+    return true;
+}
+
+
+bool zvar_save_capabilities(const char *path)
+{
+    zvar_byte_writer_t writer = {0};
+
+    zvar_lock(&capabilities_lock);
+
+    zvar_write_u32(&writer, instance_capabilities != NULL);
+
+    if (instance_capabilities) {
+        zvar_write_u32(&writer, instance_capabilities->api_version);
+        zvar_write_capability_names(&writer, &instance_capabilities->layers);
+        zvar_write_capability_names(&writer, &instance_capabilities->extensions);
+    }
+
+    zvar_write_u32(&writer, device_capabilities_count);
+
+    for (uint32_t i = 0; i < device_capabilities_count; ++i) {
+        zvar_device_capabilities_t *capabilities = device_capabilities[i];
+
+        zvar_write_bytes(&writer, &capabilities->properties, sizeof(capabilities->properties));
+        zvar_write_bytes(&writer, &capabilities->features, sizeof(capabilities->features));
+        zvar_write_bytes(&writer, &capabilities->memory_properties, sizeof(capabilities->memory_properties));
+        zvar_write_bytes(&writer, capabilities->device_uuid, VK_UUID_SIZE);
+        zvar_write_capability_names(&writer, &capabilities->extensions);
+        zvar_write_u32(&writer, capabilities->queue_family_count);
+        zvar_write_bytes(&writer, capabilities->queue_families, capabilities->queue_family_count * sizeof(VkQueueFamilyProperties));
+        zvar_write_bytes(&writer, capabilities->format_properties, sizeof(capabilities->format_properties));
+    }
+
+    zvar_unlock(&capabilities_lock);
+
+    zvar_capabilities_file_header_t header = {
+        .magic = ZVAR_CAPABILITIES_MAGIC,
+        .version = ZVAR_CAPABILITIES_VERSION,
+        .struct_sizes = ZVAR_CAPABILITIES_STRUCT_SIZES,
+        .data_size = writer.size,
+        .data_hash = zvar_hash_bytes(writer.data, writer.size),
+    };
+
+    bool ok = zvar_write_file_atomic(path, &header, sizeof(header), writer.data, writer.size);
+
+    free(writer.data);
+
+    return ok;
+}
+
+
+static zvar_device_capabilities_t *zvar_read_device_capabilities(zvar_byte_reader_t *reader)
+{
+    zvar_device_capabilities_t *capabilities = zvar_realloc(NULL, sizeof(zvar_device_capabilities_t));
+
+    *capabilities = (zvar_device_capabilities_t) {
+        .from_cache = true,
+    };
+
+    bool ok = zvar_read_bytes(reader, &capabilities->properties, sizeof(capabilities->properties))
+           && zvar_read_bytes(reader, &capabilities->features, sizeof(capabilities->features))
+           && zvar_read_bytes(reader, &capabilities->memory_properties, sizeof(capabilities->memory_properties))
+           && zvar_read_bytes(reader, capabilities->device_uuid, VK_UUID_SIZE)
+           && zvar_read_capability_names(reader, &capabilities->extensions)
+           && zvar_read_bytes(reader, &capabilities->queue_family_count, sizeof(capabilities->queue_family_count))
+           && capabilities->queue_family_count <= (reader->size - reader->offset) / sizeof(VkQueueFamilyProperties);
+
+    if (ok) {
+        capabilities->queue_families = zvar_realloc(NULL, (capabilities->queue_family_count + 1) * sizeof(VkQueueFamilyProperties));
+
+        ok = zvar_read_bytes(reader, capabilities->queue_families, capabilities->queue_family_count * sizeof(VkQueueFamilyProperties))
+          && zvar_read_bytes(reader, capabilities->format_properties, sizeof(capabilities->format_properties));
+    }
+
+    if (!ok) {
+        zvar_free_device_capabilities(capabilities);
+        return NULL;
+    }
+
+    return capabilities;
+}
+
+
+bool zvar_load_capabilities(const char *path)
+{
+    zvar_mapped_file_t file;
+
+    if (!zvar_map_file(path, &file))
+        return false;
+
+    const zvar_capabilities_file_header_t *header = file.data;
+    const uint8_t *data = (const uint8_t *)file.data + sizeof(*header);
+
+    bool valid = file.size >= sizeof(*header)
+              && header->magic == ZVAR_CAPABILITIES_MAGIC
+              && header->version == ZVAR_CAPABILITIES_VERSION
+              && header->struct_sizes == ZVAR_CAPABILITIES_STRUCT_SIZES
+              && header->data_size == file.size - sizeof(*header)
+              && zvar_hash_bytes(data, header->data_size) == header->data_hash;
+
+    if (!valid) {
+        zvar_unmap_file(&file);
+        return false;
+    }
+
+    zvar_byte_reader_t reader = {
+        .data = data,
+        .size = header->data_size,
+    };
+
+    zvar_instance_capabilities_t *instance = NULL;
+
+    uint32_t device_count = 0, device_capacity = 0;
+    zvar_device_capabilities_t **devices = NULL;
+
+    uint32_t has_instance;
+    bool ok = zvar_read_bytes(&reader, &has_instance, sizeof(has_instance));
+
+    if (ok && has_instance) {
+        instance = zvar_realloc(NULL, sizeof(zvar_instance_capabilities_t));
+
+        *instance = (zvar_instance_capabilities_t) {
+            .from_cache = true,
+        };
+
+        ok = zvar_read_bytes(&reader, &instance->api_version, sizeof(instance->api_version))
+          && zvar_read_capability_names(&reader, &instance->layers)
+          && zvar_read_capability_names(&reader, &instance->extensions);
+    }
+
+    uint32_t file_device_count = 0;
+    ok = ok && zvar_read_bytes(&reader, &file_device_count, sizeof(file_device_count));
+
+    for (uint32_t i = 0; ok && i < file_device_count; ++i) {
+        zvar_device_capabilities_t *capabilities = zvar_read_device_capabilities(&reader);
+
+        if (capabilities) {
+            zvar_array_push(devices, device_count, device_capacity, capabilities);
+        }
+        else {
+            ok = false;
+        }
+    }
+
+    zvar_unmap_file(&file);
+
+    // NOTE: A different loader may come with different layers and extensions, the instance part is only good for the same one.
+    if (ok && instance) {
+        uint32_t api_version = VK_API_VERSION_1_0;
+
+        if (volkInitialize() != VK_SUCCESS || (vkEnumerateInstanceVersion && vkEnumerateInstanceVersion(&api_version) != VK_SUCCESS) || api_version != instance->api_version) {
+            zvar_free_instance_capabilities(instance);
+            instance = NULL;
+        }
+    }
+
+    if (!ok) {
+        if (instance) {
+            zvar_free_instance_capabilities(instance);
+        }
+
+        for (uint32_t i = 0; i < device_count; ++i) {
+            zvar_free_device_capabilities(devices[i]);
+        }
+
+        free(devices);
+
+        return false;
+    }
+
+    zvar_lock(&capabilities_lock);
+
+    if (instance && !instance_capabilities) {
+        instance_capabilities = instance;
+        instance = NULL;
+    }
+
+    for (uint32_t i = 0; i < device_count; ++i) {
+        zvar_array_push(device_capabilities, device_capabilities_count, device_capabilities_capacity, devices[i]);
+    }
+
+    zvar_unlock(&capabilities_lock);
+
+    if (instance) {
+        zvar_free_instance_capabilities(instance);
+    }
+
+    free(devices);
+
+    return true;
+}
+
+
+void zvar_free_capabilities(void)
+{
+    zvar_lock(&capabilities_lock);
+
+    if (instance_capabilities) {
+        zvar_free_instance_capabilities(instance_capabilities);
+    }
+
+    for (uint32_t i = 0; i < retired_instance_capabilities_count; ++i) {
+        zvar_free_instance_capabilities(retired_instance_capabilities[i]);
+    }
+
+    for (uint32_t i = 0; i < device_capabilities_count; ++i) {
+        zvar_free_device_capabilities(device_capabilities[i]);
+    }
+
+    for (uint32_t i = 0; i < retired_device_capabilities_count; ++i) {
+        zvar_free_device_capabilities(retired_device_capabilities[i]);
+    }
+
+    free(retired_instance_capabilities);
+    free(device_capabilities);
+    free(retired_device_capabilities);
+
+    instance_capabilities = NULL;
+
+    retired_instance_capabilities_count = 0;
+    retired_instance_capabilities_capacity = 0;
+    retired_instance_capabilities = NULL;
+
+    device_capabilities_count = 0;
+    device_capabilities_capacity = 0;
+    device_capabilities = NULL;
+
+    retired_device_capabilities_count = 0;
+    retired_device_capabilities_capacity = 0;
+    retired_device_capabilities = NULL;
+
+    zvar_unlock(&capabilities_lock);
+}
+
+
+VkInstance zvar_create_instance(const zvar_instance_create_info_t *info)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_INSTANCE);
+
+    const zvar_instance_capabilities_t *capabilities = zvar_get_instance_capabilities();
+
+    if (!capabilities) {
+        zvar_instrument_end(ZVAR_COUNTER_CREATE_INSTANCE);
+        return VK_NULL_HANDLE;
+    }
+
+    // check the version of api
+    {
+        uint32_t api_version = capabilities->api_version;
+
+        // TODO: Remove maybe? Or do differently.
+        printf("Vulkan API version: %d.%d.%d:%d\n",
+               VK_API_VERSION_MAJOR(api_version),
+               VK_API_VERSION_MINOR(api_version),
+               VK_API_VERSION_PATCH(api_version),
+               VK_API_VERSION_VARIANT(api_version));
+
+        if (api_version < info->minimum_version) {
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_INSTANCE);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    // find validation layers
+    char **layers = info->required_validation_layers;
+    uint32_t layer_count = info->required_validation_layer_count;
+
+    if (layers == NULL) {
+        layers = default_validation_layers;
+        layer_count = lengthof(default_validation_layers);
+    }
+
+    for (uint32_t i = 0; i < layer_count; ++i) {
+        if (!zvar_has_instance_capability(&capabilities, true, layers[i])) {
+            fprintf(stderr, "Required validation layer '%s' not found!\n", layers[i]);
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_INSTANCE);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    // find instance extensions
+    char **req_instance_extensions = info->required_instance_extensions;
+    uint32_t req_instance_extension_count = info->required_instance_extension_count;
+
+    if (req_instance_extensions == NULL && !info->headless) {
+        req_instance_extensions = default_instance_extensions;
+        req_instance_extension_count = lengthof(default_instance_extensions);
+    }
+
+    for (uint32_t i = 0; i < req_instance_extension_count; ++i) {
+        if (!zvar_has_instance_capability(&capabilities, false, req_instance_extensions[i])) {
+            fprintf(stderr, "Required instance extension '%s' not found!\n", req_instance_extensions[i]);
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_INSTANCE);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    // NOTE: The optional names that are present get appended to the required ones.
+    uint32_t enabled_layer_count = 0;
+    char **enabled_layers = zvar_get_scratch((layer_count + info->optional_validation_layer_count) * sizeof(char *));
+
+    for (uint32_t i = 0; i < layer_count; ++i) {
+        enabled_layers[enabled_layer_count++] = layers[i];
+    }
+
+    for (uint32_t i = 0; i < info->optional_validation_layer_count; ++i) {
+        char *name = info->optional_validation_layers[i];
+
+        bool enabled = zvar_contains_name(enabled_layer_count, enabled_layers, name);
+
+        if (!enabled && zvar_has_instance_capability(&capabilities, true, name)) {
+            enabled_layers[enabled_layer_count++] = name;
+            enabled = true;
+        }
+
+        if (info->optional_validation_layers_enabled) {
+            info->optional_validation_layers_enabled[i] = enabled;
+        }
+    }
+
+    // NOTE: The highest version zvar knows what to do with, a higher minimum is passed on as it is.
+    uint32_t api_version = capabilities->api_version < VK_API_VERSION_1_3 ? capabilities->api_version : VK_API_VERSION_1_3;
+
+    if (api_version < info->minimum_version) {
+        api_version = info->minimum_version;
+    }
+
+    uint32_t enabled_extension_count = 0;
+    char **enabled_extensions = zvar_get_scratch((req_instance_extension_count + info->optional_instance_extension_count + 1) * sizeof(char *));
+
+    for (uint32_t i = 0; i < req_instance_extension_count; ++i) {
+        enabled_extensions[enabled_extension_count++] = req_instance_extensions[i];
+    }
+
+    for (uint32_t i = 0; i < info->optional_instance_extension_count; ++i) {
+        char *name = info->optional_instance_extensions[i];
+
+        bool enabled = zvar_contains_name(enabled_extension_count, enabled_extensions, name);
+
+        if (!enabled && zvar_has_instance_capability(&capabilities, false, name)) {
+            enabled_extensions[enabled_extension_count++] = name;
+            enabled = true;
+        }
+
+        if (info->optional_instance_extensions_enabled) {
+            info->optional_instance_extensions_enabled[i] = enabled;
+        }
+    }
+
+    // NOTE: Below 1.1 the extended feature and property queries, and with them most optional device extensions, need it.
+    bool has_properties2_extension = zvar_contains_name(enabled_extension_count, enabled_extensions, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+    if (api_version < VK_API_VERSION_1_1 && !has_properties2_extension
+     && zvar_has_instance_capability(&capabilities, false, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    {
+        enabled_extensions[enabled_extension_count++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+        has_properties2_extension = true;
+    }
+
+    // create instance
+
+    VkInstance instance;
+    {
+        VkInstanceCreateInfo instance_info = {
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .flags = 0,
+            .pApplicationInfo = &(VkApplicationInfo) {
+                .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+                .pApplicationName = info->application_name ? info->application_name : "zvarog",
+                .applicationVersion = info->application_version,
+                .pEngineName = info->engine_name ? info->engine_name : "zvar",
+                .engineVersion = info->engine_version,
+                .apiVersion = api_version,
+            },
+            .enabledLayerCount = enabled_layer_count,
+            .ppEnabledLayerNames = (const char *const *)enabled_layers,
+            .enabledExtensionCount = enabled_extension_count,
+            .ppEnabledExtensionNames = (const char *const *)enabled_extensions,
+        };
+
+        if (vkCreateInstance(&instance_info, info->allocation_callbacks, &instance) != VK_SUCCESS) {
+            zvar_restore_scratch(scratch_mark);
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_INSTANCE);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    zvar_restore_scratch(scratch_mark);
+
+    zvar_instance_record_t *record = zvar_realloc(NULL, sizeof(zvar_instance_record_t));
+
+    *record = (zvar_instance_record_t) {
+        .dispatch_key = zvar_get_dispatch_key(instance),
+        .instance = instance,
+        .allocation_callbacks = info->allocation_callbacks,
+        .api_version = api_version,
+        .has_properties2_extension = has_properties2_extension,
+    };
+
+    zvar_lock(&records_lock);
+    zvar_array_push(instance_records, instance_record_count, instance_record_capacity, record);
+    zvar_unlock(&records_lock);
+
+    volkLoadInstance(instance);
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_INSTANCE);
+    return instance;
+}
+
+
+void zvar_destroy_instance(VkInstance instance)
+{
+    // NOTE: The record goes first, an instance created right after may get the same dispatch key.
+    zvar_instance_record_t *record = zvar_find_instance_record(instance);
+
+    zvar_lock(&records_lock);
+
+    for (uint32_t i = 0; i < instance_record_count; ++i) {
+        if (instance_records[i] == record) {
+            instance_records[i] = instance_records[--instance_record_count];
+            break;
+        }
+    }
+
+    zvar_unlock(&records_lock);
+
+    zvar_unbind_device_capabilities(zvar_get_dispatch_key(instance));
+
+    vkDestroyInstance(instance, record ? record->allocation_callbacks : NULL);
+
+    free(record);
+}
+
+
+VkPhysicalDevice zvar_choose_some_physical_device(VkInstance instance)
+{
+    zvar_device_selection_info_t info = {
+        .instance = instance,
+    };
+
+    VkPhysicalDevice physical_device = zvar_choose_physical_device(&info);
+
+    if (physical_device == VK_NULL_HANDLE) {
+        fprintf(stderr, "Failed to find GPU!\n");
+        exit(1);
+    }
+
+    return physical_device;
+}
+
+/* Picks the first graphics family that can present to `surface`, any when there is none, and the first compute and transfer only families. */
+static void zvar_find_queue_families(VkPhysicalDevice physical_device, VkSurfaceKHR surface,
+                                     uint32_t family_indices[ZVAR_QUEUE_ROLE_COUNT], uint32_t family_queue_counts[ZVAR_QUEUE_ROLE_COUNT])
+{
+    for (uint32_t role = 0; role < ZVAR_QUEUE_ROLE_COUNT; ++role) {
+        family_indices[role] = ZVAR_NO_INDEX;
+        family_queue_counts[role] = 0;
+    }
+
+    const zvar_device_capabilities_t *capabilities = zvar_get_device_capabilities(physical_device);
+
+    for (uint32_t family_index = 0; family_index < capabilities->queue_family_count; ++family_index) {
+        const VkQueueFamilyProperties *props = capabilities->queue_families + family_index;
+
+        uint32_t role;
+
+        if (props->queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            // Headless devices have nothing to present to.
+            VkBool32 supports_present = VK_TRUE;
+
+            if (surface != VK_NULL_HANDLE) {
+                ZVAR_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, family_index, surface, &supports_present));
+            }
+
+            if (!supports_present)
+                continue;
+
+            role = ZVAR_QUEUE_ROLE_GRAPHICS;
+        }
+        else if (props->queueFlags & VK_QUEUE_COMPUTE_BIT) {
+            role = ZVAR_QUEUE_ROLE_COMPUTE;
+        }
+        else if (props->queueFlags & VK_QUEUE_TRANSFER_BIT) {
+            role = ZVAR_QUEUE_ROLE_TRANSFER;
+        }
+        else {
+            continue;
+        }
+
+        if (family_indices[role] == ZVAR_NO_INDEX) {
+            family_indices[role] = family_index;
+            family_queue_counts[role] = props->queueCount;
+        }
+    }
+}
+
+
+static const zvar_optional_feature_t *zvar_find_optional_feature(const char *name)
+{
+    for (uint32_t i = 0; i < lengthof(optional_device_features); ++i) {
+        if (str_eq(optional_device_features[i].extension, name))
+            return optional_device_features + i;
+    }
+
+    return NULL;
+}
+
+
+/* Optional extensions promoted to Vulkan 1.3 stay off on devices usable with it, their feature gets turned on in `core_features` instead.
+ * Returns false when the device is older or lacks the feature, the extension is tried then.
+ */
+static bool zvar_enable_core_device_feature(const zvar_device_capabilities_t *capabilities, const char *name, VkPhysicalDeviceVulkan13Features *core_features)
+{
+    const zvar_optional_feature_t *feature = zvar_find_optional_feature(name);
+
+    if (!feature || !feature->core_feature_offset)
+        return false;
+
+    if (zvar_get_usable_api_version(capabilities->physical_device, capabilities->properties.apiVersion) < VK_API_VERSION_1_3)
+        return false;
+
+    VkPhysicalDeviceVulkan13Features supported_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+    };
+
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &supported_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(capabilities->physical_device, &features2);
+
+    if (!*(VkBool32 *)((uint8_t *)&supported_features + feature->core_feature_offset))
+        return false;
+
+    *(VkBool32 *)((uint8_t *)core_features + feature->core_feature_offset) = VK_TRUE;
+
+    return true;
+}
+
+
+/* Extensions without an entry in `optional_device_features` need nothing turned on.
+ * Otherwise queries the feature struct and chains it onto `next` with the features enabled, the struct lives in scratch,
+ * and appends the dependencies the device needs to `enabled_extensions`, which has to have room for them.
+ * Returns false when the device doesn't support the features or a dependency, or there is no way to ask it.
+ */
+static bool zvar_enable_optional_device_feature(const zvar_device_capabilities_t **capabilities, const char *name, void **next,
+                                                uint32_t *enabled_extension_count, char **enabled_extensions)
+{
+    const zvar_optional_feature_t *feature = zvar_find_optional_feature(name);
+
+    if (!feature)
+        return true;
+
+    VkPhysicalDevice physical_device = (*capabilities)->physical_device;
+    uint32_t device_api_version = (*capabilities)->properties.apiVersion;
+
+    PFN_vkGetPhysicalDeviceFeatures2 get_features = zvar_get_features2_function(physical_device, device_api_version);
+
+    if (!get_features)
+        return false;
+
+    uint32_t api_version = zvar_get_usable_api_version(physical_device, device_api_version);
+
+    for (uint32_t i = 0; i < lengthof(feature->dependencies) && feature->dependencies[i].extension; ++i) {
+        const zvar_extension_dependency_t *dependency = feature->dependencies + i;
+
+        if (api_version < dependency->core_version && !zvar_has_device_extension(capabilities, dependency->extension))
+            return false;
+    }
+
+    if (feature->size) {
+        VkBaseOutStructure *features = zvar_get_scratch(feature->size);
+        memset(features, 0, feature->size);
+        features->sType = feature->type;
+
+        VkPhysicalDeviceFeatures2 features2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = features,
+        };
+
+        get_features(physical_device, &features2);
+
+        for (uint32_t i = 0; i < lengthof(feature->feature_offsets) && feature->feature_offsets[i]; ++i) {
+            VkBool32 *supported = (VkBool32 *)((uint8_t *)features + feature->feature_offsets[i]);
+
+            if (!*supported)
+                return false;
+        }
+
+        // NOTE: Features the list doesn't ask for are left on too, the device supports them all the same.
+
+        features->pNext = *next;
+        *next = features;
+    }
+
+    for (uint32_t i = 0; i < lengthof(feature->dependencies) && feature->dependencies[i].extension; ++i) {
+        const zvar_extension_dependency_t *dependency = feature->dependencies + i;
+
+        if (api_version < dependency->core_version && !zvar_contains_name(*enabled_extension_count, enabled_extensions, dependency->extension)) {
+            enabled_extensions[(*enabled_extension_count)++] = (char *)dependency->extension;
+        }
+    }
+
+    return true;
+}
+
+
+static VkDevice zvar_create_device_with_queue_infos(const zvar_device_create_info_t *info, uint32_t queue_create_info_count, const VkDeviceQueueCreateInfo *queue_create_infos)
+{
+    char **req_device_extensions = info->required_device_extensions;
+    uint32_t req_device_extension_count = info->required_device_extension_count;
+
+    // NOTE: Without a surface there is no swapchain to require.
+    if (info->required_device_extensions == NULL && info->surface != VK_NULL_HANDLE) {
+        req_device_extensions = default_device_extensions;
+        req_device_extension_count = lengthof(default_device_extensions);
+    }
+
+    const zvar_device_capabilities_t *capabilities = zvar_get_device_capabilities(info->physical_device);
+
+    // find device extensions
+    for (uint32_t i = 0; i < req_device_extension_count; ++i) {
+        if (!zvar_has_device_extension(&capabilities, req_device_extensions[i])) {
+            fprintf(stderr, "Required device extension '%s' not found!\n", req_device_extensions[i]);
+            return VK_NULL_HANDLE;
+        }
+    }
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    uint32_t enabled_extension_count = 0;
+    // NOTE: Room for the dependencies of every optional extension too.
+    uint32_t dependency_capacity = info->optional_device_extension_count * lengthof(optional_device_features[0].dependencies);
+    char **enabled_extensions = zvar_get_scratch((req_device_extension_count + info->optional_device_extension_count + dependency_capacity) * sizeof(char *));
+
+    for (uint32_t i = 0; i < req_device_extension_count; ++i) {
+        enabled_extensions[enabled_extension_count++] = req_device_extensions[i];
+    }
+
+    // NOTE: Gets chained in front of the features of optional extensions that are turned on.
+    void *features_next = NULL;
+
+    // NOTE: The structs of features promoted to 1.3 can't be chained next to this one, they all go through it.
+    VkPhysicalDeviceVulkan13Features core_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+    };
+
+    bool has_core_features = false;
+    bool synchronization2 = false;
+
+    for (uint32_t i = 0; i < info->optional_device_extension_count; ++i) {
+        char *name = info->optional_device_extensions[i];
+
+        bool enabled = zvar_contains_name(enabled_extension_count, enabled_extensions, name);
+
+        // NOTE: An already enabled one is named twice or required, which doesn't turn its feature on.
+        if (!enabled) {
+            if (zvar_enable_core_device_feature(capabilities, name, &core_features)) {
+                has_core_features = true;
+                enabled = true;
+            }
+            else if (zvar_has_device_extension(&capabilities, name)
+                  && zvar_enable_optional_device_feature(&capabilities, name, &features_next, &enabled_extension_count, enabled_extensions)) {
+                enabled_extensions[enabled_extension_count++] = name;
+                enabled = true;
+            }
+
+            if (enabled && str_eq(name, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+                synchronization2 = true;
+            }
+        }
+
+        if (info->optional_device_extensions_enabled) {
+            info->optional_device_extensions_enabled[i] = enabled;
+        }
+    }
+
+    if (has_core_features) {
+        core_features.pNext = features_next;
+        features_next = &core_features;
+    }
+
+    VkDevice device;
+
+    const VkAllocationCallbacks *allocation_callbacks = info->allocation_callbacks;
+
+    if (!allocation_callbacks) {
+        zvar_instance_record_t *instance_record = zvar_find_instance_record(info->physical_device);
+
+        allocation_callbacks = instance_record ? instance_record->allocation_callbacks : NULL;
+    }
+
+    // create device
+    {
+        VkDeviceCreateInfo device_create_info = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .pNext = features_next,
+            .queueCreateInfoCount = queue_create_info_count,
+            .pQueueCreateInfos = queue_create_infos,
+            .enabledExtensionCount = enabled_extension_count,
+            .ppEnabledExtensionNames = (const char *const *)enabled_extensions,
+            .pEnabledFeatures = &info->requested_device_features,
+        };
+
+        ZVAR_CHECK(vkCreateDevice(info->physical_device, &device_create_info, allocation_callbacks, &device));
+    }
+
+    zvar_device_record_t *record = zvar_realloc(NULL, sizeof(zvar_device_record_t));
+
+    *record = (zvar_device_record_t) {
+        .dispatch_key = zvar_get_dispatch_key(device),
+        .device = device,
+        .allocation_callbacks = allocation_callbacks,
+        .synchronization2 = synchronization2,
+    };
+
+    // NOTE: Skips the loader trampoline for every device call zvar makes from here on.
+    volkLoadDeviceTable(&record->table, device);
+
+    zvar_lock(&records_lock);
+    zvar_array_push(device_records, device_record_count, device_record_capacity, record);
+    zvar_unlock(&records_lock);
+
+    zvar_restore_scratch(scratch_mark);
+
+    if (info->device_table) {
+        *info->device_table = record->table;
+    }
+    else {
+        volkLoadDevice(device);
+    }
+
+    return device;
+}
+
+
+VkDevice zvar_create_device(const zvar_device_create_info_t *info, uint32_t *graphics_index, uint32_t *compute_index, uint32_t *transfer_index)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_DEVICE);
+
+    uint32_t family_indices[ZVAR_QUEUE_ROLE_COUNT];
+    uint32_t family_queue_counts[ZVAR_QUEUE_ROLE_COUNT];
+
+    zvar_find_queue_families(info->physical_device, info->surface, family_indices, family_queue_counts);
+
+    uint32_t graphics_family_index = family_indices[ZVAR_QUEUE_ROLE_GRAPHICS];
+    uint32_t compute_family_index  = family_indices[ZVAR_QUEUE_ROLE_COMPUTE];
+    uint32_t transfer_family_index = family_indices[ZVAR_QUEUE_ROLE_TRANSFER];
+
+    uint32_t device_queue_create_info_count = 0;
+    VkDeviceQueueCreateInfo device_queue_create_infos[3];
+
+    if (graphics_index && graphics_family_index == ZVAR_NO_INDEX && info->surface != VK_NULL_HANDLE) {
+        fprintf(stderr, "Failed to find graphics queue with a present capability!\n");
+        zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+        return VK_NULL_HANDLE;
+    }
+
+    // NOTE: Headless compute nodes may have no graphics family, the device goes without a graphics queue then.
+    if (graphics_index) {
+        *graphics_index = graphics_family_index;
+    }
+
+    if (graphics_index && graphics_family_index != ZVAR_NO_INDEX) {
+        device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = graphics_family_index,
+            .queueCount = 1,
+            .pQueuePriorities = &(float){ 1.0f },
+        };
+    }
+
+    if (compute_index) {
+        *compute_index = compute_family_index;
+
+        if (compute_family_index != ZVAR_NO_INDEX) {
+            device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = compute_family_index,
+                .queueCount = 1,
+                .pQueuePriorities = &(float){ 1.0f },
+            };
+        }
+    }
+
+    if (transfer_index) {
+        *transfer_index = transfer_family_index;
+
+        if (transfer_family_index != ZVAR_NO_INDEX) {
+            device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = transfer_family_index,
+                .queueCount = 1,
+                .pQueuePriorities = &(float){ 1.0f },
+            };
+        }
+    }
+
+    if (!device_queue_create_info_count) {
+        fprintf(stderr, "Failed to find a queue family for any of the requested queues!\n");
+        zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+        return VK_NULL_HANDLE;
+    }
+
+    VkDevice device = zvar_create_device_with_queue_infos(info, device_queue_create_info_count, device_queue_create_infos);
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+
+    return device;
+}
+
+
+VkDevice zvar_create_device_with_queues(const zvar_device_create_info_t *info, const zvar_queue_topology_create_info_t *topology_info, zvar_queue_topology_t *topology)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CREATE_DEVICE);
+
+    uint32_t family_indices[ZVAR_QUEUE_ROLE_COUNT];
+    uint32_t family_queue_counts[ZVAR_QUEUE_ROLE_COUNT];
+
+    zvar_find_queue_families(info->physical_device, info->surface, family_indices, family_queue_counts);
+
+    // NOTE: Roles without a family of their own fall back onto the graphics one, onto the compute one on headless compute nodes without it.
+    uint32_t fallback_slot = ZVAR_QUEUE_ROLE_GRAPHICS;
+
+    if (family_indices[ZVAR_QUEUE_ROLE_GRAPHICS] == ZVAR_NO_INDEX) {
+        if (info->surface != VK_NULL_HANDLE) {
+            fprintf(stderr, "Failed to find graphics queue with a present capability!\n");
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+            return VK_NULL_HANDLE;
+        }
+
+        if (topology_info->requests[ZVAR_QUEUE_ROLE_GRAPHICS].count || family_indices[ZVAR_QUEUE_ROLE_COMPUTE] == ZVAR_NO_INDEX) {
+            fprintf(stderr, "Failed to find graphics queue, a device without one can only have compute and transfer queues!\n");
+            zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+            return VK_NULL_HANDLE;
+        }
+
+        fallback_slot = ZVAR_QUEUE_ROLE_COMPUTE;
+    }
+
+    *topology = (zvar_queue_topology_t) {0};
+
+    // NOTE: Every role lands in a family of its own slot, the fallback one when there is no dedicated family.
+    //       Queues are handed out in role order, so the first graphics queue is always queue 0.
+    uint32_t family_used_counts[ZVAR_QUEUE_ROLE_COUNT] = {0};
+    float family_priorities[ZVAR_QUEUE_ROLE_COUNT][ZVAR_QUEUE_ROLE_COUNT * ZVAR_MAX_QUEUES_PER_ROLE];
+
+    for (uint32_t role = 0; role < ZVAR_QUEUE_ROLE_COUNT; ++role) {
+        const zvar_queue_request_t *request = topology_info->requests + role;
+
+        uint32_t slot = family_indices[role] == ZVAR_NO_INDEX ? fallback_slot : role;
+
+        uint32_t count = request->count < ZVAR_MAX_QUEUES_PER_ROLE ? request->count : ZVAR_MAX_QUEUES_PER_ROLE;
+
+        for (uint32_t i = 0; i < count; ++i) {
+            zvar_queue_t *queue = topology->queues[role] + i;
+
+            queue->family_index = family_indices[slot];
+            queue->dedicated = slot == role;
+
+            if (family_used_counts[slot] < family_queue_counts[slot]) {
+                queue->queue_index = family_used_counts[slot];
+                family_priorities[slot][family_used_counts[slot]++] = request->priorities ? request->priorities[i] : 1.0f;
+            }
+            else {
+                // Out of queues in the family, wrap around onto the ones already handed out.
+                queue->queue_index = i % family_used_counts[slot];
+                queue->shared = true;
+            }
+        }
+
+        topology->queue_counts[role] = count;
+    }
+
+    uint32_t device_queue_create_info_count = 0;
+    VkDeviceQueueCreateInfo device_queue_create_infos[ZVAR_QUEUE_ROLE_COUNT];
+
+    for (uint32_t slot = 0; slot < ZVAR_QUEUE_ROLE_COUNT; ++slot) {
+        if (!family_used_counts[slot])
+            continue;
+
+        device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = family_indices[slot],
+            .queueCount = family_used_counts[slot],
+            .pQueuePriorities = family_priorities[slot],
+        };
+    }
+
+    VkDevice device = zvar_create_device_with_queue_infos(info, device_queue_create_info_count, device_queue_create_infos);
+
+    if (device == VK_NULL_HANDLE) {
+        zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+        return VK_NULL_HANDLE;
+    }
+
+    for (uint32_t role = 0; role < ZVAR_QUEUE_ROLE_COUNT; ++role) {
+        for (uint32_t i = 0; i < topology->queue_counts[role]; ++i) {
+            zvar_queue_t *queue = topology->queues[role] + i;
+
+            zvar_vk(device, vkGetDeviceQueue)(device, queue->family_index, queue->queue_index, &queue->queue);
+        }
+    }
+
+    // NOTE: A queue that got wrapped onto shares its VkQueue, mark both sides.
+    for (uint32_t role = 0; role < ZVAR_QUEUE_ROLE_COUNT; ++role) {
+        for (uint32_t i = 0; i < topology->queue_counts[role]; ++i) {
+            zvar_queue_t *queue = topology->queues[role] + i;
+
+            if (!queue->shared)
+                continue;
+
+            for (uint32_t other_role = 0; other_role < ZVAR_QUEUE_ROLE_COUNT; ++other_role) {
+                for (uint32_t j = 0; j < topology->queue_counts[other_role]; ++j) {
+                    zvar_queue_t *other = topology->queues[other_role] + j;
+
+                    if (other->queue == queue->queue) {
+                        other->shared = true;
+                    }
+                }
+            }
+        }
+    }
+
+    zvar_instrument_end(ZVAR_COUNTER_CREATE_DEVICE);
+    return device;
+}
+
+
+void zvar_destroy_device(VkDevice device)
+{
+    // NOTE: The record goes first, a device created right after may get the same dispatch key.
+    zvar_device_record_t *record = zvar_find_device_record(device);
+
+    zvar_lock(&records_lock);
+
+    for (uint32_t i = 0; i < device_record_count; ++i) {
+        if (device_records[i] == record) {
+            device_records[i] = device_records[--device_record_count];
+            break;
+        }
+    }
+
+    zvar_unlock(&records_lock);
+
+    zvar_atomic_add(&device_record_generation, 1);
+
+    if (record) {
+        record->table.vkDestroyDevice(device, record->allocation_callbacks);
+    }
+    else {
+        vkDestroyDevice(device, NULL);
+    }
+
+    free(record);
+}
+
+VkSurfaceFormatKHR zvar_find_surface_format(const zvar_surface_format_info_t *info)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_FIND_SURFACE_FORMAT);
+
+    VkFormat *supported_formats = info->supported_surface_formats;
+    uint32_t supported_format_count = info->supported_surface_format_count;
+
+    if (supported_formats == NULL) {
+        supported_formats = default_surface_formats;
+        supported_format_count = lengthof(default_surface_formats);
+    }
+
+    VkColorSpaceKHR *supported_color_spaces = info->supported_surface_color_spaces;
+    uint32_t supported_color_space_count = info->supported_surface_color_space_count;
+
+    if (supported_color_spaces == NULL) {
+        supported_color_spaces = default_surface_color_spaces;
+        supported_color_space_count = lengthof(default_surface_color_spaces);
+    }
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    uint32_t surface_format_count;
+    ZVAR_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(info->physical_device, info->surface, &surface_format_count, NULL));
+    VkSurfaceFormatKHR *surface_formats = zvar_get_scratch(surface_format_count * sizeof(VkSurfaceFormatKHR));
+    ZVAR_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(info->physical_device, info->surface, &surface_format_count, surface_formats));
+
+    uint32_t supported_format_index = supported_format_count;
+    uint32_t supported_space_index  = supported_color_space_count;
+    uint32_t found_format_index = 0;
+
+    for (uint32_t i = 0; i < surface_format_count; ++i) {
+        VkFormat format = surface_formats[i].format;
+
+        for (uint32_t format_index = 0;
+             format_index <= supported_format_index && format_index < supported_format_count;
+             ++format_index)
+        {
+            if (format == supported_formats[format_index]) {
+                VkColorSpaceKHR space = surface_formats[i].colorSpace;
+
+                uint32_t search_count = (format_index == supported_format_index)
+                                      ? supported_space_index
+                                      : supported_color_space_count;
+
+                uint32_t space_index = 0;
+
+                for (; space_index < search_count; ++space_index) {
+                    if (space == supported_color_spaces[space_index])
+                        break;
+                }
+
+                if (space_index == search_count)
+                    continue;
+
+                supported_format_index = format_index;
+                supported_space_index = space_index;
+                found_format_index = i;
+                break;
+            }
+        }
+    }
+
+    if (supported_format_index == supported_format_count) {
+        fprintf(stderr, "Failed to find supported surface format!\n");
+        exit(1);
+    }
+
+    VkSurfaceFormatKHR surface_format = surface_formats[found_format_index];
+
+    zvar_restore_scratch(scratch_mark);
+
+    zvar_instrument_end(ZVAR_COUNTER_FIND_SURFACE_FORMAT);
+    return surface_format;
+}
+
+
+VkFormat zvar_find_depth_format(const zvar_depth_format_info_t *info)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_FIND_DEPTH_FORMAT);
+
+    const VkFormat *depth_format_prefs = info->supported_depth_formats;
+    uint32_t depth_format_pref_count = info->supported_depth_format_count;
+
+    if (depth_format_prefs == NULL) {
+        depth_format_prefs = default_depth_format_prefs;
+        depth_format_pref_count = lengthof(default_depth_format_prefs);
+    }
+
+    VkFormat res = 0;
+
+    uint32_t i = 0;
+
+    for (; i < depth_format_pref_count; ++i) {
+        VkFormat format = depth_format_prefs[i];
+
+        VkFormatProperties format_properties = zvar_get_format_properties(info->physical_device, format);
+
+        if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            res = format;
+            break;
+        }
+    }
+
+    if (i == depth_format_pref_count) {
+        fprintf(stderr, "Failed to find suitable depth format!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    zvar_instrument_end(ZVAR_COUNTER_FIND_DEPTH_FORMAT);
+    return res;
+}
+
+
+/* pipeline cache */
+
+#define ZVAR_PIPELINE_CACHE_MAGIC   0x4350565A // "ZVPC"
+#define ZVAR_PIPELINE_CACHE_VERSION 1
+
+// NOTE: Precedes the blob returned by vkGetPipelineCacheData in the file.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_size;
+    uint64_t data_hash;
+} zvar_pipeline_cache_file_header_t;
+
+
+static uint32_t zvar_read_u32_le(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+
+/* Checks the VkPipelineCacheHeaderVersionOne at the start of the blob, its fields are always little endian. */
+static bool zvar_validate_pipeline_cache_data(const zvar_pipeline_cache_t *cache, const uint8_t *data, size_t size)
+{
+    if (size < 16 + VK_UUID_SIZE)
+        return false;
+
+    uint32_t header_size    = zvar_read_u32_le(data + 0);
+    uint32_t header_version = zvar_read_u32_le(data + 4);
+    uint32_t vendor_id      = zvar_read_u32_le(data + 8);
+    uint32_t device_id      = zvar_read_u32_le(data + 12);
+
+    if (header_size < 16 + VK_UUID_SIZE || header_size > size)
+        return false;
+
+    if (header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+        return false;
+
+    if (vendor_id != cache->vendor_id || device_id != cache->device_id)
+        return false;
+
+    return memcmp(data + 16, cache->uuid, VK_UUID_SIZE) == 0;
+}
+
+
+void zvar_create_pipeline_cache(const zvar_pipeline_cache_create_info_t *info, zvar_pipeline_cache_t *cache)
+{
+    uint64_t start = zvar_time_ns();
+
+    const VkPhysicalDeviceProperties *properties = &zvar_get_device_capabilities(info->physical_device)->properties;
+
+    *cache = (zvar_pipeline_cache_t) {
+        .device = info->device,
+        .vendor_id = properties->vendorID,
+        .device_id = properties->deviceID,
+    };
+
+    memcpy(cache->uuid, properties->pipelineCacheUUID, VK_UUID_SIZE);
+
+    if (info->path) {
+        size_t length = strlen(info->path);
+        cache->path = zvar_realloc(NULL, length + 1);
+        memcpy(cache->path, info->path, length + 1);
+    }
+
+    zvar_mapped_file_t file = {0};
+
+    const void *initial_data = NULL;
+    size_t initial_size = 0;
+
+    if (cache->path && zvar_map_file(cache->path, &file)) {
+        const zvar_pipeline_cache_file_header_t *header = file.data;
+        const uint8_t *data = (const uint8_t *)file.data + sizeof(*header);
+
+        bool valid = file.size >= sizeof(*header)
+                  && header->magic == ZVAR_PIPELINE_CACHE_MAGIC
+                  && header->version == ZVAR_PIPELINE_CACHE_VERSION
+                  && header->data_size == file.size - sizeof(*header)
+                  && zvar_validate_pipeline_cache_data(cache, data, header->data_size)
+                  && zvar_hash_bytes(data, header->data_size) == header->data_hash;
+
+        if (valid) {
+            initial_data = data;
+            initial_size = header->data_size;
+        }
+    }
+
+    VkPipelineCacheCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = initial_size,
+        .pInitialData = initial_data,
+    };
+
+    VkResult res = zvar_vk(cache->device, vkCreatePipelineCache)(cache->device, &create_info, zvar_get_device_allocation_callbacks(cache->device), &cache->cache);
+
+    // A driver may still refuse data that passed the checks, start empty then.
+    if (res != VK_SUCCESS && initial_data) {
+        create_info.initialDataSize = 0;
+        create_info.pInitialData = NULL;
+        initial_size = 0;
+
+        res = zvar_vk(cache->device, vkCreatePipelineCache)(cache->device, &create_info, zvar_get_device_allocation_callbacks(cache->device), &cache->cache);
+    }
+
+    ZVAR_CHECK(res);
+
+    // NOTE: The driver copies the data, the mapping isn't needed past creation.
+    zvar_unmap_file(&file);
+
+    cache->loaded_size = initial_size;
+    cache->load_time_ns = zvar_time_ns() - start;
+}
+
+
+VkPipelineCache zvar_create_worker_pipeline_cache(const zvar_pipeline_cache_t *cache)
+{
+    VkPipelineCacheCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    };
+
+    VkPipelineCache res = VK_NULL_HANDLE;
+
+    ZVAR_CHECK(zvar_vk(cache->device, vkCreatePipelineCache)(cache->device, &create_info, zvar_get_device_allocation_callbacks(cache->device), &res));
+
+    return res;
+}
+
+
+void zvar_merge_pipeline_caches(zvar_pipeline_cache_t *cache, uint32_t worker_cache_count, const VkPipelineCache *worker_caches)
+{
+    if (!worker_cache_count)
+        return;
+
+    ZVAR_CHECK(zvar_vk(cache->device, vkMergePipelineCaches)(cache->device, cache->cache, worker_cache_count, worker_caches));
+}
+
+
+bool zvar_save_pipeline_cache(zvar_pipeline_cache_t *cache)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_SAVE_PIPELINE_CACHE);
+
+    if (!cache->path) {
+        zvar_instrument_end(ZVAR_COUNTER_SAVE_PIPELINE_CACHE);
+        return false;
+    }
+
+    uint64_t start = zvar_time_ns();
+
+    size_t size;
+    ZVAR_CHECK(zvar_vk(cache->device, vkGetPipelineCacheData)(cache->device, cache->cache, &size, NULL));
+
+    void *data = zvar_realloc(NULL, size);
+
+    // NOTE: The cache can only have grown since the size query if another thread uses it.
+    //       What VK_INCOMPLETE leaves behind is still a valid cache.
+    VkResult res = zvar_vk(cache->device, vkGetPipelineCacheData)(cache->device, cache->cache, &size, data);
+
+    if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+        ZVAR_CHECK(res);
+        free(data);
+        zvar_instrument_end(ZVAR_COUNTER_SAVE_PIPELINE_CACHE);
+        return false;
+    }
+
+    zvar_pipeline_cache_file_header_t header = {
+        .magic = ZVAR_PIPELINE_CACHE_MAGIC,
+        .version = ZVAR_PIPELINE_CACHE_VERSION,
+        .data_size = size,
+        .data_hash = zvar_hash_bytes(data, size),
+    };
+
+    bool ok = zvar_write_file_atomic(cache->path, &header, sizeof(header), data, size);
+
+    free(data);
+
+    if (ok) {
+        cache->saved_size = size;
+    }
+
+    cache->save_time_ns = zvar_time_ns() - start;
+
+    zvar_instrument_end(ZVAR_COUNTER_SAVE_PIPELINE_CACHE);
+    return ok;
+}
+
+
+void zvar_destroy_pipeline_cache(zvar_pipeline_cache_t *cache)
+{
+    zvar_save_pipeline_cache(cache);
+
+    zvar_vk(cache->device, vkDestroyPipelineCache)(cache->device, cache->cache, zvar_get_device_allocation_callbacks(cache->device));
+
+    free(cache->path);
+
+    *cache = (zvar_pipeline_cache_t) {0};
+}
+
+
+/* shader library */
+
+#define ZVAR_SPIRV_MAGIC 0x07230203
+
+
+void zvar_create_shader_library(const zvar_shader_library_create_info_t *info, zvar_shader_library_t *library)
+{
+    *library = (zvar_shader_library_t) {
+        .device = info->device,
+        .chain_shader_code = info->chain_shader_code,
+        .free_shaders = ZVAR_NO_INDEX,
+        .free_paths = ZVAR_NO_INDEX,
+        .bucket_count = 64,
+    };
+
+    library->shader_buckets = zvar_realloc(NULL, library->bucket_count * sizeof(uint32_t));
+    library->path_buckets   = zvar_realloc(NULL, library->bucket_count * sizeof(uint32_t));
+
+    memset(library->shader_buckets, 0xFF, library->bucket_count * sizeof(uint32_t));
+    memset(library->path_buckets,   0xFF, library->bucket_count * sizeof(uint32_t));
+}
+
+
+static void zvar_free_shader_entry(zvar_shader_library_t *library, zvar_shader_t *shader)
+{
+    if (shader->module) {
+        zvar_vk(library->device, vkDestroyShaderModule)(library->device, shader->module, zvar_get_device_allocation_callbacks(library->device));
+    }
+
+    if (shader->file) {
+        zvar_unmap_file(shader->file);
+        free(shader->file);
+    }
+}
+
+
+void zvar_destroy_shader_library(zvar_shader_library_t *library)
+{
+    for (uint32_t i = 0; i < library->shader_count; ++i) {
+        if (library->shaders[i].reference_count) {
+            zvar_free_shader_entry(library, library->shaders + i);
+        }
+    }
+
+    for (uint32_t i = 0; i < library->path_count; ++i) {
+        free(library->paths[i].path);
+    }
+
+    free(library->shaders);
+    free(library->paths);
+    free(library->shader_buckets);
+    free(library->path_buckets);
+
+    *library = (zvar_shader_library_t) {0};
+}
+
+
+static void zvar_rehash_shader_library(zvar_shader_library_t *library)
+{
+    uint32_t bucket_count = library->bucket_count * 2;
+    uint32_t mask = bucket_count - 1;
+
+    library->bucket_count = bucket_count;
+    library->shader_buckets = zvar_realloc(library->shader_buckets, bucket_count * sizeof(uint32_t));
+    library->path_buckets   = zvar_realloc(library->path_buckets,   bucket_count * sizeof(uint32_t));
+
+    memset(library->shader_buckets, 0xFF, bucket_count * sizeof(uint32_t));
+    memset(library->path_buckets,   0xFF, bucket_count * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < library->shader_count; ++i) {
+        zvar_shader_t *shader = library->shaders + i;
+
+        if (!shader->reference_count)
+            continue;
+
+        shader->next = library->shader_buckets[shader->hash & mask];
+        library->shader_buckets[shader->hash & mask] = i;
+    }
+
+    for (uint32_t i = 0; i < library->path_count; ++i) {
+        zvar_shader_path_t *path = library->paths + i;
+
+        if (!path->path)
+            continue;
+
+        path->next = library->path_buckets[path->hash & mask];
+        library->path_buckets[path->hash & mask] = i;
+    }
+}
+
+
+/* Looks up identical code or adds a new shader, taking ownership of `file` either way. */
+static uint32_t zvar_intern_shader(zvar_shader_library_t *library, size_t size, const void *code, zvar_mapped_file_t *file)
+{
+    const uint32_t *words = code;
+
+    if (size < 4 || size % 4 || words[0] != ZVAR_SPIRV_MAGIC) {
+        if (file) {
+            zvar_unmap_file(file);
+            free(file);
+        }
+
+        return ZVAR_NO_INDEX;
+    }
+
+    uint64_t hash = zvar_hash_bytes(code, size);
+
+    for (uint32_t i = library->shader_buckets[hash & (library->bucket_count - 1)]; i != ZVAR_NO_INDEX; i = library->shaders[i].next) {
+        zvar_shader_t *shader = library->shaders + i;
+
+        if (shader->hash == hash && shader->size == size && memcmp(shader->code, code, size) == 0) {
+            if (file) {
+                zvar_unmap_file(file);
+                free(file);
+            }
+
+            shader->reference_count++;
+            library->shared_count++;
+            return i;
+        }
+    }
+
+    if (library->live_shader_count >= library->bucket_count) {
+        zvar_rehash_shader_library(library);
+    }
+
+    uint32_t index = library->free_shaders;
+
+    if (index != ZVAR_NO_INDEX) {
+        library->free_shaders = library->shaders[index].next;
+    }
+    else {
+        zvar_array_push(library->shaders, library->shader_count, library->shader_capacity, (zvar_shader_t) {0});
+        index = library->shader_count - 1;
+    }
+
+    uint32_t bucket = hash & (library->bucket_count - 1);
+
+    library->shaders[index] = (zvar_shader_t) {
+        .hash = hash,
+        .code = words,
+        .size = size,
+        .file = file,
+        .module = library->chain_shader_code ? VK_NULL_HANDLE : zvar_create_shader_module(library->device, size, (void *)code),
+        .reference_count = 1,
+        .next = library->shader_buckets[bucket],
+    };
+
+    library->shader_buckets[bucket] = index;
+    library->live_shader_count++;
+
+    return index;
+}
+
+
+uint32_t zvar_load_shader(zvar_shader_library_t *library, const char *path)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_LOAD_SHADER);
+
+    size_t length = strlen(path);
+    uint64_t path_hash = zvar_hash_bytes(path, length);
+
+    for (uint32_t i = library->path_buckets[path_hash & (library->bucket_count - 1)]; i != ZVAR_NO_INDEX; i = library->paths[i].next) {
+        zvar_shader_path_t *p = library->paths + i;
+
+        if (p->hash == path_hash && strcmp(p->path, path) == 0) {
+            library->shaders[p->shader].reference_count++;
+            library->shared_count++;
+            zvar_instrument_end(ZVAR_COUNTER_LOAD_SHADER);
+            return p->shader;
+        }
+    }
+
+    zvar_mapped_file_t *file = zvar_realloc(NULL, sizeof(zvar_mapped_file_t));
+
+    if (!zvar_map_file(path, file)) {
+        free(file);
+        zvar_instrument_end(ZVAR_COUNTER_LOAD_SHADER);
+        return ZVAR_NO_INDEX;
+    }
+
+    library->mapped_file_count++;
+
+    uint32_t shader = zvar_intern_shader(library, file->size, file->data, file);
+
+    if (shader == ZVAR_NO_INDEX) {
+        zvar_instrument_end(ZVAR_COUNTER_LOAD_SHADER);
+        return ZVAR_NO_INDEX;
+    }
+
+    // remember the path, even when the code turned out to be shared
+    uint32_t index = library->free_paths;
+
+    if (index != ZVAR_NO_INDEX) {
+        library->free_paths = library->paths[index].next;
+    }
+    else {
+        zvar_array_push(library->paths, library->path_count, library->path_capacity, (zvar_shader_path_t) {0});
+        index = library->path_count - 1;
+    }
+
+    char *path_copy = zvar_realloc(NULL, length + 1);
+    memcpy(path_copy, path, length + 1);
+
+    uint32_t bucket = path_hash & (library->bucket_count - 1);
+
+    library->paths[index] = (zvar_shader_path_t) {
+        .hash = path_hash,
+        .path = path_copy,
+        .shader = shader,
+        .next = library->path_buckets[bucket],
+    };
+
+    library->path_buckets[bucket] = index;
+
+    zvar_instrument_end(ZVAR_COUNTER_LOAD_SHADER);
+    return shader;
+}
+
+
+uint32_t zvar_add_shader(zvar_shader_library_t *library, size_t size, const void *code)
+{
+    return zvar_intern_shader(library, size, code, NULL);
+}
+
+
+void zvar_release_shader(zvar_shader_library_t *library, uint32_t index)
+{
+    zvar_shader_t *shader = library->shaders + index;
+
+    if (--shader->reference_count)
+        return;
+
+    uint32_t mask = library->bucket_count - 1;
+
+    // forget the paths leading to it
+    for (uint32_t i = 0; i < library->path_count; ++i) {
+        zvar_shader_path_t *path = library->paths + i;
+
+        if (!path->path || path->shader != index)
+            continue;
+
+        uint32_t *link = library->path_buckets + (path->hash & mask);
+
+        while (*link != i) {
+            link = &library->paths[*link].next;
+        }
+
+        *link = path->next;
+
+        free(path->path);
+        path->path = NULL;
+        path->next = library->free_paths;
+        library->free_paths = i;
+    }
+
+    uint32_t *link = library->shader_buckets + (shader->hash & mask);
+
+    while (*link != index) {
+        link = &library->shaders[*link].next;
+    }
+
+    *link = shader->next;
+
+    zvar_free_shader_entry(library, shader);
+
+    *shader = (zvar_shader_t) {
+        .next = library->free_shaders,
+    };
+
+    library->free_shaders = index;
+    library->live_shader_count--;
+}
+
+
+VkPipelineShaderStageCreateInfo zvar_get_shader_stage(const zvar_shader_library_t *library, uint32_t index, VkShaderStageFlagBits stage, const char *entry_point,
+                                                      VkShaderModuleCreateInfo *chained_code)
+{
+    const zvar_shader_t *shader = library->shaders + index;
+
+    VkPipelineShaderStageCreateInfo res = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = stage,
+        .module = shader->module,
+        .pName = entry_point ? entry_point : "main",
+    };
+
+    if (!shader->module) {
+        *chained_code = (VkShaderModuleCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = shader->size,
+            .pCode = shader->code,
+        };
+
+        res.pNext = chained_code;
+    }
+
+    return res;
+}
+
+
+/* host allocators */
+
+/* Sits right before every pointer handed out by the built-in host allocators. */
+typedef struct
+{
+    uint32_t offset;
+    uint32_t size_class;
+    uint64_t size;
+} zvar_host_header_t;
+
+#define ZVAR_HOST_MIN_ALIGNMENT     16
+#define ZVAR_HOST_POOL_MIN_SHIFT    6
+#define ZVAR_HOST_SLAB_SIZE         (64 * 1024)
+#define ZVAR_HOST_ARENA_CHUNK_SIZE  (256 * 1024)
+
+static size_t zvar_host_alignment(size_t alignment)
+{
+    return alignment < ZVAR_HOST_MIN_ALIGNMENT ? ZVAR_HOST_MIN_ALIGNMENT : alignment;
+}
+
+static zvar_host_header_t *zvar_get_host_header(void *memory)
+{
+    return (zvar_host_header_t *)memory - 1;
+}
+
+/* A 16 byte aligned `block` needs `size + alignment` bytes. */
+static void *zvar_place_host_allocation(void *block, size_t size, size_t alignment, uint32_t size_class)
+{
+    uintptr_t start = (uintptr_t)block;
+    uintptr_t res = (start + sizeof(zvar_host_header_t) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+    zvar_host_header_t *header = (zvar_host_header_t *)res - 1;
+    header->offset = (uint32_t)(res - start);
+    header->size_class = size_class;
+    header->size = size;
+
+    return (void *)res;
+}
+
+static void *zvar_host_malloc(size_t size, size_t alignment)
+{
+    alignment = zvar_host_alignment(alignment);
+
+    // NOTE: Extra header worth of bytes in case malloc aligns to less than 16.
+    void *block = malloc(size + alignment + sizeof(zvar_host_header_t));
+    if (!block)
+        return NULL;
+
+    return zvar_place_host_allocation(block, size, alignment, ZVAR_NO_INDEX);
+}
+
+static void zvar_host_free(void *memory)
+{
+    if (!memory)
+        return;
+
+    free((uint8_t *)memory - zvar_get_host_header(memory)->offset);
+}
+
+static void *zvar_host_realloc(void *original, size_t size, size_t alignment)
+{
+    if (!original)
+        return zvar_host_malloc(size, alignment);
+
+    if (!size) {
+        zvar_host_free(original);
+        return NULL;
+    }
+
+    void *res = zvar_host_malloc(size, alignment);
+    if (!res)
+        return NULL;
+
+    size_t old_size = zvar_get_host_header(original)->size;
+    memcpy(res, original, old_size < size ? old_size : size);
+
+    zvar_host_free(original);
+
+    return res;
+}
+
+
+static void *zvar_forward_allocation(const VkAllocationCallbacks *callbacks, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    if (callbacks)
+        return callbacks->pfnAllocation(callbacks->pUserData, size, alignment, scope);
+
+    return zvar_host_malloc(size, alignment);
+}
+
+static void *zvar_forward_reallocation(const VkAllocationCallbacks *callbacks, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    if (callbacks)
+        return callbacks->pfnReallocation(callbacks->pUserData, original, size, alignment, scope);
+
+    return zvar_host_realloc(original, size, alignment);
+}
+
+static void zvar_forward_free(const VkAllocationCallbacks *callbacks, void *memory)
+{
+    if (callbacks) {
+        callbacks->pfnFree(callbacks->pUserData, memory);
+        return;
+    }
+
+    zvar_host_free(memory);
+}
+
+
+static size_t zvar_get_pool_class_size(uint32_t size_class)
+{
+    return (size_t)1 << (size_class + ZVAR_HOST_POOL_MIN_SHIFT);
+}
+
+/* Called under the lock, returns one block of a fresh slab and puts the rest on the free list. */
+static void *zvar_carve_pool_slab(zvar_pool_host_allocator_t *allocator, uint32_t size_class)
+{
+    uint8_t *slab = malloc(ZVAR_HOST_SLAB_SIZE + 2 * ZVAR_HOST_MIN_ALIGNMENT);
+    if (!slab)
+        return NULL;
+
+    *(void **)slab = allocator->slabs;
+    allocator->slabs = slab;
+    allocator->slab_count++;
+
+    uint8_t *data = (uint8_t *)zvar_align_up((uintptr_t)slab + sizeof(void *), ZVAR_HOST_MIN_ALIGNMENT);
+
+    size_t class_size = zvar_get_pool_class_size(size_class);
+    size_t block_count = ZVAR_HOST_SLAB_SIZE / class_size;
+
+    for (size_t i = block_count - 1; i > 0; --i) {
+        void *block = data + i * class_size;
+
+        *(void **)block = allocator->free_lists[size_class];
+        allocator->free_lists[size_class] = block;
+    }
+
+    return data;
+}
+
+static VKAPI_ATTR void *VKAPI_CALL zvar_pool_allocation(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    (void)scope;
+
+    zvar_pool_host_allocator_t *allocator = user_data;
+
+    alignment = zvar_host_alignment(alignment);
+    size_t needed = size + alignment;
+
+    uint32_t size_class = needed <= zvar_get_pool_class_size(0)
+                        ? 0
+                        : zvar_bit_scan_reverse(needed - 1) + 1 - ZVAR_HOST_POOL_MIN_SHIFT;
+
+    if (size_class >= ZVAR_HOST_POOL_CLASS_COUNT) {
+        zvar_atomic_add(&allocator->large_count, 1);
+        return zvar_host_malloc(size, alignment);
+    }
+
+    zvar_lock(&allocator->lock);
+
+    void *block = allocator->free_lists[size_class];
+
+    if (block) {
+        allocator->free_lists[size_class] = *(void **)block;
+    }
+    else {
+        block = zvar_carve_pool_slab(allocator, size_class);
+    }
+
+    zvar_unlock(&allocator->lock);
+
+    if (!block)
+        return NULL;
+
+    zvar_atomic_add(&allocator->pooled_count, 1);
+
+    return zvar_place_host_allocation(block, size, alignment, size_class);
+}
+
+static VKAPI_ATTR void VKAPI_CALL zvar_pool_free(void *user_data, void *memory)
+{
+    zvar_pool_host_allocator_t *allocator = user_data;
+
+    if (!memory)
+        return;
+
+    zvar_host_header_t *header = zvar_get_host_header(memory);
+
+    if (header->size_class == ZVAR_NO_INDEX) {
+        zvar_host_free(memory);
+        return;
+    }
+
+    void *block = (uint8_t *)memory - header->offset;
+    uint32_t size_class = header->size_class;
+
+    zvar_lock(&allocator->lock);
+
+    *(void **)block = allocator->free_lists[size_class];
+    allocator->free_lists[size_class] = block;
+
+    zvar_unlock(&allocator->lock);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL zvar_pool_reallocation(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    if (!original)
+        return zvar_pool_allocation(user_data, size, alignment, scope);
+
+    if (!size) {
+        zvar_pool_free(user_data, original);
+        return NULL;
+    }
+
+    zvar_host_header_t *header = zvar_get_host_header(original);
+
+    // NOTE: Stays in its block as long as it fits and keeps the alignment.
+    if (header->size_class != ZVAR_NO_INDEX
+     && ((uintptr_t)original & (alignment - 1)) == 0
+     && header->offset + size <= zvar_get_pool_class_size(header->size_class))
+    {
+        header->size = size;
+        return original;
+    }
+
+    void *res = zvar_pool_allocation(user_data, size, alignment, scope);
+    if (!res)
+        return NULL;
+
+    memcpy(res, original, header->size < size ? header->size : size);
+
+    zvar_pool_free(user_data, original);
+
+    return res;
+}
+
+
+void zvar_create_pool_host_allocator(zvar_pool_host_allocator_t *allocator)
+{
+    *allocator = (zvar_pool_host_allocator_t) {
+        .callbacks = {
+            .pUserData = allocator,
+            .pfnAllocation = zvar_pool_allocation,
+            .pfnReallocation = zvar_pool_reallocation,
+            .pfnFree = zvar_pool_free,
+        },
+    };
+}
+
+
+void zvar_destroy_pool_host_allocator(zvar_pool_host_allocator_t *allocator)
+{
+    void *slab = allocator->slabs;
+
+    while (slab) {
+        void *next = *(void **)slab;
+        free(slab);
+        slab = next;
+    }
+
+    allocator->slabs = NULL;
+
+    for (uint32_t i = 0; i < ZVAR_HOST_POOL_CLASS_COUNT; ++i) {
+        allocator->free_lists[i] = NULL;
+    }
+}
+
+
+typedef struct zvar_arena_chunk zvar_arena_chunk_t;
+
+struct zvar_arena_chunk
+{
+    zvar_arena_chunk_t *next;
+    size_t size;
+};
+
+static uint8_t *zvar_get_arena_chunk_data(zvar_arena_chunk_t *chunk)
+{
+    return (uint8_t *)zvar_align_up((uintptr_t)(chunk + 1), ZVAR_HOST_MIN_ALIGNMENT);
+}
+
+static bool zvar_arena_owns(zvar_arena_host_allocator_t *allocator, void *memory)
+{
+    bool res = false;
+
+    zvar_lock(&allocator->lock);
+
+    for (zvar_arena_chunk_t *chunk = allocator->chunks; chunk; chunk = chunk->next) {
+        uint8_t *data = zvar_get_arena_chunk_data(chunk);
+
+        if ((uint8_t *)memory >= data && (uint8_t *)memory < data + chunk->size) {
+            res = true;
+            break;
+        }
+    }
+
+    zvar_unlock(&allocator->lock);
+
+    return res;
+}
+
+static VKAPI_ATTR void *VKAPI_CALL zvar_arena_allocation(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    zvar_arena_host_allocator_t *allocator = user_data;
+
+    if (scope > allocator->max_scope)
+        return zvar_forward_allocation(allocator->fallback, size, alignment, scope);
+
+    alignment = zvar_host_alignment(alignment);
+    size_t needed = size + alignment;
+
+    zvar_lock(&allocator->lock);
+
+    zvar_arena_chunk_t *chunk = allocator->current_chunk;
+    size_t offset = zvar_align_up(allocator->used, ZVAR_HOST_MIN_ALIGNMENT);
+
+    if (!chunk || offset + needed > chunk->size) {
+        zvar_arena_chunk_t *next = chunk ? chunk->next : allocator->chunks;
+
+        // NOTE: Chunks from before the last reset get reused, a new one goes in front of a chunk that is too small.
+        if (!next || needed > next->size) {
+            size_t chunk_size = needed > allocator->chunk_size ? needed : allocator->chunk_size;
+
+            zvar_arena_chunk_t *fresh = malloc(sizeof(zvar_arena_chunk_t) + ZVAR_HOST_MIN_ALIGNMENT + chunk_size);
+            if (!fresh) {
+                zvar_unlock(&allocator->lock);
+                return NULL;
+            }
+
+            fresh->size = chunk_size;
+            fresh->next = next;
+
+            if (chunk) {
+                chunk->next = fresh;
+            }
+            else {
+                allocator->chunks = fresh;
+            }
+
+            next = fresh;
+        }
+
+        chunk = next;
+        offset = 0;
+
+        allocator->current_chunk = chunk;
+    }
+
+    allocator->used = offset + needed;
+
+    allocator->used_bytes += needed;
+    if (allocator->used_bytes > allocator->peak_bytes) {
+        allocator->peak_bytes = allocator->used_bytes;
+    }
+
+    zvar_unlock(&allocator->lock);
+
+    return zvar_place_host_allocation(zvar_get_arena_chunk_data(chunk) + offset, size, alignment, ZVAR_NO_INDEX);
+}
+
+static VKAPI_ATTR void VKAPI_CALL zvar_arena_free(void *user_data, void *memory)
+{
+    zvar_arena_host_allocator_t *allocator = user_data;
+
+    if (!memory || zvar_arena_owns(allocator, memory))
+        return;
+
+    zvar_forward_free(allocator->fallback, memory);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL zvar_arena_reallocation(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    zvar_arena_host_allocator_t *allocator = user_data;
+
+    if (!original)
+        return zvar_arena_allocation(user_data, size, alignment, scope);
+
+    if (!zvar_arena_owns(allocator, original))
+        return zvar_forward_reallocation(allocator->fallback, original, size, alignment, scope);
+
+    if (!size)
+        return NULL;
+
+    void *res = zvar_arena_allocation(user_data, size, alignment, scope);
+    if (!res)
+        return NULL;
+
+    size_t old_size = zvar_get_host_header(original)->size;
+    memcpy(res, original, old_size < size ? old_size : size);
+
+    return res;
+}
+
+
+void zvar_create_arena_host_allocator(const zvar_arena_host_allocator_create_info_t *info, zvar_arena_host_allocator_t *allocator)
+{
+    *allocator = (zvar_arena_host_allocator_t) {
+        .callbacks = {
+            .pUserData = allocator,
+            .pfnAllocation = zvar_arena_allocation,
+            .pfnReallocation = zvar_arena_reallocation,
+            .pfnFree = zvar_arena_free,
+        },
+        .max_scope = info->max_scope,
+        .fallback = info->fallback,
+        .chunk_size = info->chunk_size ? info->chunk_size : ZVAR_HOST_ARENA_CHUNK_SIZE,
+    };
+}
+
+
+void zvar_destroy_arena_host_allocator(zvar_arena_host_allocator_t *allocator)
+{
+    zvar_arena_chunk_t *chunk = allocator->chunks;
+
+    while (chunk) {
+        zvar_arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    allocator->chunks = NULL;
+    allocator->current_chunk = NULL;
+    allocator->used = 0;
+}
+
+
+void zvar_reset_arena_host_allocator(zvar_arena_host_allocator_t *allocator)
+{
+    zvar_lock(&allocator->lock);
+
+    allocator->current_chunk = NULL;
+    allocator->used = 0;
+    allocator->used_bytes = 0;
+
+    zvar_unlock(&allocator->lock);
+}
+
+
+static VKAPI_ATTR void *VKAPI_CALL zvar_counting_allocation(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    zvar_counting_host_allocator_t *allocator = user_data;
+
+    zvar_atomic_add(&allocator->counts.allocations[scope], 1);
+    zvar_atomic_add(&allocator->counts.allocated_bytes[scope], size);
+
+    return zvar_forward_allocation(allocator->parent, size, alignment, scope);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL zvar_counting_reallocation(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    zvar_counting_host_allocator_t *allocator = user_data;
+
+    zvar_atomic_add(&allocator->counts.reallocations[scope], 1);
+    zvar_atomic_add(&allocator->counts.allocated_bytes[scope], size);
+
+    return zvar_forward_reallocation(allocator->parent, original, size, alignment, scope);
+}
+
+static VKAPI_ATTR void VKAPI_CALL zvar_counting_free(void *user_data, void *memory)
+{
+    zvar_counting_host_allocator_t *allocator = user_data;
+
+    if (memory) {
+        zvar_atomic_add(&allocator->counts.frees, 1);
+    }
+
+    zvar_forward_free(allocator->parent, memory);
+}
+
+static VKAPI_ATTR void VKAPI_CALL zvar_counting_internal_allocation(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+    zvar_counting_host_allocator_t *allocator = user_data;
+
+    zvar_atomic_add(&allocator->counts.internal_allocations[scope], 1);
+    zvar_atomic_add(&allocator->counts.internal_allocated_bytes[scope], size);
+
+    const VkAllocationCallbacks *parent = allocator->parent;
+
+    if (parent && parent->pfnInternalAllocation) {
+        parent->pfnInternalAllocation(parent->pUserData, size, type, scope);
+    }
+}
+
+static VKAPI_ATTR void VKAPI_CALL zvar_counting_internal_free(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+    zvar_counting_host_allocator_t *allocator = user_data;
+
+    zvar_atomic_add(&allocator->counts.internal_frees, 1);
+
+    const VkAllocationCallbacks *parent = allocator->parent;
+
+    if (parent && parent->pfnInternalFree) {
+        parent->pfnInternalFree(parent->pUserData, size, type, scope);
+    }
+}
+
+
+void zvar_create_counting_host_allocator(const VkAllocationCallbacks *parent, zvar_counting_host_allocator_t *allocator)
+{
+    *allocator = (zvar_counting_host_allocator_t) {
+        .callbacks = {
+            .pUserData = allocator,
+            .pfnAllocation = zvar_counting_allocation,
+            .pfnReallocation = zvar_counting_reallocation,
+            .pfnFree = zvar_counting_free,
+            .pfnInternalAllocation = zvar_counting_internal_allocation,
+            .pfnInternalFree = zvar_counting_internal_free,
+        },
+        .parent = parent,
+    };
+}
+
+
+void zvar_take_host_allocation_counts(zvar_counting_host_allocator_t *allocator, zvar_host_allocation_counts_t *counts)
+{
+    // NOTE: The counts are nothing but uint64_t fields.
+    uint64_t *src = (uint64_t *)&allocator->counts;
+    uint64_t *dst = (uint64_t *)counts;
+
+    for (size_t i = 0; i < sizeof(zvar_host_allocation_counts_t) / sizeof(uint64_t); ++i) {
+        dst[i] = zvar_atomic_exchange(src + i, 0);
+    }
+}
+
+
+/* gpu profiler */
+
+#define ZVAR_DEFAULT_PROFILER_ZONES 64
+
+bool zvar_create_profiler(const zvar_profiler_create_info_t *info, zvar_profiler_t *profiler)
+{
+    const zvar_device_capabilities_t *capabilities = zvar_get_device_capabilities(info->physical_device);
+
+    uint32_t valid_bits = capabilities->queue_families[info->queue_family_index].timestampValidBits;
+
+    if (valid_bits == 0)
+        return false;
+
+    uint32_t max_zones = info->max_zones_per_frame ? info->max_zones_per_frame : ZVAR_DEFAULT_PROFILER_ZONES;
+
+    *profiler = (zvar_profiler_t) {
+        .device = info->device,
+        .ns_per_tick = capabilities->properties.limits.timestampPeriod,
+        .timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1,
+        .frames_in_flight = info->frames_in_flight,
+        .max_zones_per_frame = max_zones,
+        .record_counts = zvar_realloc(NULL, info->frames_in_flight * sizeof(uint32_t)),
+        .records = zvar_realloc(NULL, info->frames_in_flight * max_zones * sizeof(zvar_profiler_record_t)),
+    };
+
+    for (uint32_t i = 0; i < info->frames_in_flight; ++i) {
+        profiler->record_counts[i] = 0;
+    }
+
+    VkQueryPoolCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = info->frames_in_flight * max_zones * 2,
+    };
+
+    ZVAR_CHECK(zvar_vk(info->device, vkCreateQueryPool)(info->device, &create_info, zvar_get_device_allocation_callbacks(info->device), &profiler->query_pool));
+
+    return true;
+}
+
+
+void zvar_destroy_profiler(zvar_profiler_t *profiler)
+{
+    zvar_vk(profiler->device, vkDestroyQueryPool)(profiler->device, profiler->query_pool, zvar_get_device_allocation_callbacks(profiler->device));
+
+    free(profiler->record_counts);
+    free(profiler->records);
+    free(profiler->zones);
+    free(profiler->events);
+}
+
+
+static void zvar_resolve_profiler_frame(zvar_profiler_t *profiler, uint32_t slot)
+{
+    uint32_t record_count = profiler->record_counts[slot];
+
+    if (!record_count)
+        return;
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    // NOTE: Every query comes back as a value and availability pair.
+    uint32_t query_count = record_count * 2;
+    uint64_t *results = zvar_get_scratch(query_count * 2 * sizeof(uint64_t));
+
+    // Doesn't wait, a query that isn't available drops its zone instead.
+    VkResult res = zvar_vk(profiler->device, vkGetQueryPoolResults)(profiler->device, profiler->query_pool, slot * profiler->max_zones_per_frame * 2, query_count,
+                                                  query_count * 2 * sizeof(uint64_t), results, 2 * sizeof(uint64_t),
+                                                  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    if (res != VK_NOT_READY) {
+        ZVAR_CHECK(res);
+    }
+
+    // The frame that used the slot is `frames_in_flight` behind the one beginning.
+    uint64_t frame_number = profiler->frame_number - profiler->frames_in_flight;
+
+    zvar_profiler_record_t *records = profiler->records + slot * profiler->max_zones_per_frame;
+
+    for (uint32_t i = 0; i < record_count; ++i) {
+        uint64_t *begin = results + i * 4;
+        uint64_t *end   = begin + 2;
+
+        if (!records[i].ended || !begin[1] || !end[1]) {
+            profiler->dropped_zone_count++;
+            continue;
+        }
+
+        uint64_t ticks = (end[0] - begin[0]) & profiler->timestamp_mask;
+
+        zvar_profiler_zone_t *zone = profiler->zones + records[i].zone;
+        zone->frame_ticks += ticks;
+        zone->touched = true;
+
+        profiler->resolved_zone_count++;
+
+        if (profiler->tracing) {
+            if (!profiler->has_trace_origin) {
+                profiler->trace_origin = begin[0];
+                profiler->has_trace_origin = true;
+            }
+
+            uint64_t offset = (begin[0] - profiler->trace_origin) & profiler->timestamp_mask;
+
+            zvar_array_push(profiler->events, profiler->event_count, profiler->event_capacity, (zvar_profiler_event_t) {
+                .zone = records[i].zone,
+                .frame_number = frame_number,
+                .begin_ns = (uint64_t)((double)offset * profiler->ns_per_tick),
+                .duration_ns = (uint64_t)((double)ticks * profiler->ns_per_tick),
+            });
+        }
+    }
+
+    for (uint32_t i = 0; i < profiler->zone_count; ++i) {
+        zvar_profiler_zone_t *zone = profiler->zones + i;
+
+        if (!zone->touched)
+            continue;
+
+        zone->samples[zone->next_sample] = (double)zone->frame_ticks * profiler->ns_per_tick * 1e-6;
+        zone->next_sample = (zone->next_sample + 1) % ZVAR_PROFILER_WINDOW;
+
+        if (zone->sample_count < ZVAR_PROFILER_WINDOW) {
+            zone->sample_count++;
+        }
+
+        zone->frame_ticks = 0;
+        zone->touched = false;
+    }
+
+    profiler->record_counts[slot] = 0;
+
+    zvar_restore_scratch(scratch_mark);
+}
+
+
+void zvar_begin_profiler_frame(zvar_profiler_t *profiler, VkCommandBuffer command_buffer)
+{
+    uint32_t slot = (uint32_t)(profiler->frame_number % profiler->frames_in_flight);
+
+    profiler->frame_slot = slot;
+
+    zvar_resolve_profiler_frame(profiler, slot);
+
+    profiler->frame_number++;
+
+    zvar_vk(command_buffer, vkCmdResetQueryPool)(command_buffer, profiler->query_pool, slot * profiler->max_zones_per_frame * 2, profiler->max_zones_per_frame * 2);
+}
+
+
+static uint32_t zvar_find_profiler_zone(zvar_profiler_t *profiler, const char *name)
+{
+    // NOTE: Names are mostly string literals, so pointers get compared first.
+    for (uint32_t i = 0; i < profiler->zone_count; ++i) {
+        if (profiler->zones[i].name == name)
+            return i;
+    }
+
+    for (uint32_t i = 0; i < profiler->zone_count; ++i) {
+        if (strcmp(profiler->zones[i].name, name) == 0)
+            return i;
+    }
+
+    zvar_array_push(profiler->zones, profiler->zone_count, profiler->zone_capacity, (zvar_profiler_zone_t) {
+        .name = name,
+    });
+
+    return profiler->zone_count - 1;
+}
+
+
+uint32_t zvar_begin_zone(zvar_profiler_t *profiler, VkCommandBuffer command_buffer, const char *name)
+{
+    uint32_t slot = profiler->frame_slot;
+    uint32_t record = profiler->record_counts[slot];
+
+    if (record == profiler->max_zones_per_frame) {
+        profiler->dropped_zone_count++;
+        return ZVAR_NO_INDEX;
+    }
+
+    profiler->record_counts[slot]++;
+
+    profiler->records[slot * profiler->max_zones_per_frame + record] = (zvar_profiler_record_t) {
+        .zone = zvar_find_profiler_zone(profiler, name),
+    };
+
+    uint32_t query = (slot * profiler->max_zones_per_frame + record) * 2;
+
+    zvar_vk(command_buffer, vkCmdWriteTimestamp)(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->query_pool, query);
+
+    return record;
+}
+
+
+void zvar_end_zone(zvar_profiler_t *profiler, VkCommandBuffer command_buffer, uint32_t record)
+{
+    if (record == ZVAR_NO_INDEX)
+        return;
+
+    uint32_t slot = profiler->frame_slot;
+    uint32_t query = (slot * profiler->max_zones_per_frame + record) * 2 + 1;
+
+    zvar_vk(command_buffer, vkCmdWriteTimestamp)(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->query_pool, query);
+
+    profiler->records[slot * profiler->max_zones_per_frame + record].ended = true;
+}
+
+
+uint32_t zvar_get_profiler_report(const zvar_profiler_t *profiler, uint32_t capacity, zvar_profiler_report_t *reports)
+{
+    uint32_t count = profiler->zone_count < capacity ? profiler->zone_count : capacity;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const zvar_profiler_zone_t *zone = profiler->zones + i;
+
+        zvar_profiler_report_t report = {
+            .name = zone->name,
+            .sample_count = zone->sample_count,
+        };
+
+        if (zone->sample_count) {
+            report.min_ms = zone->samples[0];
+            report.max_ms = zone->samples[0];
+
+            double sum = 0.0;
+
+            for (uint32_t j = 0; j < zone->sample_count; ++j) {
+                double sample = zone->samples[j];
+
+                if (sample < report.min_ms) report.min_ms = sample;
+                if (sample > report.max_ms) report.max_ms = sample;
+                sum += sample;
+            }
+
+            report.avg_ms = sum / zone->sample_count;
+            report.last_ms = zone->samples[(zone->next_sample + ZVAR_PROFILER_WINDOW - 1) % ZVAR_PROFILER_WINDOW];
+        }
+
+        reports[i] = report;
+    }
+
+    return profiler->zone_count;
+}
+
+
+void zvar_start_profiler_trace(zvar_profiler_t *profiler)
+{
+    profiler->tracing = true;
+    profiler->has_trace_origin = false;
+    profiler->event_count = 0;
+}
+
+
+bool zvar_write_profiler_trace(zvar_profiler_t *profiler, const char *path)
+{
+    profiler->tracing = false;
+
+    FILE *file = fopen(path, "wb");
+
+    if (!file)
+        return false;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for (uint32_t i = 0; i < profiler->event_count; ++i) {
+        zvar_profiler_event_t *event = profiler->events + i;
+
+        fprintf(file, "%s{\"name\":\"", i ? ",\n" : "");
+
+        for (const char *c = profiler->zones[event->zone].name; *c; ++c) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', file);
+            }
+
+            fputc(*c, file);
+        }
+
+        // NOTE: Chrome trace times are in microseconds.
+        fprintf(file, "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                (double)event->begin_ns * 1e-3, (double)event->duration_ns * 1e-3, (unsigned long long)event->frame_number);
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    profiler->event_count = 0;
+
+    return fclose(file) == 0;
+}
+
+
+/* physical device selection */
+
+int64_t zvar_score_physical_device(const zvar_device_selection_info_t *info, VkPhysicalDevice physical_device)
+{
+    const zvar_device_capabilities_t *capabilities = zvar_get_device_capabilities(physical_device);
+
+    // NOTE: VkPhysicalDeviceFeatures is nothing but VkBool32s.
+    const VkBool32 *required_features = (const VkBool32 *)&info->required_features;
+    const VkBool32 *supported_features = (const VkBool32 *)&capabilities->features;
+
+    for (uint32_t i = 0; i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); ++i) {
+        if (required_features[i] && !supported_features[i])
+            return -1;
+    }
+
+    for (uint32_t i = 0; i < info->required_extension_count; ++i) {
+        if (!zvar_has_device_extension(&capabilities, info->required_extensions[i]))
+            return -1;
+    }
+
+    uint32_t family_indices[ZVAR_QUEUE_ROLE_COUNT];
+    uint32_t family_queue_counts[ZVAR_QUEUE_ROLE_COUNT];
+
+    zvar_find_queue_families(physical_device, info->surface, family_indices, family_queue_counts);
+
+    if (family_indices[ZVAR_QUEUE_ROLE_GRAPHICS] == ZVAR_NO_INDEX)
+        return -1;
+
+    // NOTE: The type outweighs everything else, integrated GPUs may report all of the system memory as device local.
+    int64_t score;
+
+    switch (capabilities->properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   score = 100000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score = 50000;  break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    score = 20000;  break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            score = 10000;  break;
+        default:                                     score = 0;      break;
+    }
+
+    // A point for every 16 MiB of the biggest device local heap.
+    VkDeviceSize device_local_size = 0;
+
+    for (uint32_t i = 0; i < capabilities->memory_properties.memoryHeapCount; ++i) {
+        const VkMemoryHeap *heap = capabilities->memory_properties.memoryHeaps + i;
+
+        if ((heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap->size > device_local_size) {
+            device_local_size = heap->size;
+        }
+    }
+
+    score += (int64_t)(device_local_size >> 24);
+
+    // Async compute and copies overlap with graphics only on families of their own.
+    if (family_indices[ZVAR_QUEUE_ROLE_COMPUTE] != ZVAR_NO_INDEX) {
+        score += 1000;
+    }
+
+    if (family_indices[ZVAR_QUEUE_ROLE_TRANSFER] != ZVAR_NO_INDEX) {
+        score += 1000;
+    }
+
+    const VkPhysicalDeviceLimits *limits = &capabilities->properties.limits;
+
+    score += limits->maxImageDimension2D / 64;
+    score += limits->maxComputeSharedMemorySize / 1024;
+
+    if (info->score_callback) {
+        int64_t user_score = info->score_callback(capabilities, info->user_data);
+
+        if (user_score < 0)
+            return -1;
+
+        score += user_score;
+    }
+
+    return score;
+}
+
+
+static bool zvar_is_preferred_physical_device(const zvar_device_selection_info_t *info, const zvar_device_capabilities_t *capabilities)
+{
+    if (info->preferred_uuid) {
+        static const uint8_t unknown_uuid[VK_UUID_SIZE];
+
+        if (memcmp(capabilities->device_uuid, unknown_uuid, VK_UUID_SIZE) != 0
+         && memcmp(capabilities->device_uuid, info->preferred_uuid, VK_UUID_SIZE) == 0)
+            return true;
+    }
+
+    if (info->preferred_name && info->preferred_name[0]) {
+        if (strstr(capabilities->properties.deviceName, info->preferred_name))
+            return true;
+    }
+
+    return false;
+}
+
+
+VkPhysicalDevice zvar_choose_physical_device(const zvar_device_selection_info_t *info)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_CHOOSE_PHYSICAL_DEVICE);
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    uint32_t physical_device_count;
+    ZVAR_CHECK(vkEnumeratePhysicalDevices(info->instance, &physical_device_count, NULL));
+    VkPhysicalDevice *physical_devices = zvar_get_scratch(physical_device_count * sizeof(VkPhysicalDevice));
+    ZVAR_CHECK(vkEnumeratePhysicalDevices(info->instance, &physical_device_count, physical_devices));
+
+    VkPhysicalDevice best_device = VK_NULL_HANDLE;
+    int64_t best_score = -1;
+
+    for (uint32_t i = 0; i < physical_device_count; ++i) {
+        int64_t score = zvar_score_physical_device(info, physical_devices[i]);
+
+        if (score < 0)
+            continue;
+
+        if (zvar_is_preferred_physical_device(info, zvar_get_device_capabilities(physical_devices[i]))) {
+            best_device = physical_devices[i];
+            break;
+        }
+
+        if (score > best_score) {
+            best_device = physical_devices[i];
+            best_score = score;
+        }
+    }
+
+    zvar_restore_scratch(scratch_mark);
+
+    zvar_instrument_end(ZVAR_COUNTER_CHOOSE_PHYSICAL_DEVICE);
+    return best_device;
+}
+
+
+/* descriptor allocator */
+
+#define ZVAR_MAX_DESCRIPTOR_POOL_SETS 4096
+
+void zvar_create_descriptor_allocator(const zvar_descriptor_allocator_create_info_t *info, zvar_descriptor_allocator_t *allocator)
+{
+    const zvar_descriptor_pool_ratio_t *ratios = info->ratios;
+    uint32_t ratio_count = info->ratio_count;
+
+    if (!ratio_count) {
+        ratios = default_descriptor_pool_ratios;
+        ratio_count = lengthof(default_descriptor_pool_ratios);
+    }
+
+    if (ratio_count > ZVAR_MAX_DESCRIPTOR_POOL_SIZES) {
+        fprintf(stderr, "Too many descriptor pool sizes!\n");
+        exit(1);
+    }
+
+    *allocator = (zvar_descriptor_allocator_t) {
+        .device = info->device,
+        .ratio_count = ratio_count,
+        .sets_per_pool = info->sets_per_pool ? info->sets_per_pool : 64,
+        .frame_count = info->frame_count ? info->frame_count : 2,
+    };
+
+    memcpy(allocator->ratios, ratios, ratio_count * sizeof(zvar_descriptor_pool_ratio_t));
+
+    allocator->frames = zvar_realloc(NULL, allocator->frame_count * sizeof(zvar_descriptor_frame_t));
+    memset(allocator->frames, 0, allocator->frame_count * sizeof(zvar_descriptor_frame_t));
+}
+
+
+void zvar_destroy_descriptor_allocator(zvar_descriptor_allocator_t *allocator)
+{
+    for (uint32_t i = 0; i < allocator->frame_count; ++i) {
+        zvar_descriptor_frame_t *frame = allocator->frames + i;
+
+        for (uint32_t j = 0; j < frame->ready_count; ++j) {
+            zvar_vk(allocator->device, vkDestroyDescriptorPool)(allocator->device, frame->ready[j], zvar_get_device_allocation_callbacks(allocator->device));
+        }
+
+        for (uint32_t j = 0; j < frame->full_count; ++j) {
+            zvar_vk(allocator->device, vkDestroyDescriptorPool)(allocator->device, frame->full[j], zvar_get_device_allocation_callbacks(allocator->device));
+        }
+
+        free(frame->ready);
+        free(frame->full);
+    }
+
+    free(allocator->frames);
+
+    *allocator = (zvar_descriptor_allocator_t) {0};
+}
+
+
+static VkDescriptorPool zvar_create_descriptor_pool(zvar_descriptor_allocator_t *allocator)
+{
+    uint32_t set_count = allocator->sets_per_pool;
+
+    VkDescriptorPoolSize pool_sizes[ZVAR_MAX_DESCRIPTOR_POOL_SIZES];
+
+    for (uint32_t i = 0; i < allocator->ratio_count; ++i) {
+        uint32_t descriptor_count = (uint32_t)(allocator->ratios[i].per_set * (float)set_count);
+
+        pool_sizes[i] = (VkDescriptorPoolSize) {
+            .type = allocator->ratios[i].type,
+            .descriptorCount = descriptor_count ? descriptor_count : 1,
+        };
+    }
+
+    VkDescriptorPoolCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = set_count,
+        .poolSizeCount = allocator->ratio_count,
+        .pPoolSizes = pool_sizes,
+    };
+
+    VkDescriptorPool pool;
+    ZVAR_CHECK(zvar_vk(allocator->device, vkCreateDescriptorPool)(allocator->device, &create_info, zvar_get_device_allocation_callbacks(allocator->device), &pool));
+
+    allocator->pool_count++;
+
+    // NOTE: A frame that outgrew its first pool likely keeps doing so, fewer bigger pools are cheaper to reset.
+    set_count += set_count / 2;
+    allocator->sets_per_pool = set_count < ZVAR_MAX_DESCRIPTOR_POOL_SETS ? set_count : ZVAR_MAX_DESCRIPTOR_POOL_SETS;
+
+    return pool;
+}
+
+
+void zvar_begin_descriptor_frame(zvar_descriptor_allocator_t *allocator)
+{
+    allocator->frame_index = (allocator->frame_index + 1) % allocator->frame_count;
+
+    zvar_descriptor_frame_t *frame = allocator->frames + allocator->frame_index;
+
+    // NOTE: Only the last ready pool and the full ones have sets in them, the ready ones below it haven't been touched.
+    if (frame->ready_count) {
+        ZVAR_CHECK(zvar_vk(allocator->device, vkResetDescriptorPool)(allocator->device, frame->ready[frame->ready_count - 1], 0));
+    }
+
+    for (uint32_t i = 0; i < frame->full_count; ++i) {
+        ZVAR_CHECK(zvar_vk(allocator->device, vkResetDescriptorPool)(allocator->device, frame->full[i], 0));
+        zvar_array_push(frame->ready, frame->ready_count, frame->ready_capacity, frame->full[i]);
+    }
+
+    frame->full_count = 0;
+}
+
+
+VkDescriptorSet zvar_allocate_descriptor_set(zvar_descriptor_allocator_t *allocator, VkDescriptorSetLayout layout, uint32_t variable_count)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_ALLOCATE_DESCRIPTOR_SET);
+
+    zvar_descriptor_frame_t *frame = allocator->frames + allocator->frame_index;
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variable_count_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+        .descriptorSetCount = 1,
+        .pDescriptorCounts = &variable_count,
+    };
+
+    VkDescriptorSetAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = variable_count ? &variable_count_info : NULL,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+
+    VkDescriptorSet set;
+
+    for (;;) {
+        bool created = false;
+
+        if (!frame->ready_count) {
+            VkDescriptorPool pool = zvar_create_descriptor_pool(allocator);
+            zvar_array_push(frame->ready, frame->ready_count, frame->ready_capacity, pool);
+            created = true;
+        }
+
+        allocate_info.descriptorPool = frame->ready[frame->ready_count - 1];
+
+        VkResult res = zvar_vk(allocator->device, vkAllocateDescriptorSets)(allocator->device, &allocate_info, &set);
+
+        if (res == VK_SUCCESS)
+            break;
+
+        if (res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL) {
+            ZVAR_CHECK(res);
+        }
+
+        // NOTE: Retrying would only keep creating pools.
+        if (created) {
+            fprintf(stderr, "Descriptor set doesn't fit in an empty pool!\n");
+            exit(1);
+        }
+
+        zvar_array_push(frame->full, frame->full_count, frame->full_capacity, frame->ready[--frame->ready_count]);
+    }
+
+    allocator->allocated_count++;
+
+    zvar_instrument_end(ZVAR_COUNTER_ALLOCATE_DESCRIPTOR_SET);
+    return set;
+}
+
+
+/* bindless descriptor table */
+
+bool zvar_create_bindless_table(const zvar_bindless_create_info_t *info, zvar_bindless_table_t *table)
+{
+    const zvar_device_capabilities_t *capabilities = zvar_get_device_capabilities(info->physical_device);
+
+    PFN_vkGetPhysicalDeviceProperties2 get_properties = zvar_get_properties2_function(info->physical_device, capabilities->properties.apiVersion);
+
+    if (!get_properties)
+        return false;
+
+    VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES,
+    };
+
+    VkPhysicalDeviceProperties2 properties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &indexing_properties,
+    };
+
+    get_properties(info->physical_device, &properties2);
+
+    // NOTE: Left at zero when neither Vulkan 1.2 nor the extension is there to fill them in.
+    uint32_t limits[ZVAR_BINDLESS_BINDING_COUNT] = {
+        indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+        indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+        indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+    };
+
+    uint32_t stage_limits[ZVAR_BINDLESS_BINDING_COUNT] = {
+        indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+        indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+    };
+
+    uint32_t capacities[ZVAR_BINDLESS_BINDING_COUNT];
+
+    for (uint32_t i = 0; i < ZVAR_BINDLESS_BINDING_COUNT; ++i) {
+        capacities[i] = info->capacities[i] ? info->capacities[i] : default_bindless_capacities[i];
+
+        if (capacities[i] > limits[i]) {
+            capacities[i] = limits[i];
+        }
+
+        if (capacities[i] > stage_limits[i]) {
+            capacities[i] = stage_limits[i];
+        }
+
+        if (!capacities[i])
+            return false;
+    }
+
+    // NOTE: Images and buffers also share a per stage budget, samplers don't count against it.
+    uint32_t resource_limit = indexing_properties.maxPerStageUpdateAfterBindResources;
+    uint64_t resource_count = (uint64_t)capacities[ZVAR_BINDLESS_SAMPLED_IMAGE] + capacities[ZVAR_BINDLESS_STORAGE_BUFFER];
+
+    if (resource_count > resource_limit) {
+        capacities[ZVAR_BINDLESS_SAMPLED_IMAGE] = (uint32_t)((uint64_t)capacities[ZVAR_BINDLESS_SAMPLED_IMAGE] * resource_limit / resource_count);
+        capacities[ZVAR_BINDLESS_STORAGE_BUFFER] = resource_limit - capacities[ZVAR_BINDLESS_SAMPLED_IMAGE];
+
+        if (!capacities[ZVAR_BINDLESS_SAMPLED_IMAGE] || !capacities[ZVAR_BINDLESS_STORAGE_BUFFER])
+            return false;
+    }
+
+    VkShaderStageFlags stage_flags = info->stage_flags ? info->stage_flags : VK_SHADER_STAGE_ALL;
+
+    VkDescriptorSetLayoutBinding bindings[ZVAR_BINDLESS_BINDING_COUNT];
+    VkDescriptorBindingFlags binding_flags[ZVAR_BINDLESS_BINDING_COUNT];
+    VkDescriptorPoolSize pool_sizes[ZVAR_BINDLESS_BINDING_COUNT];
+
+    *table = (zvar_bindless_table_t) {
+        .device = info->device,
+    };
+
+    for (uint32_t i = 0; i < ZVAR_BINDLESS_BINDING_COUNT; ++i) {
+        table->slots[i].capacity = capacities[i];
+
+        bindings[i] = (VkDescriptorSetLayoutBinding) {
+            .binding = i,
+            .descriptorType = bindless_descriptor_types[i],
+            .descriptorCount = capacities[i],
+            .stageFlags = stage_flags,
+        };
+
+        // NOTE: Holes are fine and slots nobody is using can be written while the set is bound.
+        binding_flags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+                         | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+                         | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+        pool_sizes[i] = (VkDescriptorPoolSize) {
+            .type = bindless_descriptor_types[i],
+            .descriptorCount = capacities[i],
+        };
+    }
+
+    // create layout
+    {
+        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .bindingCount = ZVAR_BINDLESS_BINDING_COUNT,
+            .pBindingFlags = binding_flags,
+        };
+
+        VkDescriptorSetLayoutCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = &binding_flags_info,
+            .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+            .bindingCount = ZVAR_BINDLESS_BINDING_COUNT,
+            .pBindings = bindings,
+        };
+
+        ZVAR_CHECK(zvar_vk(info->device, vkCreateDescriptorSetLayout)(info->device, &create_info, zvar_get_device_allocation_callbacks(info->device), &table->layout));
+    }
+
+    // create pool
+    {
+        VkDescriptorPoolCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+            .maxSets = 1,
+            .poolSizeCount = ZVAR_BINDLESS_BINDING_COUNT,
+            .pPoolSizes = pool_sizes,
+        };
+
+        ZVAR_CHECK(zvar_vk(info->device, vkCreateDescriptorPool)(info->device, &create_info, zvar_get_device_allocation_callbacks(info->device), &table->pool));
+    }
+
+    // allocate set
+    {
+        VkDescriptorSetAllocateInfo allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = table->pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &table->layout,
+        };
+
+        ZVAR_CHECK(zvar_vk(info->device, vkAllocateDescriptorSets)(info->device, &allocate_info, &table->set));
+    }
+
+    return true;
+}
+
+
+void zvar_destroy_bindless_table(zvar_bindless_table_t *table)
+{
+    zvar_vk(table->device, vkDestroyDescriptorPool)(table->device, table->pool, zvar_get_device_allocation_callbacks(table->device));
+    zvar_vk(table->device, vkDestroyDescriptorSetLayout)(table->device, table->layout, zvar_get_device_allocation_callbacks(table->device));
+
+    for (uint32_t i = 0; i < ZVAR_BINDLESS_BINDING_COUNT; ++i) {
+        free(table->slots[i].free);
+    }
+
+    free(table->writes);
+
+    *table = (zvar_bindless_table_t) {0};
+}
+
+
+/* Reuses removed indices first so the arrays stay dense. */
+static uint32_t zvar_acquire_bindless_index(zvar_bindless_table_t *table, zvar_bindless_binding_t binding)
+{
+    zvar_bindless_slots_t *slots = table->slots + binding;
+
+    if (slots->free_count)
+        return slots->free[--slots->free_count];
+
+    if (slots->used_count < slots->capacity)
+        return slots->used_count++;
+
+    return ZVAR_NO_INDEX;
+}
+
+
+uint32_t zvar_add_bindless_image(zvar_bindless_table_t *table, VkImageView view, VkImageLayout layout)
+{
+    uint32_t index = zvar_acquire_bindless_index(table, ZVAR_BINDLESS_SAMPLED_IMAGE);
+
+    if (index == ZVAR_NO_INDEX)
+        return ZVAR_NO_INDEX;
+
+    zvar_bindless_write_t write = {
+        .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        .binding = ZVAR_BINDLESS_SAMPLED_IMAGE,
+        .index = index,
+        .image = {
+            .imageView = view,
+            .imageLayout = layout,
+        },
+    };
+
+    zvar_array_push(table->writes, table->write_count, table->write_capacity, write);
+
+    return index;
+}
+
+
+uint32_t zvar_add_bindless_buffer(zvar_bindless_table_t *table, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    uint32_t index = zvar_acquire_bindless_index(table, ZVAR_BINDLESS_STORAGE_BUFFER);
+
+    if (index == ZVAR_NO_INDEX)
+        return ZVAR_NO_INDEX;
+
+    zvar_bindless_write_t write = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .binding = ZVAR_BINDLESS_STORAGE_BUFFER,
+        .index = index,
+        .buffer = {
+            .buffer = buffer,
+            .offset = offset,
+            .range = range,
+        },
+    };
+
+    zvar_array_push(table->writes, table->write_count, table->write_capacity, write);
+
+    return index;
+}
+
+
+uint32_t zvar_add_bindless_sampler(zvar_bindless_table_t *table, VkSampler sampler)
+{
+    uint32_t index = zvar_acquire_bindless_index(table, ZVAR_BINDLESS_SAMPLER);
+
+    if (index == ZVAR_NO_INDEX)
+        return ZVAR_NO_INDEX;
+
+    zvar_bindless_write_t write = {
+        .type = VK_DESCRIPTOR_TYPE_SAMPLER,
+        .binding = ZVAR_BINDLESS_SAMPLER,
+        .index = index,
+        .image = {
+            .sampler = sampler,
+        },
+    };
+
+    zvar_array_push(table->writes, table->write_count, table->write_capacity, write);
+
+    return index;
+}
+
+
+void zvar_remove_bindless(zvar_bindless_table_t *table, zvar_bindless_binding_t binding, uint32_t index)
+{
+    zvar_bindless_slots_t *slots = table->slots + binding;
+
+    // NOTE: The stale descriptor stays in the set, partially bound lets it sit there until the index is written again.
+    zvar_array_push(slots->free, slots->free_count, slots->free_capacity, index);
+}
+
+
+void zvar_flush_bindless_writes(zvar_bindless_table_t *table)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_FLUSH_BINDLESS_WRITES);
+
+    if (!table->write_count) {
+        zvar_instrument_end(ZVAR_COUNTER_FLUSH_BINDLESS_WRITES);
+        return;
+    }
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    VkWriteDescriptorSet *writes = zvar_get_scratch(table->write_count * sizeof(VkWriteDescriptorSet));
+
+    for (uint32_t i = 0; i < table->write_count; ++i) {
+        const zvar_bindless_write_t *write = table->writes + i;
+
+        writes[i] = (VkWriteDescriptorSet) {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = table->set,
+            .dstBinding = write->binding,
+            .dstArrayElement = write->index,
+            .descriptorCount = 1,
+            .descriptorType = write->type,
+            .pImageInfo = write->type != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ? &write->image : NULL,
+            .pBufferInfo = write->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ? &write->buffer : NULL,
+        };
+    }
+
+    // NOTE: Applied in order, so a removed and re-added index ends up with the last write.
+    zvar_vk(table->device, vkUpdateDescriptorSets)(table->device, table->write_count, writes, 0, NULL);
+
+    table->write_count = 0;
+
+    zvar_restore_scratch(scratch_mark);
+
+    zvar_instrument_end(ZVAR_COUNTER_FLUSH_BINDLESS_WRITES);
+}
+
+
+void zvar_bind_bindless_table(zvar_bindless_table_t *table, VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index)
+{
+    zvar_vk(command_buffer, vkCmdBindDescriptorSets)(command_buffer, bind_point, pipeline_layout, set_index, 1, &table->set, 0, NULL);
+}
+
+
+/* barrier tracker */
+
+#define ZVAR_ACCESS_2_WRITE_MASK (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT \
+                                | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT)
+
+typedef struct
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+} zvar_barrier_source_t;
+
+
+void zvar_create_barrier_tracker(zvar_barrier_tracker_t *tracker)
+{
+    // NOTE: Tracked states start at batch zero, so nothing counts as queued.
+    *tracker = (zvar_barrier_tracker_t) {
+        .batch = 1,
+    };
+}
+
+
+void zvar_destroy_barrier_tracker(zvar_barrier_tracker_t *tracker)
+{
+    free(tracker->image_barriers);
+    free(tracker->buffer_barriers);
+
+    *tracker = (zvar_barrier_tracker_t) {0};
+}
+
+
+void zvar_track_image(zvar_tracked_image_t *tracked, VkImage image, VkImageAspectFlags aspect, uint32_t mip_level_count, uint32_t array_layer_count, VkImageLayout layout)
+{
+    *tracked = (zvar_tracked_image_t) {
+        .image = image,
+        .aspect = aspect,
+        .mip_level_count = mip_level_count,
+        .array_layer_count = array_layer_count,
+    };
+
+    uint32_t count = mip_level_count * array_layer_count;
+
+    tracked->states = count == 1 ? &tracked->state : zvar_realloc(NULL, count * sizeof(zvar_resource_state_t));
+
+    for (uint32_t i = 0; i < count; ++i) {
+        tracked->states[i] = (zvar_resource_state_t) {
+            .layout = layout,
+        };
+    }
+}
+
+
+void zvar_free_tracked_image(zvar_tracked_image_t *tracked)
+{
+    if (tracked->states != &tracked->state) {
+        free(tracked->states);
+    }
+
+    *tracked = (zvar_tracked_image_t) {0};
+}
+
+
+void zvar_track_buffer(zvar_tracked_buffer_t *tracked, VkBuffer buffer)
+{
+    *tracked = (zvar_tracked_buffer_t) {
+        .buffer = buffer,
+    };
+}
+
+
+/* Moves `state` past the use, returns false when it needs no barrier. */
+static bool zvar_apply_resource_use(zvar_resource_state_t *state, const zvar_resource_use_t *use, bool has_layout, zvar_barrier_source_t *source)
+{
+    VkImageLayout layout = has_layout ? use->layout : state->layout;
+    VkAccessFlags2 write_access = use->access & ZVAR_ACCESS_2_WRITE_MASK;
+
+    bool transition = layout != state->layout;
+
+    *source = (zvar_barrier_source_t) {
+        .layout = state->layout,
+    };
+
+    // NOTE: A layout transition writes too, so it waits for everything before just like a write.
+    if (write_access || transition) {
+        // NOTE: Reads only need execution order, only the write has to be made available.
+        source->stages = state->write_stages | state->read_stages;
+        source->access = state->write_access;
+
+        bool needed = transition || source->stages;
+
+        state->layout = layout;
+        state->write_stages = use->stages;
+        state->write_access = write_access;
+
+        if (write_access) {
+            state->read_stages = 0;
+            state->visible_stages = 0;
+            state->visible_access = 0;
         }
-        else if (present_mode_prefs == ZVAR_NOSYNC_DEFAULT_PRESENT_MODE) {
-            present_mode_pref_count = lengthof(default_nosync_present_mode_prefs);
-            present_mode_prefs      = default_nosync_present_mode_prefs;
+        else {
+            // NOTE: A read right behind a transition, the barrier makes the transition visible to it.
+            state->read_stages = use->stages;
+            state->visible_stages = use->stages;
+            state->visible_access = use->access;
+        }
+
+        return needed;
+    }
+
+    state->read_stages |= use->stages;
+
+    // NOTE: Nothing written yet, or earlier reads already got the write made visible to them.
+    if (!state->write_stages && !state->write_access)
+        return false;
+
+    if (!(use->stages & ~state->visible_stages) && !(use->access & ~state->visible_access))
+        return false;
+
+    source->stages = state->write_stages;
+    source->access = state->write_access;
+
+    state->visible_stages |= use->stages;
+    state->visible_access |= use->access;
+
+    return true;
+}
+
+
+/* Folds the last queued barrier into the one before when they cover the same layers of neighbouring mips. */
+static void zvar_merge_image_barrier(zvar_barrier_tracker_t *tracker)
+{
+    if (tracker->image_barrier_count < 2)
+        return;
+
+    VkImageMemoryBarrier2 *prev = tracker->image_barriers + tracker->image_barrier_count - 2;
+    VkImageMemoryBarrier2 *last = tracker->image_barriers + tracker->image_barrier_count - 1;
+
+    if (prev->image != last->image
+     || prev->srcStageMask != last->srcStageMask || prev->srcAccessMask != last->srcAccessMask
+     || prev->dstStageMask != last->dstStageMask || prev->dstAccessMask != last->dstAccessMask
+     || prev->oldLayout != last->oldLayout || prev->newLayout != last->newLayout)
+        return;
+
+    const VkImageSubresourceRange *prev_range = &prev->subresourceRange;
+    const VkImageSubresourceRange *last_range = &last->subresourceRange;
+
+    if (prev_range->baseArrayLayer != last_range->baseArrayLayer || prev_range->layerCount != last_range->layerCount
+     || prev_range->baseMipLevel + prev_range->levelCount != last_range->baseMipLevel)
+        return;
+
+    prev->subresourceRange.levelCount += last_range->levelCount;
+    tracker->image_barrier_count--;
+}
+
+
+void zvar_use_image(zvar_barrier_tracker_t *tracker, VkCommandBuffer command_buffer, zvar_tracked_image_t *tracked, const VkImageSubresourceRange *range, const zvar_resource_use_t *use)
+{
+    uint32_t level_count = range->levelCount == VK_REMAINING_MIP_LEVELS ? tracked->mip_level_count - range->baseMipLevel : range->levelCount;
+    uint32_t layer_count = range->layerCount == VK_REMAINING_ARRAY_LAYERS ? tracked->array_layer_count - range->baseArrayLayer : range->layerCount;
+
+    for (uint32_t mip = range->baseMipLevel; mip < range->baseMipLevel + level_count; ++mip) {
+        for (uint32_t layer = range->baseArrayLayer; layer < range->baseArrayLayer + layer_count; ++layer) {
+            zvar_resource_state_t *state = tracked->states + mip * tracked->array_layer_count + layer;
+
+            // NOTE: Barriers in one call aren't ordered among each other, a second one for the same subresource has to come after.
+            if (state->batch == tracker->batch) {
+                zvar_flush_barriers(tracker, command_buffer);
+            }
+
+            zvar_barrier_source_t source;
+
+            if (!zvar_apply_resource_use(state, use, true, &source))
+                continue;
+
+            state->batch = tracker->batch;
+
+            // extend the run of layers queued last
+            if (tracker->image_barrier_count) {
+                VkImageMemoryBarrier2 *last = tracker->image_barriers + tracker->image_barrier_count - 1;
+                VkImageSubresourceRange *last_range = &last->subresourceRange;
+
+                if (last->image == tracked->image && last->srcStageMask == source.stages && last->srcAccessMask == source.access
+                 && last->dstStageMask == use->stages && last->dstAccessMask == use->access
+                 && last->oldLayout == source.layout && last->newLayout == state->layout
+                 && last_range->baseMipLevel == mip && last_range->levelCount == 1
+                 && last_range->baseArrayLayer + last_range->layerCount == layer)
+                {
+                    last_range->layerCount++;
+                    continue;
+                }
+            }
+
+            VkImageMemoryBarrier2 barrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .srcStageMask = source.stages,
+                .srcAccessMask = source.access,
+                .dstStageMask = use->stages,
+                .dstAccessMask = use->access,
+                .oldLayout = source.layout,
+                .newLayout = state->layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = tracked->image,
+                .subresourceRange = {
+                    .aspectMask = tracked->aspect,
+                    .baseMipLevel = mip,
+                    .levelCount = 1,
+                    .baseArrayLayer = layer,
+                    .layerCount = 1,
+                },
+            };
+
+            zvar_array_push(tracker->image_barriers, tracker->image_barrier_count, tracker->image_barrier_capacity, barrier);
+        }
+
+        zvar_merge_image_barrier(tracker);
+    }
+}
+
+
+void zvar_use_buffer(zvar_barrier_tracker_t *tracker, VkCommandBuffer command_buffer, zvar_tracked_buffer_t *tracked, const zvar_resource_use_t *use)
+{
+    if (tracked->state.batch == tracker->batch) {
+        zvar_flush_barriers(tracker, command_buffer);
+    }
+
+    zvar_barrier_source_t source;
+
+    if (!zvar_apply_resource_use(&tracked->state, use, false, &source))
+        return;
+
+    tracked->state.batch = tracker->batch;
+
+    VkBufferMemoryBarrier2 barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = source.stages,
+        .srcAccessMask = source.access,
+        .dstStageMask = use->stages,
+        .dstAccessMask = use->access,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = tracked->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    zvar_array_push(tracker->buffer_barriers, tracker->buffer_barrier_count, tracker->buffer_barrier_capacity, barrier);
+}
+
+
+void zvar_flush_barriers(zvar_barrier_tracker_t *tracker, VkCommandBuffer command_buffer)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_FLUSH_BARRIERS);
+
+    if (!tracker->image_barrier_count && !tracker->buffer_barrier_count) {
+        zvar_instrument_end(ZVAR_COUNTER_FLUSH_BARRIERS);
+        return;
+    }
+
+    VkDependencyInfo dependency_info = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = tracker->buffer_barrier_count,
+        .pBufferMemoryBarriers = tracker->buffer_barriers,
+        .imageMemoryBarrierCount = tracker->image_barrier_count,
+        .pImageMemoryBarriers = tracker->image_barriers,
+    };
+
+    // NOTE: The core entry point is there on any 1.3 device, the feature has to be turned on all the same.
+    assert(zvar_find_device_record(command_buffer)->synchronization2);
+
+    // NOTE: The extension's entry point is only there when it got enabled, the core one otherwise.
+    const VolkDeviceTable *table = zvar_get_device_table(command_buffer);
+    PFN_vkCmdPipelineBarrier2 pipeline_barrier = table->vkCmdPipelineBarrier2KHR ? table->vkCmdPipelineBarrier2KHR : table->vkCmdPipelineBarrier2;
+
+    pipeline_barrier(command_buffer, &dependency_info);
+
+    tracker->barrier_count += tracker->image_barrier_count + tracker->buffer_barrier_count;
+    tracker->flush_count++;
+
+    tracker->image_barrier_count = 0;
+    tracker->buffer_barrier_count = 0;
+    tracker->batch++;
+
+    zvar_instrument_end(ZVAR_COUNTER_FLUSH_BARRIERS);
+}
+
+
+/* frame graph */
+
+static VkImageAspectFlags zvar_get_format_aspect(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+
+/* Shader reads in the general layout are taken as storage, in any other as sampled. */
+static VkImageUsageFlags zvar_get_use_image_usage(const zvar_resource_use_t *use)
+{
+    VkAccessFlags2 access = use->access;
+    VkImageUsageFlags usage = 0;
+
+    if (access & (VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT)) {
+        usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    }
+
+    if (access & (VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)) {
+        usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    }
+
+    if (access & VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT) {
+        usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    }
+
+    if (access & VK_ACCESS_2_SHADER_SAMPLED_READ_BIT) {
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+
+    if (access & (VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT)) {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    if (access & VK_ACCESS_2_SHADER_READ_BIT) {
+        usage |= use->layout == VK_IMAGE_LAYOUT_GENERAL ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+
+    if (access & VK_ACCESS_2_TRANSFER_READ_BIT) {
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+
+    if (access & VK_ACCESS_2_TRANSFER_WRITE_BIT) {
+        usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    return usage;
+}
+
+
+void zvar_create_frame_graph(const zvar_frame_graph_create_info_t *info, zvar_frame_graph_t *graph)
+{
+    *graph = (zvar_frame_graph_t) {
+        .device = info->device,
+        .physical_device_memory_properties = info->physical_device_memory_properties,
+    };
+
+    zvar_create_barrier_tracker(&graph->tracker);
+}
+
+
+void zvar_destroy_frame_graph(zvar_frame_graph_t *graph)
+{
+    for (uint32_t i = 0; i < graph->resource_count; ++i) {
+        zvar_graph_resource_t *resource = graph->resources + i;
+
+        if (!resource->is_buffer) {
+            if (!resource->imported && resource->image != VK_NULL_HANDLE) {
+                zvar_vk(graph->device, vkDestroyImageView)(graph->device, resource->view, zvar_get_device_allocation_callbacks(graph->device));
+                zvar_vk(graph->device, vkDestroyImage)(graph->device, resource->image, zvar_get_device_allocation_callbacks(graph->device));
+            }
+
+            zvar_free_tracked_image(&resource->tracked_image);
+        }
+
+        free(resource->overlaps);
+    }
+
+    for (uint32_t i = 0; i < graph->memory_count; ++i) {
+        zvar_vk(graph->device, vkFreeMemory)(graph->device, graph->memories[i], zvar_get_device_allocation_callbacks(graph->device));
+    }
+
+    free(graph->passes);
+    free(graph->resources);
+    free(graph->order);
+    free(graph->batches);
+    free(graph->transfers);
+    free(graph->memories);
+
+    zvar_destroy_barrier_tracker(&graph->tracker);
+
+    *graph = (zvar_frame_graph_t) {0};
+}
+
+
+static uint32_t zvar_add_graph_resource(zvar_frame_graph_t *graph, const zvar_graph_resource_t *resource)
+{
+    // NOTE: Tracked images point into themselves, the array must not move once they are tracked.
+    assert(!graph->compiled);
+
+    zvar_array_push(graph->resources, graph->resource_count, graph->resource_capacity, *resource);
+
+    return graph->resource_count - 1;
+}
+
+
+uint32_t zvar_add_graph_image(zvar_frame_graph_t *graph, const zvar_graph_image_info_t *info)
+{
+    zvar_graph_resource_t resource = {
+        .image_info = *info,
+        .aspect = zvar_get_format_aspect(info->format),
+        .initial_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .queue_family_index = VK_QUEUE_FAMILY_IGNORED,
+    };
+
+    return zvar_add_graph_resource(graph, &resource);
+}
+
+
+uint32_t zvar_import_graph_image(zvar_frame_graph_t *graph, VkImage image, VkImageView view, VkImageAspectFlags aspect, VkImageLayout layout, const zvar_resource_use_t *final_use)
+{
+    zvar_graph_resource_t resource = {
+        .imported = true,
+        .aspect = aspect,
+        .initial_layout = layout,
+        .image = image,
+        .view = view,
+        .has_final_use = final_use != NULL,
+        .final_use = final_use ? *final_use : (zvar_resource_use_t) {0},
+        .queue_family_index = VK_QUEUE_FAMILY_IGNORED,
+    };
+
+    return zvar_add_graph_resource(graph, &resource);
+}
+
+
+uint32_t zvar_import_graph_buffer(zvar_frame_graph_t *graph, VkBuffer buffer, const zvar_resource_use_t *final_use)
+{
+    zvar_graph_resource_t resource = {
+        .imported = true,
+        .is_buffer = true,
+        .buffer = buffer,
+        .has_final_use = final_use != NULL,
+        .final_use = final_use ? *final_use : (zvar_resource_use_t) {0},
+        .queue_family_index = VK_QUEUE_FAMILY_IGNORED,
+    };
+
+    return zvar_add_graph_resource(graph, &resource);
+}
+
+
+void zvar_set_graph_image(zvar_frame_graph_t *graph, uint32_t resource_index, VkImage image, VkImageView view, VkImageLayout layout)
+{
+    zvar_graph_resource_t *resource = graph->resources + resource_index;
+
+    resource->image = image;
+    resource->view = view;
+    resource->initial_layout = layout;
+
+    if (graph->compiled) {
+        zvar_free_tracked_image(&resource->tracked_image);
+        zvar_track_image(&resource->tracked_image, image, resource->aspect, 1, 1, layout);
+    }
+}
+
+
+uint32_t zvar_add_graph_pass(zvar_frame_graph_t *graph, const zvar_graph_pass_t *pass)
+{
+    assert(!graph->compiled && pass->access_count <= ZVAR_GRAPH_MAX_PASS_ACCESSES);
+
+    zvar_array_push(graph->passes, graph->pass_count, graph->pass_capacity, *pass);
+
+    return graph->pass_count - 1;
+}
+
+
+/* Lowest offset where `resource` overlaps no image of its memory that is alive at the same time. */
+static VkDeviceSize zvar_place_graph_image(zvar_frame_graph_t *graph, const zvar_graph_resource_t *resource, uint32_t placed_count, const uint32_t *placed)
+{
+    VkDeviceSize size = resource->memory_requirements.size;
+    VkDeviceSize alignment = resource->memory_requirements.alignment;
+
+    VkDeviceSize best_offset = ~(VkDeviceSize)0;
+
+    // NOTE: The best spot starts at zero or right behind one of the images in the way.
+    for (uint32_t c = 0; c <= placed_count; ++c) {
+        VkDeviceSize offset = 0;
+
+        if (c < placed_count) {
+            const zvar_graph_resource_t *other = graph->resources + placed[c];
+
+            if (other->memory_index != resource->memory_index || other->last_use < resource->first_use || other->first_use > resource->last_use)
+                continue;
+
+            offset = zvar_align_up(other->memory_offset + other->memory_requirements.size, alignment);
         }
 
-        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        if (offset >= best_offset)
+            continue;
 
-        for (uint32_t pi = 0; pi < present_mode_pref_count; ++pi) {
-            VkPresentModeKHR p = present_mode_prefs[pi];
+        bool fits = true;
 
-            for (uint32_t i = 0; i < present_mode_count; ++i) {
-                if (present_modes[i] == p) {
-                    present_mode = p;
-                    break;
-                }
-            }
+        for (uint32_t i = 0; i < placed_count; ++i) {
+            const zvar_graph_resource_t *other = graph->resources + placed[i];
 
-            if (present_mode == p)
+            if (other->memory_index != resource->memory_index || other->last_use < resource->first_use || other->first_use > resource->last_use)
+                continue;
+
+            if (offset < other->memory_offset + other->memory_requirements.size && other->memory_offset < offset + size) {
+                fits = false;
                 break;
+            }
         }
 
-        VkExtent2D swapchain_extent = surface_capabilities.currentExtent;
+        if (fits) {
+            best_offset = offset;
+        }
+    }
 
-        // In this case width == height.
-        if (surface_capabilities.currentExtent.width == 0xFFFFFFFF) {
-            swapchain_extent = (VkExtent2D) {
-                .width  = *width,
-                .height = *height,
-            };
+    return best_offset;
+}
 
-            if (swapchain_extent.width < surface_capabilities.minImageExtent.width) {
-                swapchain_extent.width = surface_capabilities.minImageExtent.width;
-            }
-            else if (swapchain_extent.width > surface_capabilities.maxImageExtent.width) {
-                swapchain_extent.width = surface_capabilities.maxImageExtent.width;
-            }
 
-            if (swapchain_extent.height < surface_capabilities.minImageExtent.height) {
-                swapchain_extent.height = surface_capabilities.minImageExtent.height;
+void zvar_compile_frame_graph(zvar_frame_graph_t *graph)
+{
+    assert(!graph->compiled);
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    // cull passes
+    {
+        bool *needed_resources = zvar_get_scratch(graph->resource_count * sizeof(bool));
+
+        // NOTE: The outside sees imported resources, so whatever writes them stays.
+        for (uint32_t i = 0; i < graph->resource_count; ++i) {
+            needed_resources[i] = graph->resources[i].imported;
+        }
+
+        bool *needed_passes = zvar_get_scratch(graph->pass_count * sizeof(bool));
+
+        // NOTE: Walks backwards, a pass is needed when a needed pass after it reads what it writes.
+        for (uint32_t i = graph->pass_count; i-- > 0;) {
+            const zvar_graph_pass_t *pass = graph->passes + i;
+
+            bool needed = pass->side_effects;
+
+            for (uint32_t a = 0; a < pass->access_count; ++a) {
+                const zvar_graph_access_t *access = pass->accesses + a;
+
+                if ((access->use.access & ZVAR_ACCESS_2_WRITE_MASK) && needed_resources[access->resource]) {
+                    needed = true;
+                }
             }
-            else if (swapchain_extent.height > surface_capabilities.maxImageExtent.height) {
-                swapchain_extent.height = surface_capabilities.maxImageExtent.height;
+
+            needed_passes[i] = needed;
+
+            if (!needed)
+                continue;
+
+            for (uint32_t a = 0; a < pass->access_count; ++a) {
+                const zvar_graph_access_t *access = pass->accesses + a;
+
+                if (access->use.access & ~ZVAR_ACCESS_2_WRITE_MASK) {
+                    needed_resources[access->resource] = true;
+                }
             }
         }
-        else {
-            *width  = swapchain_extent.width;
-            *height = swapchain_extent.height;
+
+        for (uint32_t i = 0; i < graph->pass_count; ++i) {
+            if (!needed_passes[i])
+                continue;
+
+            uint32_t queue_family_index = graph->passes[i].queue_family_index;
+
+            if (!graph->batch_count || graph->batches[graph->batch_count - 1].queue_family_index != queue_family_index) {
+                zvar_graph_batch_t batch = {
+                    .queue_family_index = queue_family_index,
+                    .first_pass = graph->order_count,
+                };
+
+                zvar_array_push(graph->batches, graph->batch_count, graph->batch_capacity, batch);
+            }
+
+            graph->batches[graph->batch_count - 1].pass_count++;
+
+            zvar_array_push(graph->order, graph->order_count, graph->order_capacity, i);
         }
+    }
 
-        if (surface_capabilities.currentExtent.width == 0 || surface_capabilities.currentExtent.height == 0) {
-            return false;
+    // find lifetimes and ownership transfers
+    {
+        for (uint32_t i = 0; i < graph->resource_count; ++i) {
+            graph->resources[i].first_use = ZVAR_NO_INDEX;
+            graph->resources[i].last_use = ZVAR_NO_INDEX;
         }
 
-        uint32_t swapchain_image_count = info->prefered_image_count;
+        uint32_t *owners = zvar_get_scratch(graph->resource_count * sizeof(uint32_t));
+        uint32_t *owner_batches = zvar_get_scratch(graph->resource_count * sizeof(uint32_t));
 
-        if (swapchain_image_count < surface_capabilities.minImageCount) {
-            swapchain_image_count = surface_capabilities.minImageCount;
+        for (uint32_t i = 0; i < graph->resource_count; ++i) {
+            owners[i] = VK_QUEUE_FAMILY_IGNORED;
         }
 
-        if (surface_capabilities.maxImageCount && swapchain_image_count > surface_capabilities.maxImageCount) {
-            swapchain_image_count = surface_capabilities.maxImageCount;
+        for (uint32_t b = 0; b < graph->batch_count; ++b) {
+            const zvar_graph_batch_t *batch = graph->batches + b;
+
+            for (uint32_t position = batch->first_pass; position < batch->first_pass + batch->pass_count; ++position) {
+                const zvar_graph_pass_t *pass = graph->passes + graph->order[position];
+
+                for (uint32_t a = 0; a < pass->access_count; ++a) {
+                    const zvar_graph_access_t *access = pass->accesses + a;
+                    zvar_graph_resource_t *resource = graph->resources + access->resource;
+
+                    if (resource->first_use == ZVAR_NO_INDEX) {
+                        resource->first_use = position;
+                    }
+
+                    resource->last_use = position;
+
+                    // NOTE: Transient images start out discarded every recording, there is nothing to hand over.
+                    bool discarded = !resource->imported && !resource->is_buffer && resource->first_use == position;
+
+                    if (!discarded && owners[access->resource] != VK_QUEUE_FAMILY_IGNORED && owners[access->resource] != batch->queue_family_index) {
+                        zvar_graph_transfer_t transfer = {
+                            .resource = access->resource,
+                            .src_queue_family_index = owners[access->resource],
+                            .dst_queue_family_index = batch->queue_family_index,
+                            .release_batch = owner_batches[access->resource],
+                            .acquire_pass = position,
+                            .use = access->use,
+                        };
+
+                        zvar_array_push(graph->transfers, graph->transfer_count, graph->transfer_capacity, transfer);
+                    }
+
+                    owners[access->resource] = batch->queue_family_index;
+                    owner_batches[access->resource] = b;
+                }
+            }
         }
+    }
 
-        assert(swapchain_image_count <= info->maximum_image_count);
+    // create transient images and place them
+    {
+        uint32_t placed_count = 0;
+        uint32_t *placed = zvar_get_scratch(graph->resource_count * sizeof(uint32_t));
 
-        *image_count = swapchain_image_count;
+        for (uint32_t i = 0; i < graph->resource_count; ++i) {
+            zvar_graph_resource_t *resource = graph->resources + i;
 
-        VkSurfaceTransformFlagBitsKHR surface_transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+            if (resource->imported || resource->first_use == ZVAR_NO_INDEX)
+                continue;
 
-        if (!(surface_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)) {
-            surface_transform = surface_capabilities.currentTransform;
+            VkImageUsageFlags usage = resource->image_info.usage;
+
+            for (uint32_t position = resource->first_use; position <= resource->last_use; ++position) {
+                const zvar_graph_pass_t *pass = graph->passes + graph->order[position];
+
+                for (uint32_t a = 0; a < pass->access_count; ++a) {
+                    if (pass->accesses[a].resource == i) {
+                        usage |= zvar_get_use_image_usage(&pass->accesses[a].use);
+                    }
+                }
+            }
+
+            const zvar_graph_image_info_t *image_info = &resource->image_info;
+
+            resource->image = zvar_create_2d_image_exclusive(graph->device, image_info->format, image_info->width, image_info->height, 1, usage);
+            resource->memory_requirements = zvar_get_image_memory_requirements(graph->device, resource->image);
+
+            graph->unaliased_size += resource->memory_requirements.size;
+
+            // NOTE: Biggest first, the small ones fill the gaps left behind.
+            uint32_t slot = placed_count++;
+
+            while (slot && graph->resources[placed[slot - 1]].memory_requirements.size < resource->memory_requirements.size) {
+                placed[slot] = placed[slot - 1];
+                slot--;
+            }
+
+            placed[slot] = i;
         }
 
-        uint32_t composite_alpha_pref_count = info->composite_alpha_pref_count;
-        VkCompositeAlphaFlagBitsKHR *composite_alpha_prefs = info->composite_alpha_prefs;
+        uint32_t *memory_type_bits = zvar_get_scratch((placed_count + 1) * sizeof(uint32_t));
+        VkDeviceSize *memory_sizes = zvar_get_scratch((placed_count + 1) * sizeof(VkDeviceSize));
 
-        if (composite_alpha_prefs == NULL) {
-            composite_alpha_pref_count = lengthof(default_composite_alpha_prefs);
-            composite_alpha_prefs      = default_composite_alpha_prefs;
+        for (uint32_t p = 0; p < placed_count; ++p) {
+            zvar_graph_resource_t *resource = graph->resources + placed[p];
+
+            uint32_t memory_index = 0;
+
+            while (memory_index < graph->memory_count && !(memory_type_bits[memory_index] & resource->memory_requirements.memoryTypeBits)) {
+                memory_index++;
+            }
+
+            if (memory_index == graph->memory_count) {
+                memory_type_bits[memory_index] = resource->memory_requirements.memoryTypeBits;
+                memory_sizes[memory_index] = 0;
+                zvar_array_push(graph->memories, graph->memory_count, graph->memory_capacity, VK_NULL_HANDLE);
+            }
+
+            memory_type_bits[memory_index] &= resource->memory_requirements.memoryTypeBits;
+
+            resource->memory_index = memory_index;
+            resource->memory_offset = zvar_place_graph_image(graph, resource, p, placed);
+
+            VkDeviceSize end = resource->memory_offset + resource->memory_requirements.size;
+
+            if (memory_sizes[memory_index] < end) {
+                memory_sizes[memory_index] = end;
+            }
         }
 
-        VkCompositeAlphaFlagBitsKHR composite_alpha = 0;
-        for (uint32_t i = 0; i < composite_alpha_pref_count; ++i) {
-            VkCompositeAlphaFlagBitsKHR ca = composite_alpha_prefs[i];
+        for (uint32_t m = 0; m < graph->memory_count; ++m) {
+            int32_t memory_type = zvar_find_memory_type(graph->physical_device_memory_properties, memory_type_bits[m], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-            if (surface_capabilities.supportedCompositeAlpha & ca) {
-                composite_alpha = ca;
-                break;
+            if (memory_type < 0) {
+                memory_type = zvar_find_memory_type(graph->physical_device_memory_properties, memory_type_bits[m], 0);
             }
+
+            graph->memories[m] = zvar_allocate_memory(graph->device, (uint32_t)memory_type, memory_sizes[m]);
+            graph->aliased_size += memory_sizes[m];
         }
 
-        VkSwapchainCreateInfoKHR swapchain_create_info = {
-            .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-            .surface = info->surface,
-            .minImageCount = swapchain_image_count,
-            .imageFormat = info->surface_format.format,
-            .imageColorSpace = info->surface_format.colorSpace,
-            .imageExtent = swapchain_extent,
-            .imageArrayLayers = 1,
-            .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-            .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .preTransform = surface_transform,
-            .compositeAlpha = composite_alpha,
-            .presentMode = present_mode,
-            .clipped = VK_TRUE,
-            .oldSwapchain = old_swapchain,
-        };
+        for (uint32_t p = 0; p < placed_count; ++p) {
+            zvar_graph_resource_t *resource = graph->resources + placed[p];
 
-        ZVAR_CHECK(vkCreateSwapchainKHR(info->device, &swapchain_create_info, NULL, swapchain));
+            ZVAR_CHECK(zvar_vk(graph->device, vkBindImageMemory)(graph->device, resource->image, graph->memories[resource->memory_index], resource->memory_offset));
 
-        if (old_swapchain != VK_NULL_HANDLE) {
-            vkDestroySwapchainKHR(info->device, old_swapchain, NULL);
+            resource->view = zvar_create_2d_image_view(graph->device, resource->image, resource->image_info.format, resource->aspect, 1);
+
+            for (uint32_t o = 0; o < placed_count; ++o) {
+                const zvar_graph_resource_t *other = graph->resources + placed[o];
+
+                if (other->memory_index != resource->memory_index)
+                    continue;
+
+                if (resource->memory_offset < other->memory_offset + other->memory_requirements.size
+                 && other->memory_offset < resource->memory_offset + resource->memory_requirements.size)
+                {
+                    zvar_array_push(resource->overlaps, resource->overlap_count, resource->overlap_capacity, placed[o]);
+                }
+            }
         }
     }
 
-    // create depth buffer
-    {
-        *depth_image = zvar_create_2d_image_exclusive(info->device, info->depth_format, *width, *height, 1, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    for (uint32_t i = 0; i < graph->resource_count; ++i) {
+        zvar_graph_resource_t *resource = graph->resources + i;
 
-        VkMemoryRequirements depth_memory_requirements = zvar_get_image_memory_requirements(info->device, *depth_image);
+        if (resource->is_buffer) {
+            zvar_track_buffer(&resource->tracked_buffer, resource->buffer);
+        }
+        else {
+            zvar_track_image(&resource->tracked_image, resource->image, resource->aspect, 1, 1, resource->initial_layout);
+        }
+    }
+
+    graph->compiled = true;
 
-        uint32_t depth_memory_type = zvar_find_memory_type(info->physical_device_memory_properties, depth_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    zvar_restore_scratch(scratch_mark);
+}
 
-        // TODO: Reuse the memory when stretching. Also probably preallocate enough memory for the whole screen.
-        *depth_memory = zvar_allocate_memory(info->device, depth_memory_type, depth_memory_requirements.size);
 
-        ZVAR_CHECK(vkBindImageMemory(info->device, *depth_image, *depth_memory, 0));
+/* The contents don't matter, but whatever used the memory last, this image in the previous recording included, has to be done with it. */
+static void zvar_discard_graph_image(zvar_frame_graph_t *graph, zvar_graph_resource_t *resource)
+{
+    VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
 
-        VkImageAspectFlags depth_aspect_flags = VK_IMAGE_ASPECT_DEPTH_BIT | (info->depth_format == VK_FORMAT_D32_SFLOAT ? 0 : VK_IMAGE_ASPECT_STENCIL_BIT);
+    for (uint32_t i = 0; i < resource->overlap_count; ++i) {
+        const zvar_resource_state_t *other = graph->resources[resource->overlaps[i]].tracked_image.states;
 
-        *depth_view = zvar_create_2d_image_view(info->device, *depth_image, info->depth_format, depth_aspect_flags, 1);
+        stages |= other->write_stages | other->read_stages;
+        access |= other->write_access;
     }
 
-    // retrieve swapchain images and create views
-    {
-        VkImage *images = zvar_get_scratch(*image_count * sizeof(VkImage));
+    zvar_resource_state_t *state = resource->tracked_image.states;
+
+    *state = (zvar_resource_state_t) {
+        .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .write_stages = stages,
+        .write_access = access,
+        .batch = state->batch,
+    };
+}
 
-        ZVAR_CHECK(vkGetSwapchainImagesKHR(info->device, *swapchain, image_count, images));
 
-        for (uint32_t i = 0; i < *image_count; ++i) {
-            views[i] = zvar_create_2d_image_view(info->device, images[i], info->surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-        }
+/* Queues one half of an ownership transfer. The release waits for the uses on the old queue,
+ * the acquire blocks the use on the new one and leaves the state as if the use went through the tracker.
+ */
+static void zvar_queue_graph_transfer(zvar_frame_graph_t *graph, VkCommandBuffer command_buffer, const zvar_graph_transfer_t *transfer, bool release)
+{
+    zvar_barrier_tracker_t *tracker = &graph->tracker;
+    zvar_graph_resource_t *resource = graph->resources + transfer->resource;
+    zvar_resource_state_t *state = resource->is_buffer ? &resource->tracked_buffer.state : resource->tracked_image.states;
+    const zvar_resource_use_t *use = &transfer->use;
+
+    if (state->batch == tracker->batch) {
+        zvar_flush_barriers(tracker, command_buffer);
     }
 
-    // create framebuffers
-    {
-        for (uint32_t i = 0; i < *image_count; ++i) {
-            VkFramebufferCreateInfo framebuffer_create_info = {
-                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-                .renderPass = info->render_pass,
-                .attachmentCount = 2,
-                .pAttachments = (VkImageView[2]) {
-                    [0] = views[i],
-                    [1] = *depth_view,
-                },
-                .width  = *width,
-                .height = *height,
-                .layers = 1,
-            };
+    VkPipelineStageFlags2 src_stages = release ? state->write_stages | state->read_stages : VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 src_access = release ? state->write_access : VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 dst_stages = release ? VK_PIPELINE_STAGE_2_NONE : use->stages;
+    VkAccessFlags2 dst_access = release ? VK_ACCESS_2_NONE : use->access;
+
+    if (resource->is_buffer) {
+        VkBufferMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .srcStageMask = src_stages,
+            .srcAccessMask = src_access,
+            .dstStageMask = dst_stages,
+            .dstAccessMask = dst_access,
+            .srcQueueFamilyIndex = transfer->src_queue_family_index,
+            .dstQueueFamilyIndex = transfer->dst_queue_family_index,
+            .buffer = resource->buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
 
+        zvar_array_push(tracker->buffer_barriers, tracker->buffer_barrier_count, tracker->buffer_barrier_capacity, barrier);
+    }
+    else {
+        // NOTE: Both halves do the same layout transition, the state isn't touched in between.
+        VkImageMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = src_stages,
+            .srcAccessMask = src_access,
+            .dstStageMask = dst_stages,
+            .dstAccessMask = dst_access,
+            .oldLayout = state->layout,
+            .newLayout = use->layout,
+            .srcQueueFamilyIndex = transfer->src_queue_family_index,
+            .dstQueueFamilyIndex = transfer->dst_queue_family_index,
+            .image = resource->image,
+            .subresourceRange = {
+                .aspectMask = resource->aspect,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        };
 
-            ZVAR_CHECK(vkCreateFramebuffer(info->device, &framebuffer_create_info, NULL, framebuffers + i));
-        }
+        zvar_array_push(tracker->image_barriers, tracker->image_barrier_count, tracker->image_barrier_capacity, barrier);
     }
 
-    return true;
+    state->batch = tracker->batch;
+
+    if (release)
+        return;
+
+    VkAccessFlags2 write_access = use->access & ZVAR_ACCESS_2_WRITE_MASK;
+
+    state->layout = resource->is_buffer ? state->layout : use->layout;
+    state->write_stages = use->stages;
+    state->write_access = write_access;
+    state->read_stages = write_access ? VK_PIPELINE_STAGE_2_NONE : use->stages;
+    state->visible_stages = write_access ? VK_PIPELINE_STAGE_2_NONE : use->stages;
+    state->visible_access = write_access ? VK_ACCESS_2_NONE : use->access;
+
+    resource->queue_family_index = transfer->dst_queue_family_index;
 }
 
-VkInstance zvar_create_instance(const zvar_instance_create_info_t *info)
+
+void zvar_record_graph_batch(zvar_frame_graph_t *graph, uint32_t batch_index, VkCommandBuffer command_buffer)
 {
-    if (volkInitialize() != VK_SUCCESS) {
-        return VK_NULL_HANDLE;
-    }
+    const zvar_graph_batch_t *batch = graph->batches + batch_index;
+    zvar_barrier_tracker_t *tracker = &graph->tracker;
 
-    // get the version of api
-    {
-        uint32_t api_version = VK_API_VERSION_1_0;
+    for (uint32_t position = batch->first_pass; position < batch->first_pass + batch->pass_count; ++position) {
+        const zvar_graph_pass_t *pass = graph->passes + graph->order[position];
 
-        if (vkEnumerateInstanceVersion) {
-            if (vkEnumerateInstanceVersion(&api_version) != VK_SUCCESS)
-                return VK_NULL_HANDLE;
-        }
+        for (uint32_t a = 0; a < pass->access_count; ++a) {
+            const zvar_graph_access_t *access = pass->accesses + a;
+            zvar_graph_resource_t *resource = graph->resources + access->resource;
 
-        // TODO: Remove maybe? Or do differently.
-        printf("Vulkan API version: %d.%d.%d:%d\n",
-               VK_API_VERSION_MAJOR(api_version),
-               VK_API_VERSION_MINOR(api_version),
-               VK_API_VERSION_PATCH(api_version),
-               VK_API_VERSION_VARIANT(api_version));
+            bool first_access = true;
+
+            for (uint32_t b = 0; b < a; ++b) {
+                if (pass->accesses[b].resource == access->resource) {
+                    first_access = false;
+                }
+            }
+
+            // NOTE: The transfer carries the first access of the pass, later ones go through the tracker from the acquired state.
+            bool acquired = false;
+
+            for (uint32_t t = 0; t < graph->transfer_count && first_access; ++t) {
+                const zvar_graph_transfer_t *transfer = graph->transfers + t;
+
+                if (transfer->acquire_pass == position && transfer->resource == access->resource) {
+                    zvar_queue_graph_transfer(graph, command_buffer, transfer, false);
+                    acquired = true;
+                    break;
+                }
+            }
+
+            if (acquired)
+                continue;
+
+            resource->queue_family_index = pass->queue_family_index;
+
+            if (resource->is_buffer) {
+                zvar_use_buffer(tracker, command_buffer, &resource->tracked_buffer, &access->use);
+                continue;
+            }
+
+            if (!resource->imported && resource->first_use == position && first_access) {
+                zvar_discard_graph_image(graph, resource);
+            }
 
-        if (api_version < info->minimum_version) {
-            return VK_NULL_HANDLE;
+            VkImageSubresourceRange range = {
+                .aspectMask = resource->aspect,
+                .levelCount = 1,
+                .layerCount = 1,
+            };
+
+            zvar_use_image(tracker, command_buffer, &resource->tracked_image, &range, &access->use);
         }
-    }
 
-    // find validation layers
-    char **layers = info->required_validation_layers;
-    uint32_t layer_count = info->required_validation_layer_count;
+        zvar_flush_barriers(tracker, command_buffer);
 
-    {
-        if (layers == NULL) {
-            layers = default_validation_layers;
-            layer_count = lengthof(default_validation_layers);
+        if (pass->execute) {
+            pass->execute(command_buffer, pass->user_data);
         }
+    }
 
-        uint32_t instance_layer_count;
-        if (vkEnumerateInstanceLayerProperties(&instance_layer_count, NULL) != VK_SUCCESS)
-            return VK_NULL_HANDLE;
-        VkLayerProperties *layer_properties = zvar_get_scratch(instance_layer_count * sizeof(VkLayerProperties));
-        if (vkEnumerateInstanceLayerProperties(&instance_layer_count, layer_properties) != VK_SUCCESS)
-            return VK_NULL_HANDLE;
+    for (uint32_t t = 0; t < graph->transfer_count; ++t) {
+        if (graph->transfers[t].release_batch == batch_index) {
+            zvar_queue_graph_transfer(graph, command_buffer, graph->transfers + t, true);
+        }
+    }
 
-        for (uint32_t i = 0; i < layer_count; ++i) {
-            char *name = layers[i];
+    // NOTE: Imported resources owned by another queue by now are left where they are.
+    if (batch_index == graph->batch_count - 1) {
+        for (uint32_t i = 0; i < graph->resource_count; ++i) {
+            zvar_graph_resource_t *resource = graph->resources + i;
 
-            bool found = false;
+            if (!resource->has_final_use)
+                continue;
 
-            for (uint32_t j = 0; j < instance_layer_count; ++j) {
-                VkLayerProperties *props = layer_properties + j;
+            if (resource->queue_family_index != VK_QUEUE_FAMILY_IGNORED && resource->queue_family_index != batch->queue_family_index)
+                continue;
 
-                if (str_eq(name, props->layerName)) {
-                    found = true;
-                    break;
-                }
+            if (resource->is_buffer) {
+                zvar_use_buffer(tracker, command_buffer, &resource->tracked_buffer, &resource->final_use);
             }
+            else {
+                VkImageSubresourceRange range = {
+                    .aspectMask = resource->aspect,
+                    .levelCount = 1,
+                    .layerCount = 1,
+                };
 
-            if (!found) {
-                fprintf(stderr, "Required validation layer '%s' not found!\n", name);
-                return VK_NULL_HANDLE;
+                zvar_use_image(tracker, command_buffer, &resource->tracked_image, &range, &resource->final_use);
             }
         }
     }
 
-    // find instance extensions
-    char **req_instance_extensions = info->required_instance_extensions;
-    uint32_t req_instance_extension_count = info->required_instance_extension_count;
+    zvar_flush_barriers(tracker, command_buffer);
+}
 
-    {
-        if (req_instance_extensions == NULL) {
-            req_instance_extensions = default_instance_extensions;
-            req_instance_extension_count = lengthof(default_instance_extensions);
-        }
 
-        uint32_t instance_extension_count;
-        if (vkEnumerateInstanceExtensionProperties(NULL, &instance_extension_count, NULL) != VK_SUCCESS)
-            return VK_NULL_HANDLE;
-        VkExtensionProperties *extension_properties = zvar_get_scratch(instance_extension_count * sizeof(VkExtensionProperties));
-        if (vkEnumerateInstanceExtensionProperties(NULL, &instance_extension_count, extension_properties) != VK_SUCCESS)
-            return VK_NULL_HANDLE;
+/* parallel recording */
 
-        for (uint32_t i = 0; i < req_instance_extension_count; ++i) {
-            char *name = req_instance_extensions[i];
+#ifdef _WIN32
+    typedef HANDLE zvar_thread_t;
+    typedef SRWLOCK zvar_mutex_t;
+    typedef CONDITION_VARIABLE zvar_condition_t;
 
-            bool found = false;
+    #define zvar_init_mutex(mutex)                  InitializeSRWLock(mutex)
+    #define zvar_destroy_mutex(mutex)               ((void)(mutex))
+    #define zvar_lock_mutex(mutex)                  AcquireSRWLockExclusive(mutex)
+    #define zvar_unlock_mutex(mutex)                ReleaseSRWLockExclusive(mutex)
+    #define zvar_init_condition(condition)          InitializeConditionVariable(condition)
+    #define zvar_destroy_condition(condition)       ((void)(condition))
+    #define zvar_wait_condition(condition, mutex)   SleepConditionVariableSRW((condition), (mutex), INFINITE, 0)
+    #define zvar_signal_condition(condition)        WakeConditionVariable(condition)
+    #define zvar_broadcast_condition(condition)     WakeAllConditionVariable(condition)
+#else
+    typedef pthread_t zvar_thread_t;
+    typedef pthread_mutex_t zvar_mutex_t;
+    typedef pthread_cond_t zvar_condition_t;
+
+    #define zvar_init_mutex(mutex)                  pthread_mutex_init((mutex), NULL)
+    #define zvar_destroy_mutex(mutex)               pthread_mutex_destroy(mutex)
+    #define zvar_lock_mutex(mutex)                  pthread_mutex_lock(mutex)
+    #define zvar_unlock_mutex(mutex)                pthread_mutex_unlock(mutex)
+    #define zvar_init_condition(condition)          pthread_cond_init((condition), NULL)
+    #define zvar_destroy_condition(condition)       pthread_cond_destroy(condition)
+    #define zvar_wait_condition(condition, mutex)   pthread_cond_wait((condition), (mutex))
+    #define zvar_signal_condition(condition)        pthread_cond_signal(condition)
+    #define zvar_broadcast_condition(condition)     pthread_cond_broadcast(condition)
+#endif
 
-            for (uint32_t j = 0; j < instance_extension_count; ++j) {
-                VkExtensionProperties *props = extension_properties + j;
+#define ZVAR_CACHE_LINE_SIZE 64
 
-                if (str_eq(name, props->extensionName)) {
-                    found = true;
-                    break;
-                }
-            }
+/* Jobs [begin, end) a worker still has to record. Padded so workers taking jobs don't share cache lines. */
+typedef struct
+{
+    long lock;
+    uint32_t begin, end;
+    uint8_t padding[ZVAR_CACHE_LINE_SIZE - sizeof(long) - 2 * sizeof(uint32_t)];
+} zvar_job_range_t;
 
-            if (!found) {
-                fprintf(stderr, "Required instance extension '%s' not found!\n", name);
-                return VK_NULL_HANDLE;
-            }
-        }
-    }
+typedef struct
+{
+    zvar_worker_pool_t *pool;
+    uint32_t worker_index;
+} zvar_worker_t;
 
-    // create instance
+struct zvar_worker_pool
+{
+    zvar_parallel_recorder_t *recorder;
 
-    VkInstance instance;
-    {
-        VkInstanceCreateInfo instance_info = {
-            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-            .flags = 0,
-            .pApplicationInfo = &(VkApplicationInfo) {
-                .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-                .pApplicationName = info->application_name ? info->application_name : "zvarog",
-                .applicationVersion = info->application_version,
-                .pEngineName = info->engine_name ? info->engine_name : "zvar",
-                .engineVersion = info->engine_version,
-                .apiVersion = info->minimum_version,
-            },
-            .enabledLayerCount = layer_count,
-            .ppEnabledLayerNames = layers,
-            .enabledExtensionCount = req_instance_extension_count,
-            .ppEnabledExtensionNames = req_instance_extensions,
-        };
+    zvar_mutex_t mutex;
+    zvar_condition_t wake;
+    zvar_condition_t done;
 
-        if (vkCreateInstance(&instance_info, NULL, &instance) != VK_SUCCESS)
-            return VK_NULL_HANDLE;
+    /* Bumped for every zvar_record_parallel, workers wait for it to change. */
+    uint64_t generation;
+    uint32_t busy_count;
+    bool quit;
+
+    VkCommandBufferBeginInfo begin_info;
+    zvar_recording_job_t *jobs;
+
+    zvar_job_range_t *ranges;
+
+    /* Worker 0 is the recording thread itself and has no thread. */
+    zvar_thread_t *threads;
+    zvar_worker_t *workers;
+};
+
+
+static uint32_t zvar_get_processor_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+
+    return system_info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    // NOTE: Not in POSIX itself, but every libc zvar builds against has it once POSIX is asked for at the top.
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (uint32_t)count : 1;
+#else
+    return 1;
+#endif
+}
+
+
+static bool zvar_take_job(zvar_job_range_t *range, uint32_t *job)
+{
+    zvar_lock(&range->lock);
+
+    bool res = range->begin < range->end;
+
+    if (res) {
+        *job = range->begin++;
     }
 
-    volkLoadInstance(instance);
+    zvar_unlock(&range->lock);
 
-    return instance;
+    return res;
 }
 
-VkPhysicalDevice zvar_choose_some_physical_device(VkInstance instance)
+
+/* Moves the back half of the first non-empty range after `worker_index` into its own, which is empty. */
+static bool zvar_steal_jobs(zvar_worker_pool_t *pool, uint32_t worker_index)
 {
-    uint32_t physical_device_count;
-    ZVAR_CHECK(vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL));
-    VkPhysicalDevice *physical_devices = zvar_get_scratch(physical_device_count * sizeof(VkPhysicalDevice));
-    ZVAR_CHECK(vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices));
+    uint32_t worker_count = pool->recorder->worker_count;
 
-    uint32_t device_type_counts[VK_PHYSICAL_DEVICE_TYPE_CPU + 1] = {0};
+    for (uint32_t i = 1; i < worker_count; ++i) {
+        zvar_job_range_t *victim = pool->ranges + (worker_index + i) % worker_count;
 
-    for (uint32_t i = 0; i < physical_device_count; ++i) {
-        VkPhysicalDeviceProperties props;
-        vkGetPhysicalDeviceProperties(physical_devices[i], &props);
+        zvar_lock(&victim->lock);
 
-        device_type_counts[props.deviceType]++;
-    }
+        uint32_t remaining = victim->end - victim->begin;
+        uint32_t begin = victim->end - (remaining + 1) / 2;
+        uint32_t end = victim->end;
 
-    VkPhysicalDeviceType type_to_find;
+        victim->end = begin;
 
-    if (device_type_counts[VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU]) {
-        type_to_find = VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
-    }
-    else if (device_type_counts[VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU]) {
-        type_to_find = VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
-    }
-    else if (device_type_counts[VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU]) {
-        type_to_find = VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU;
-    }
-    else if (device_type_counts[VK_PHYSICAL_DEVICE_TYPE_CPU]) {
-        type_to_find = VK_PHYSICAL_DEVICE_TYPE_CPU;
-    }
-    else if (device_type_counts[VK_PHYSICAL_DEVICE_TYPE_OTHER]) {
-        type_to_find = VK_PHYSICAL_DEVICE_TYPE_OTHER;
-    }
-    else {
-        fprintf(stderr, "Failed to find GPU!\n");
-        exit(1);
-    }
+        zvar_unlock(&victim->lock);
 
-    uint32_t device_number = 0;
+        if (!remaining)
+            continue;
 
-    for (; device_number < physical_device_count; ++device_number) {
-        VkPhysicalDeviceProperties props;
-        vkGetPhysicalDeviceProperties(physical_devices[device_number], &props);
+        zvar_job_range_t *range = pool->ranges + worker_index;
 
-        if (props.deviceType == type_to_find)
-            break;
+        zvar_lock(&range->lock);
+        range->begin = begin;
+        range->end = end;
+        zvar_unlock(&range->lock);
+
+        zvar_atomic_add(&pool->recorder->steal_count, 1);
+
+        return true;
     }
 
-    return physical_devices[device_number];
+    return false;
 }
 
-VkDevice zvar_create_device(const zvar_device_create_info_t *info, uint32_t *graphics_index, uint32_t *compute_index, uint32_t *transfer_index)
+
+static void zvar_run_recording_jobs(zvar_worker_pool_t *pool, uint32_t worker_index)
 {
-    char **req_device_extensions = info->required_device_extensions;
-    uint32_t req_device_extension_count = info->required_device_extension_count;
+    zvar_parallel_recorder_t *recorder = pool->recorder;
+    zvar_recording_pool_t *recording_pool = recorder->pools + recorder->frame_index * recorder->worker_count + worker_index;
 
-    if (info->required_device_extensions == NULL) {
-        req_device_extensions = default_device_extensions;
-        req_device_extension_count = lengthof(default_device_extensions);
-    }
+    for (;;) {
+        uint32_t job_index;
 
-    // find device extensions
-    {
-        uint32_t device_extension_count;
-        ZVAR_CHECK(vkEnumerateDeviceExtensionProperties(info->physical_device, NULL, &device_extension_count, NULL));
-        VkExtensionProperties *extension_properties = zvar_get_scratch(device_extension_count * sizeof(VkExtensionProperties));
-        ZVAR_CHECK(vkEnumerateDeviceExtensionProperties(info->physical_device, NULL, &device_extension_count, extension_properties));
+        if (!zvar_take_job(pool->ranges + worker_index, &job_index)) {
+            if (!zvar_steal_jobs(pool, worker_index))
+                return;
 
-        for (uint32_t i = 0; i < req_device_extension_count; ++i) {
-            char *name = req_device_extensions[i];
+            continue;
+        }
 
-            bool found = false;
+        // NOTE: Secondaries of earlier frames are reused, the pool reset put them back into the initial state.
+        if (recording_pool->used_count == recording_pool->command_buffer_count) {
+            uint32_t count = recording_pool->command_buffer_count ? recording_pool->command_buffer_count : 16;
 
-            for (uint32_t j = 0; j < device_extension_count; ++j) {
-                VkExtensionProperties *props = extension_properties + j;
+            recording_pool->command_buffer_capacity = recording_pool->command_buffer_count + count;
+            recording_pool->command_buffers = zvar_realloc(recording_pool->command_buffers, recording_pool->command_buffer_capacity * sizeof(VkCommandBuffer));
 
-                if (str_eq(name, props->extensionName)) {
-                    found = true;
-                    break;
-                }
-            }
+            zvar_allocate_command_buffers(recorder->device, recording_pool->command_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, count,
+                                          recording_pool->command_buffers + recording_pool->command_buffer_count);
 
-            if (!found) {
-                fprintf(stderr, "Required device extension '%s' not found!\n", name);
-                exit(1);
-            }
+            recording_pool->command_buffer_count += count;
         }
-    }
 
-    uint32_t graphics_family_index = ZVAR_NO_INDEX;
-    uint32_t compute_family_index  = ZVAR_NO_INDEX;
-    uint32_t transfer_family_index = ZVAR_NO_INDEX;
+        zvar_recording_job_t *job = pool->jobs + job_index;
+        VkCommandBuffer command_buffer = recording_pool->command_buffers[recording_pool->used_count++];
 
-    // find adequate queue family
-    {
-        uint32_t queue_family_count;
-        vkGetPhysicalDeviceQueueFamilyProperties(info->physical_device, &queue_family_count, NULL);
-        VkQueueFamilyProperties *queue_family_properties = zvar_get_scratch(queue_family_count * sizeof(VkQueueFamilyProperties));
-        vkGetPhysicalDeviceQueueFamilyProperties(info->physical_device, &queue_family_count, queue_family_properties);
-
-        for (uint32_t family_index = 0; family_index < queue_family_count; ++family_index) {
-            VkQueueFamilyProperties *props = queue_family_properties + family_index;
+        ZVAR_CHECK(zvar_vk(command_buffer, vkBeginCommandBuffer)(command_buffer, &pool->begin_info));
 
-            VkBool32 supports_present;
+        job->record(command_buffer, worker_index, job->user_data);
 
-            ZVAR_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(info->physical_device, family_index, info->surface, &supports_present));
+        ZVAR_CHECK(zvar_vk(command_buffer, vkEndCommandBuffer)(command_buffer));
 
-            if (props->queueFlags & VK_QUEUE_GRAPHICS_BIT && supports_present) {
-                graphics_family_index = family_index;
-                continue;
-            }
-            //                                              Needs to be retarded because of present support.
-            if (props->queueFlags & VK_QUEUE_COMPUTE_BIT && !(props->queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
-                compute_family_index = family_index;
-                continue;
-            }
-            //                                               Needs to be retarded because of present support.
-            if (props->queueFlags & VK_QUEUE_TRANSFER_BIT && !(props->queueFlags & VK_QUEUE_GRAPHICS_BIT) && !(props->queueFlags & VK_QUEUE_COMPUTE_BIT)) {
-                transfer_family_index = family_index;
-                continue;
-            }
-        }
+        job->command_buffer = command_buffer;
     }
+}
 
-    VkDevice device;
 
-    // create device
-    {
-        uint32_t device_queue_create_info_count = 0;
-        VkDeviceQueueCreateInfo device_queue_create_infos[3];
+#ifdef _WIN32
+static DWORD WINAPI zvar_run_worker(void *arg)
+#else
+static void *zvar_run_worker(void *arg)
+#endif
+{
+    zvar_worker_t *worker = arg;
+    zvar_worker_pool_t *pool = worker->pool;
 
-        if (graphics_index) {
-            if (graphics_family_index == ZVAR_NO_INDEX) {
-                fprintf(stderr, "Failed to find graphics queue with a present capability!\n");
-                exit(1);
-            }
+    uint64_t generation = 0;
 
-            *graphics_index = graphics_family_index;
+    zvar_lock_mutex(&pool->mutex);
 
-            device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                .queueFamilyIndex = graphics_family_index,
-                .queueCount = 1,
-                .pQueuePriorities = &(float){ 1.0f },
-            };
+    for (;;) {
+        while (!pool->quit && pool->generation == generation) {
+            zvar_wait_condition(&pool->wake, &pool->mutex);
         }
 
-        if (compute_index) {
-            *compute_index = compute_family_index;
+        if (pool->quit)
+            break;
 
-            if (compute_family_index != ZVAR_NO_INDEX) {
-                device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
-                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                    .queueFamilyIndex = compute_family_index,
-                    .queueCount = 1,
-                    .pQueuePriorities = &(float){ 1.0f },
-                };
-            }
-        }
+        generation = pool->generation;
 
-        if (transfer_index) {
-            *transfer_index = transfer_family_index;
+        zvar_unlock_mutex(&pool->mutex);
 
-            if (transfer_family_index != ZVAR_NO_INDEX) {
-                device_queue_create_infos[device_queue_create_info_count++] = (VkDeviceQueueCreateInfo) {
-                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                    .queueFamilyIndex = transfer_family_index,
-                    .queueCount = 1,
-                    .pQueuePriorities = &(float){ 1.0f },
-                };
-            }
-        }
+        zvar_run_recording_jobs(pool, worker->worker_index);
 
-        VkDeviceCreateInfo device_create_info = {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-            .queueCreateInfoCount = device_queue_create_info_count,
-            .pQueueCreateInfos = device_queue_create_infos,
-            .enabledExtensionCount = req_device_extension_count,
-            .ppEnabledExtensionNames = req_device_extensions,
-            .pEnabledFeatures = &info->requested_device_features,
-        };
+        zvar_lock_mutex(&pool->mutex);
 
-        ZVAR_CHECK(vkCreateDevice(info->physical_device, &device_create_info, NULL, &device));
+        if (--pool->busy_count == 0) {
+            zvar_signal_condition(&pool->done);
+        }
     }
 
-    return device;
+    zvar_unlock_mutex(&pool->mutex);
+
+    zvar_free_thread_scratch();
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
 }
 
-VkSurfaceFormatKHR zvar_find_surface_format(const zvar_surface_format_info_t *info)
+
+void zvar_create_parallel_recorder(const zvar_parallel_recorder_create_info_t *info, zvar_parallel_recorder_t *recorder)
 {
-    VkFormat *supported_formats = info->supported_surface_formats;
-    uint32_t supported_format_count = info->supported_surface_format_count;
+    uint32_t frame_count = info->frame_count ? info->frame_count : 2;
+    uint32_t worker_count = info->worker_count ? info->worker_count : zvar_get_processor_count();
 
-    if (supported_formats == NULL) {
-        supported_formats = default_surface_formats;
-        supported_format_count = lengthof(default_surface_formats);
-    }
+    *recorder = (zvar_parallel_recorder_t) {
+        .device = info->device,
+        .frame_count = frame_count,
+        .worker_count = worker_count,
+    };
 
-    VkColorSpaceKHR *supported_color_spaces = info->supported_surface_color_spaces;
-    uint32_t supported_color_space_count = info->supported_surface_color_space_count;
+    recorder->pools = zvar_realloc(NULL, frame_count * worker_count * sizeof(zvar_recording_pool_t));
 
-    if (supported_color_spaces == NULL) {
-        supported_color_spaces = default_surface_color_spaces;
-        supported_color_space_count = lengthof(default_surface_color_spaces);
+    for (uint32_t i = 0; i < frame_count * worker_count; ++i) {
+        recorder->pools[i] = (zvar_recording_pool_t) {
+            .command_pool = zvar_create_command_pool(info->device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, info->queue_family_index),
+        };
     }
 
-    uint32_t surface_format_count;
-    ZVAR_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(info->physical_device, info->surface, &surface_format_count, NULL));
-    VkSurfaceFormatKHR *surface_formats = zvar_get_scratch(surface_format_count * sizeof(VkSurfaceFormatKHR));
-    ZVAR_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(info->physical_device, info->surface, &surface_format_count, surface_formats));
+    zvar_worker_pool_t *pool = zvar_realloc(NULL, sizeof(zvar_worker_pool_t));
 
-    uint32_t supported_format_index = supported_format_count;
-    uint32_t supported_space_index  = supported_color_space_count;
-    uint32_t found_format_index = 0;
+    *pool = (zvar_worker_pool_t) {
+        .recorder = recorder,
+        .ranges = zvar_realloc(NULL, worker_count * sizeof(zvar_job_range_t)),
+        .threads = zvar_realloc(NULL, worker_count * sizeof(zvar_thread_t)),
+        .workers = zvar_realloc(NULL, worker_count * sizeof(zvar_worker_t)),
+    };
 
-    for (uint32_t i = 0; i < surface_format_count; ++i) {
-        VkFormat format = surface_formats[i].format;
+    zvar_init_mutex(&pool->mutex);
+    zvar_init_condition(&pool->wake);
+    zvar_init_condition(&pool->done);
 
-        for (uint32_t format_index = 0;
-             format_index <= supported_format_index && format_index < supported_format_count;
-             ++format_index)
-        {
-            if (format == supported_formats[format_index]) {
-                VkColorSpaceKHR space = surface_formats[i].colorSpace;
+    recorder->workers = pool;
 
-                uint32_t search_count = (format_index == supported_format_index)
-                                      ? supported_space_index
-                                      : supported_color_space_count;
+    for (uint32_t i = 0; i < worker_count; ++i) {
+        pool->ranges[i] = (zvar_job_range_t) {0};
+        pool->workers[i] = (zvar_worker_t) {
+            .pool = pool,
+            .worker_index = i,
+        };
+    }
 
-                uint32_t space_index = 0;
+    for (uint32_t i = 1; i < worker_count; ++i) {
+#ifdef _WIN32
+        pool->threads[i] = CreateThread(NULL, 0, zvar_run_worker, pool->workers + i, 0, NULL);
 
-                for (; space_index < search_count; ++space_index) {
-                    if (space == supported_color_spaces[space_index])
-                        break;
-                }
+        if (pool->threads[i] == NULL) {
+#else
+        if (pthread_create(pool->threads + i, NULL, zvar_run_worker, pool->workers + i)) {
+#endif
+            fprintf(stderr, "Failed to create a worker thread!\n");
+            exit(1);
+        }
+    }
+}
 
-                if (space_index == search_count)
-                    continue;
 
-                supported_format_index = format_index;
-                supported_space_index = space_index;
-                found_format_index = i;
-                break;
-            }
-        }
+void zvar_destroy_parallel_recorder(zvar_parallel_recorder_t *recorder)
+{
+    zvar_worker_pool_t *pool = recorder->workers;
+
+    zvar_lock_mutex(&pool->mutex);
+    pool->quit = true;
+    zvar_broadcast_condition(&pool->wake);
+    zvar_unlock_mutex(&pool->mutex);
+
+    for (uint32_t i = 1; i < recorder->worker_count; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+#else
+        pthread_join(pool->threads[i], NULL);
+#endif
     }
 
-    if (supported_format_index == supported_format_count) {
-        fprintf(stderr, "Failed to find supported surface format!\n");
-        exit(1);
+    zvar_destroy_condition(&pool->done);
+    zvar_destroy_condition(&pool->wake);
+    zvar_destroy_mutex(&pool->mutex);
+
+    free(pool->ranges);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+
+    // NOTE: Destroying the pools frees their command buffers.
+    for (uint32_t i = 0; i < recorder->frame_count * recorder->worker_count; ++i) {
+        zvar_vk(recorder->device, vkDestroyCommandPool)(recorder->device, recorder->pools[i].command_pool, zvar_get_device_allocation_callbacks(recorder->device));
+        free(recorder->pools[i].command_buffers);
     }
 
-    return surface_formats[found_format_index];
+    free(recorder->pools);
+
+    *recorder = (zvar_parallel_recorder_t) {0};
 }
 
 
-VkFormat zvar_find_depth_format(const zvar_depth_format_info_t *info)
+void zvar_begin_recording_frame(zvar_parallel_recorder_t *recorder, uint32_t frame_index)
 {
-    const VkFormat *depth_format_prefs = info->supported_depth_formats;
-    uint32_t depth_format_pref_count = info->supported_depth_format_count;
+    assert(frame_index < recorder->frame_count);
 
-    if (depth_format_prefs == NULL) {
-        depth_format_prefs = default_depth_format_prefs;
-        depth_format_pref_count = lengthof(default_depth_format_prefs);
+    recorder->frame_index = frame_index;
+
+    for (uint32_t i = 0; i < recorder->worker_count; ++i) {
+        zvar_recording_pool_t *pool = recorder->pools + frame_index * recorder->worker_count + i;
+
+        if (!pool->used_count)
+            continue;
+
+        ZVAR_CHECK(zvar_vk(recorder->device, vkResetCommandPool)(recorder->device, pool->command_pool, 0));
+
+        pool->used_count = 0;
     }
+}
 
-    VkFormat res = 0;
 
-    uint32_t i = 0;
+void zvar_record_parallel(zvar_parallel_recorder_t *recorder, VkCommandBufferUsageFlags flags, const VkCommandBufferInheritanceInfo *inheritance,
+                          uint32_t job_count, zvar_recording_job_t *jobs)
+{
+    zvar_instrument_begin(ZVAR_COUNTER_RECORD_PARALLEL);
 
-    for (; i < depth_format_pref_count; ++i) {
-        VkFormat format = depth_format_prefs[i];
+    zvar_worker_pool_t *pool = recorder->workers;
+    uint32_t worker_count = recorder->worker_count;
+
+    pool->begin_info = (VkCommandBufferBeginInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = flags,
+        .pInheritanceInfo = inheritance,
+    };
 
-        VkFormatProperties format_properties;
-        vkGetPhysicalDeviceFormatProperties(info->physical_device, format, &format_properties);
+    pool->jobs = jobs;
 
-        if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-            res = format;
-            break;
-        }
+    // NOTE: Contiguous ranges keep neighbouring jobs, which likely touch the same data, on one worker.
+    for (uint32_t i = 0; i < worker_count; ++i) {
+        pool->ranges[i].begin = (uint32_t)((uint64_t)job_count * i / worker_count);
+        pool->ranges[i].end   = (uint32_t)((uint64_t)job_count * (i + 1) / worker_count);
     }
 
-    if (i == depth_format_pref_count) {
-        fprintf(stderr, "Failed to find suitable depth format!\n");
-        exit(EXIT_FAILURE);
+    zvar_lock_mutex(&pool->mutex);
+    pool->generation++;
+    pool->busy_count = worker_count - 1;
+    zvar_broadcast_condition(&pool->wake);
+    zvar_unlock_mutex(&pool->mutex);
+
+    zvar_run_recording_jobs(pool, 0);
+
+    zvar_lock_mutex(&pool->mutex);
+
+    while (pool->busy_count) {
+        zvar_wait_condition(&pool->done, &pool->mutex);
     }
 
-    return res;
+    zvar_unlock_mutex(&pool->mutex);
+
+    recorder->recorded_count += job_count;
+
+    zvar_instrument_end(ZVAR_COUNTER_RECORD_PARALLEL);
+}
+
+
+void zvar_execute_recording_jobs(VkCommandBuffer command_buffer, uint32_t job_count, const zvar_recording_job_t *jobs)
+{
+    if (!job_count)
+        return;
+
+    zvar_scratch_mark_t scratch_mark = zvar_save_scratch();
+
+    VkCommandBuffer *command_buffers = zvar_get_scratch(job_count * sizeof(VkCommandBuffer));
+
+    for (uint32_t i = 0; i < job_count; ++i) {
+        command_buffers[i] = jobs[i].command_buffer;
+    }
+
+    zvar_vk(command_buffer, vkCmdExecuteCommands)(command_buffer, job_count, command_buffers);
+
+    zvar_restore_scratch(scratch_mark);
 }
@@ -1,9 +1,9 @@
 /* TODO:
- * [ ] Add optional layers and extensions.
- * [ ] Remove dck.h from implementation.
- * [ ] Make prefered device work properly.
+ * [X] Add optional layers and extensions.
+ * [X] Remove dck.h from implementation.
+ * [X] Make prefered device work properly.
  * [X] Error callback.
- * [ ] Custom allocators.
+ * [X] Custom allocators.
  */
 
 #ifndef ZVAR_H_
@@ -41,8 +41,16 @@ do { \
 
 #define ZVAR_EMPTY ((void *)666)
 
+/* Temporary memory of zvar functions is kept in a per-thread arena, so they can be called from several threads at once.
+ * Frees the arena of the calling thread, call it before a thread that used zvar exits.
+ */
+void zvar_free_thread_scratch(void);
+
 typedef struct
 {
+    /* The instance gets created with the highest version the loader has, up to 1.3, and no lower than this.
+     * Below 1.1 VK_KHR_get_physical_device_properties2 gets enabled when present.
+     */
     uint32_t minimum_version;
 
     char *application_name;
@@ -55,26 +63,154 @@ typedef struct
 
     uint32_t required_instance_extension_count;
     char   **required_instance_extensions;
+
+    /* Enabled when present, missing ones are skipped.
+     * The `_enabled` arrays can be NULL, otherwise they get whether each optional name was enabled.
+     */
+    uint32_t optional_validation_layer_count;
+    char   **optional_validation_layers;
+    bool    *optional_validation_layers_enabled;
+
+    uint32_t optional_instance_extension_count;
+    char   **optional_instance_extensions;
+    bool    *optional_instance_extensions_enabled;
+
+    /* No window system, the default instance extensions are left out. */
+    bool headless;
+
+    /* Host allocator of the instance and of everything zvar creates on it, can be NULL.
+     * Has to stay alive until the instance is destroyed.
+     */
+    const VkAllocationCallbacks *allocation_callbacks;
 } zvar_instance_create_info_t;
 
 VkInstance zvar_create_instance(const zvar_instance_create_info_t *info);
 
+/* Destroys the instance with the allocator it was created with, every device of it has to be destroyed already. */
+void zvar_destroy_instance(VkInstance instance);
+
+/* What zvar passes as `pAllocator` for objects of the instance or device, use it for objects created outside of zvar too.
+ * NULL for handles zvar didn't create.
+ */
+const VkAllocationCallbacks *zvar_get_instance_allocation_callbacks(VkInstance instance);
+
+const VkAllocationCallbacks *zvar_get_device_allocation_callbacks(VkDevice device);
+
 
 #define ZVAR_NO_INDEX 0xFFFFFFFF
 
 typedef struct
 {
     VkPhysicalDevice physical_device;
+    /* VK_NULL_HANDLE makes a headless device, no present support or swapchain extension is required. */
     VkSurfaceKHR surface;
 
     VkPhysicalDeviceFeatures requested_device_features;
 
     uint32_t required_device_extension_count;
     char   **required_device_extensions;
+
+    /* Enabled when present, with their feature struct chained and turned on when they have one.
+     * The device extensions they depend on get enabled too where the device version doesn't have them in core.
+     * An extension whose feature or dependency the device lacks counts as missing, so do the ones zvar knows of
+     * when neither Vulkan 1.1 nor VK_KHR_get_physical_device_properties2 is on the instance.
+     * On a device usable with Vulkan 1.3, dynamic rendering, synchronization2 and pipeline creation cache control
+     * get their core feature turned on instead of the extension and count as enabled.
+     * `optional_device_extensions_enabled` can be NULL, otherwise it gets whether each one was enabled.
+     */
+    uint32_t optional_device_extension_count;
+    char   **optional_device_extensions;
+    bool    *optional_device_extensions_enabled;
+
+    /* Host allocator of the device and of every object zvar creates on it.
+     * NULL uses the callbacks of the instance.
+     */
+    const VkAllocationCallbacks *allocation_callbacks;
+
+    /* zvar keeps a table per device and finds it from the VkDevice, VkQueue or VkCommandBuffer it gets, so any number of devices works.
+     * NULL also loads the device entry points into the global volk functions for the application, fine when there is a single device.
+     * Otherwise this table gets a copy of the device's entry points and the global functions are left alone.
+     */
+    VolkDeviceTable *device_table;
 } zvar_device_create_info_t;
 
+/* Fast paths worth asking for as optional device extensions:
+ *     char *optional_extensions[] = { ZVAR_PERFORMANCE_DEVICE_EXTENSIONS };
+ * All of them need VK_KHR_get_physical_device_properties2 or Vulkan 1.1 on the instance.
+ */
+#define ZVAR_PERFORMANCE_DEVICE_EXTENSIONS \
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, \
+    VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME, \
+    VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, \
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, \
+    VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME, \
+    VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME
+
+/* The indices get ZVAR_NO_INDEX for queues the device has no family for, only possible for graphics without a surface.
+ * Returns VK_NULL_HANDLE when a required device extension is missing, there is no graphics family that can present
+ * to the surface, or no family for any requested queue.
+ */
 VkDevice zvar_create_device(const zvar_device_create_info_t *info, uint32_t *graphics_index, uint32_t *compute_index, uint32_t *transfer_index);
 
+typedef enum
+{
+    ZVAR_QUEUE_ROLE_GRAPHICS,
+    ZVAR_QUEUE_ROLE_COMPUTE,
+    ZVAR_QUEUE_ROLE_TRANSFER,
+
+    ZVAR_QUEUE_ROLE_COUNT,
+} zvar_queue_role_t;
+
+#define ZVAR_MAX_QUEUES_PER_ROLE 16
+
+typedef struct
+{
+    /* 0 skips the role, at most ZVAR_MAX_QUEUES_PER_ROLE. */
+    uint32_t count;
+    /* `count` priorities between 0 and 1, NULL gives all of them 1. */
+    const float *priorities;
+} zvar_queue_request_t;
+
+typedef struct
+{
+    zvar_queue_request_t requests[ZVAR_QUEUE_ROLE_COUNT];
+} zvar_queue_topology_create_info_t;
+
+typedef struct
+{
+    VkQueue queue;
+    uint32_t family_index;
+    uint32_t queue_index;
+    /* False when the role had no family of its own and the queue comes from the graphics family,
+     * or the compute family on a headless device without a graphics one.
+     */
+    bool dedicated;
+    /* The family ran out of queues and this VkQueue is handed out more than once. */
+    bool shared;
+} zvar_queue_t;
+
+/* Thread ownership:
+ * Submitting and presenting to a VkQueue has to be externally synchronized.
+ * Every queue without `shared` can be owned by a thread of its own and submitted to without locking.
+ * Queues with `shared` alias another entry, their owners have to serialize submission to them.
+ */
+typedef struct
+{
+    uint32_t queue_counts[ZVAR_QUEUE_ROLE_COUNT];
+    zvar_queue_t queues[ZVAR_QUEUE_ROLE_COUNT][ZVAR_MAX_QUEUES_PER_ROLE];
+} zvar_queue_topology_t;
+
+/* Compute and transfer queues come from the first family dedicated to them, otherwise from the graphics family.
+ * Without a surface the device may lack a graphics family, as on compute nodes, it can't have graphics queues then
+ * and transfer queues come from the compute family.
+ * The first graphics queue is the one zvar_create_device would have created.
+ * Returns VK_NULL_HANDLE when a required device extension or a usable graphics family is missing.
+ */
+VkDevice zvar_create_device_with_queues(const zvar_device_create_info_t *info, const zvar_queue_topology_create_info_t *topology_info, zvar_queue_topology_t *topology);
+
+/* Destroys the device with the allocator it was created with, the device has to be idle and done with every object of it. */
+void zvar_destroy_device(VkDevice device);
+
 
 typedef struct
 {
@@ -115,7 +251,13 @@ typedef struct
     VkSurfaceFormatKHR surface_format;
     VkPhysicalDeviceMemoryProperties *physical_device_memory_properties;
     VkFormat depth_format;
+    /* Ignored by zvar_create_dynamic_swapchain_clique, VK_NULL_HANDLE makes the frame loop use dynamic rendering. */
     VkRenderPass render_pass;
+    /* Zero or VK_SAMPLE_COUNT_1_BIT renders straight into the swapchain images. More adds a multisampled color image
+     * that resolves into the swapchain image, the depth image gets the same sample count.
+     * The framebuffers then take the multisampled color, the depth and the swapchain image as resolve attachment, in that order.
+     */
+    VkSampleCountFlagBits samples;
 
     uint32_t prefered_image_count;
     uint32_t maximum_image_count;
@@ -125,13 +267,100 @@ typedef struct
 
     uint32_t present_mode_pref_count;
     VkPresentModeKHR *present_mode_prefs;
+
+    /* Extent the depth memory is sized for at the least, the monitor extent for example.
+     * Zero sizes it by the swapchain with some headroom.
+     */
+    uint32_t depth_reserve_width, depth_reserve_height;
 } zvar_swapchain_create_info_t;
 
+/* When `*swapchain` isn't VK_NULL_HANDLE the clique previously returned through the same pointers is retired,
+ * the device has to be done using it. The depth memory is kept for the new depth image as long as it is big enough
+ * and `*depth_memory_size` tracks its size, so resizing allocates no device memory in the steady state.
+ * The depth and multisampled color images are transient attachments, their contents don't survive the render pass.
+ * They share the depth memory, which is lazily allocated where the device has such memory.
+ * `color_image` and `color_view` can be NULL without multisampling, they are VK_NULL_HANDLE then.
+ * Returns false with the previous clique untouched when the surface has no area.
+ */
 bool zvar_create_swapchain_clique(const zvar_swapchain_create_info_t *info,
                                   VkSwapchainKHR *swapchain, uint32_t *width, uint32_t *height, uint32_t *image_count, VkImageView *views, VkFramebuffer *framebuffers,
+                                  VkImage *color_image, VkImageView *color_view,
+                                  VkImage *depth_image, VkDeviceMemory *depth_memory, VkDeviceSize *depth_memory_size, VkImageView *depth_view);
+
+/* zvar_create_swapchain_clique for VK_KHR_dynamic_rendering or Vulkan 1.3, handing out the swapchain images instead of framebuffers.
+ * Nothing depends on a render pass, so resizing recreates less and pipelines don't multiply with render pass permutations.
+ */
+bool zvar_create_dynamic_swapchain_clique(const zvar_swapchain_create_info_t *info,
+                                          VkSwapchainKHR *swapchain, uint32_t *width, uint32_t *height, uint32_t *image_count, VkImage *images, VkImageView *views,
+                                          VkImage *color_image, VkImageView *color_view,
+                                          VkImage *depth_image, VkDeviceMemory *depth_memory, VkDeviceSize *depth_memory_size, VkImageView *depth_view);
+
+
+typedef struct
+{
+    VkImage color_image;
+    VkImageView color_view;
+    /* Layout zvar_end_rendering leaves the color image in, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for a swapchain image. */
+    VkImageLayout color_final_layout;
+    VkClearColorValue clear_color;
+
+    /* Single sampled image the multisampled color image resolves into, the swapchain image for example.
+     * `color_final_layout` applies to it then and the color image itself is never stored.
+     * VK_NULL_HANDLE renders without resolving.
+     */
+    VkImage resolve_image;
+    VkImageView resolve_view;
+
+    /* VK_NULL_HANDLE renders without depth. */
+    VkImage depth_image;
+    VkImageView depth_view;
+    VkFormat depth_format;
+    float clear_depth;
+
+    uint32_t width, height;
+} zvar_rendering_info_t;
+
+/* Transitions the attachments and begins dynamic rendering, both get cleared and the depth isn't stored.
+ * A resolved color image isn't stored either, it gets averaged into the resolve image.
+ * Pipelines drawn with it chain a VkPipelineRenderingCreateInfo with the same formats instead of naming a render pass,
+ * and the multisample state takes the sample count of the attachments.
+ */
+void zvar_begin_rendering(VkCommandBuffer command_buffer, const zvar_rendering_info_t *info);
+
+void zvar_end_rendering(VkCommandBuffer command_buffer, const zvar_rendering_info_t *info);
+
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties *physical_device_memory_properties;
+    VkFormat color_format;
+    /* VK_FORMAT_UNDEFINED leaves out the depth image. */
+    VkFormat depth_format;
+    /* VK_NULL_HANDLE leaves out the framebuffers, for zvar_begin_rendering for example. */
+    VkRenderPass render_pass;
+
+    uint32_t width, height;
+    uint32_t image_count;
+
+    /* Usage on top of the color attachment one, VK_IMAGE_USAGE_TRANSFER_SRC_BIT to read the images back for example. */
+    VkImageUsageFlags color_usage;
+} zvar_offscreen_create_info_t;
+
+/* Render target of a headless device, shaped like the swapchain clique.
+ * All color images share `color_memory`, they start out in VK_IMAGE_LAYOUT_UNDEFINED.
+ */
+void zvar_create_offscreen_clique(const zvar_offscreen_create_info_t *info,
+                                  VkImage *images, VkDeviceMemory *color_memory, VkImageView *views, VkFramebuffer *framebuffers,
                                   VkImage *depth_image, VkDeviceMemory *depth_memory, VkImageView *depth_view);
 
+/* The device has to be done using the clique. */
+void zvar_destroy_offscreen_clique(const zvar_offscreen_create_info_t *info,
+                                   VkImage *images, VkDeviceMemory *color_memory, VkImageView *views, VkFramebuffer *framebuffers,
+                                   VkImage *depth_image, VkDeviceMemory *depth_memory, VkImageView *depth_view);
+
 
+/* zvar_choose_physical_device with nothing but the instance, exits when there is no device at all. */
 VkPhysicalDevice zvar_choose_some_physical_device(VkInstance instance);
 
 VkCommandPool zvar_create_command_pool(VkDevice device, VkCommandPoolCreateFlags flags, uint32_t queue_family_index);
@@ -156,10 +385,1444 @@ void zvar_finish_one_off_command_buffer(VkDevice device, VkCommandPool command_p
 
 VkImage zvar_create_2d_image_exclusive(VkDevice device, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, VkImageUsageFlags usage);
 
+/* Single mip image with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT on top of `usage`, for attachments whose contents don't outlive the render pass
+ * like depth and multisampled color. Back it with memory from zvar_find_attachment_memory_type.
+ */
+VkImage zvar_create_2d_attachment_image(VkDevice device, VkFormat format, uint32_t width, uint32_t height, VkSampleCountFlagBits samples, VkImageUsageFlags usage);
+
 VkDeviceMemory zvar_allocate_memory(VkDevice device, uint32_t memory_type, VkDeviceSize size);
 
 VkImageView zvar_create_2d_image_view(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect_mask, uint32_t level_count);
 
 int32_t zvar_find_memory_type(VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t supported_type_mask, VkMemoryPropertyFlags required_properties);
 
+/* Lazily allocated device local memory when there is some, on tile based GPUs transient attachments then never get memory committed.
+ * Plain device local memory otherwise.
+ */
+int32_t zvar_find_attachment_memory_type(VkPhysicalDeviceMemoryProperties *memory_properties, uint32_t supported_type_mask);
+
+
+/* Device memory sub-allocator.
+ * Carves allocations out of large per-memory-type blocks using TLSF placement.
+ * Not thread safe, calls on the same allocator have to be externally synchronized.
+ */
+
+#define ZVAR_DEFAULT_MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+
+typedef struct zvar_memory_block zvar_memory_block_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+
+    /* Zero means ZVAR_DEFAULT_MEMORY_BLOCK_SIZE.
+     * Requests bigger than half of the block size get their own VkDeviceMemory.
+     */
+    VkDeviceSize block_size;
+} zvar_allocator_create_info_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkDeviceSize buffer_image_granularity;
+    VkDeviceSize non_coherent_atom_size;
+    VkDeviceSize block_size;
+
+    uint32_t block_count, block_capacity;
+    zvar_memory_block_t **blocks;
+
+    /* statistics */
+    uint32_t dedicated_count;
+    uint32_t allocation_count;
+    VkDeviceSize reserved_bytes;
+    VkDeviceSize used_bytes;
+} zvar_allocator_t;
+
+typedef struct
+{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+
+    /* Points at `offset` inside of a persistently mapped block.
+     * NULL when the memory type is not host visible.
+     */
+    void *mapped;
+
+    uint32_t memory_type;
+
+    /* internal */
+    zvar_memory_block_t *block;
+    uint32_t node;
+} zvar_allocation_t;
+
+bool zvar_create_allocator(const zvar_allocator_create_info_t *info, zvar_allocator_t *allocator);
+
+/* All allocations have to be freed and the device idle. */
+void zvar_destroy_allocator(zvar_allocator_t *allocator);
+
+/* Returns false when no memory type satisfying `required_properties` has space left.
+ * `optimal_image` tells whether the memory backs an optimally tiled image, used to honour bufferImageGranularity.
+ */
+bool zvar_suballocate_memory(zvar_allocator_t *allocator, const VkMemoryRequirements *requirements, VkMemoryPropertyFlags required_properties, bool optimal_image, zvar_allocation_t *allocation);
+
+void zvar_free_suballocation(zvar_allocator_t *allocator, zvar_allocation_t *allocation);
+
+/* Allocate and bind in one go. */
+bool zvar_allocate_buffer_memory(zvar_allocator_t *allocator, VkBuffer buffer, VkMemoryPropertyFlags required_properties, zvar_allocation_t *allocation);
+
+bool zvar_allocate_image_memory(zvar_allocator_t *allocator, VkImage image, VkMemoryPropertyFlags required_properties, zvar_allocation_t *allocation);
+
+
+/* Batched uploads.
+ * Copies are recorded into a shared command buffer and submitted without waiting.
+ * Every submission returns a ticket that can be polled or waited on later.
+ * Command buffers and fences are recycled, the batch count only grows while all of them are in flight.
+ * Resources are expected to be owned by the upload queue family or created with concurrent sharing.
+ */
+
+typedef struct
+{
+    VkDevice device;
+    VkQueue queue;
+    uint32_t queue_family_index;
+
+    /* Zero means 4. */
+    uint32_t initial_batch_count;
+} zvar_upload_context_create_info_t;
+
+typedef struct
+{
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    uint64_t ticket;
+    bool pending;
+} zvar_upload_batch_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool command_pool;
+
+    uint32_t batch_count, batch_capacity;
+    zvar_upload_batch_t *batches;
+
+    /* ZVAR_NO_INDEX when nothing is being recorded. */
+    uint32_t recording_batch;
+    uint32_t recorded_command_count;
+
+    uint64_t last_ticket;
+    uint64_t completed_ticket;
+} zvar_upload_context_t;
+
+void zvar_create_upload_context(const zvar_upload_context_create_info_t *info, zvar_upload_context_t *context);
+
+/* Waits for all pending batches. */
+void zvar_destroy_upload_context(zvar_upload_context_t *context);
+
+/* Returns the command buffer of the batch being recorded, starting a new one when needed.
+ * Anything recorded into it is submitted by the next zvar_submit_uploads.
+ */
+VkCommandBuffer zvar_get_upload_command_buffer(zvar_upload_context_t *context);
+
+void zvar_upload_buffer(zvar_upload_context_t *context, VkBuffer src, VkDeviceSize src_offset, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size);
+
+/* Copies tightly packed texels into the first mip level, transitioning the image from undefined to `final_layout`. */
+void zvar_upload_2d_image(zvar_upload_context_t *context, VkBuffer src, VkDeviceSize src_offset, VkImage dst, VkImageAspectFlags aspect_mask, uint32_t width, uint32_t height, VkImageLayout final_layout);
+
+/* Returns the ticket of the submitted batch.
+ * With nothing recorded returns the ticket of the last submission.
+ */
+uint64_t zvar_submit_uploads(zvar_upload_context_t *context);
+
+/* Polls the pending batches and returns the newest ticket below which everything has finished. */
+uint64_t zvar_get_completed_upload_ticket(zvar_upload_context_t *context);
+
+bool zvar_is_upload_complete(zvar_upload_context_t *context, uint64_t ticket);
+
+void zvar_wait_for_upload(zvar_upload_context_t *context, uint64_t ticket);
+
+
+/* Staging ring buffer.
+ * A persistently mapped host visible buffer handing out aligned slices in a circular fashion.
+ * Slices handed out since the last zvar_fence_staging_ring are tagged with the value passed to it
+ * and get reclaimed once the completion source reaches that value.
+ * The value is a timeline semaphore value, an upload ticket or anything else monotonic.
+ */
+
+typedef struct
+{
+    zvar_allocator_t *allocator;
+
+    VkDeviceSize size;
+    /* Zero means VK_BUFFER_USAGE_TRANSFER_SRC_BIT. */
+    VkBufferUsageFlags usage;
+
+    /* Completion source, at most one may be set.
+     * With neither set the completed value is passed to zvar_retire_staging_ring by hand.
+     */
+    VkSemaphore timeline_semaphore;
+    zvar_upload_context_t *upload_context;
+} zvar_staging_ring_create_info_t;
+
+typedef struct
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void *mapped;
+} zvar_staging_slice_t;
+
+typedef struct
+{
+    uint64_t value;
+    uint64_t end;
+} zvar_staging_fence_t;
+
+typedef struct
+{
+    VkDevice device;
+    zvar_allocator_t *allocator;
+    VkBuffer buffer;
+    zvar_allocation_t allocation;
+    uint8_t *mapped;
+    VkDeviceSize size;
+
+    bool coherent;
+    VkDeviceSize atom_size;
+
+    VkSemaphore timeline_semaphore;
+    zvar_upload_context_t *upload_context;
+
+    /* Monotonic byte positions, wrapped by `size`. */
+    uint64_t head, tail, fenced;
+
+    /* Circular queue of fenced segments, oldest first. */
+    uint32_t fence_first, fence_count, fence_capacity;
+    zvar_staging_fence_t *fences;
+} zvar_staging_ring_t;
+
+bool zvar_create_staging_ring(const zvar_staging_ring_create_info_t *info, zvar_staging_ring_t *ring);
+
+/* The GPU must be done with every slice. */
+void zvar_destroy_staging_ring(zvar_staging_ring_t *ring);
+
+/* Returns false when the ring is full even after reclaiming finished segments.
+ * `alignment` has to be a power of two.
+ */
+bool zvar_allocate_staging_slice(zvar_staging_ring_t *ring, VkDeviceSize size, VkDeviceSize alignment, zvar_staging_slice_t *slice);
+
+/* Tags every slice handed out since the last call with `value`, flushing them if the memory isn't coherent.
+ * Values have to be increasing.
+ */
+void zvar_fence_staging_ring(zvar_staging_ring_t *ring, uint64_t value);
+
+/* Polls the completion source and reclaims finished segments. */
+void zvar_reclaim_staging_ring(zvar_staging_ring_t *ring);
+
+void zvar_retire_staging_ring(zvar_staging_ring_t *ring, uint64_t completed_value);
+
+
+/* Fence and semaphore pools.
+ * Hand out unsignaled fences and binary semaphores, growing on demand.
+ * Not thread safe, calls on the same pool have to be externally synchronized.
+ */
+
+typedef struct
+{
+    VkDevice device;
+
+    /* Unsignaled, ready to be handed out. */
+    uint32_t ready_count, ready_capacity;
+    VkFence *ready;
+
+    /* Signaled, reset in bulk once the ready ones run out. */
+    uint32_t signaled_count, signaled_capacity;
+    VkFence *signaled;
+
+    /* Possibly still in flight, polled once the ready and signaled ones run out. */
+    uint32_t pending_count, pending_capacity;
+    VkFence *pending;
+
+    uint64_t created_count;
+    uint64_t reused_count;
+} zvar_fence_pool_t;
+
+typedef struct
+{
+    VkDevice device;
+
+    uint32_t ready_count, ready_capacity;
+    VkSemaphore *ready;
+
+    uint64_t created_count;
+    uint64_t reused_count;
+} zvar_semaphore_pool_t;
+
+void zvar_create_fence_pool(VkDevice device, zvar_fence_pool_t *pool);
+
+/* Every acquired fence has to be released and not in use by the device. */
+void zvar_destroy_fence_pool(zvar_fence_pool_t *pool);
+
+/* Returns an unsignaled fence. */
+VkFence zvar_acquire_fence(zvar_fence_pool_t *pool);
+
+/* The fence has to be signaled or never submitted. */
+void zvar_release_fence(zvar_fence_pool_t *pool, VkFence fence);
+
+/* The fence may still be in flight, it is taken back once it signals. */
+void zvar_release_pending_fence(zvar_fence_pool_t *pool, VkFence fence);
+
+void zvar_create_semaphore_pool(VkDevice device, zvar_semaphore_pool_t *pool);
+
+void zvar_destroy_semaphore_pool(zvar_semaphore_pool_t *pool);
+
+VkSemaphore zvar_acquire_semaphore(zvar_semaphore_pool_t *pool);
+
+/* The semaphore has to be unsignaled with no pending signal or wait operation,
+ * usually known from the fence of the submission that waited on it.
+ */
+void zvar_release_semaphore(zvar_semaphore_pool_t *pool, VkSemaphore semaphore);
+
+/* zvar_finish_one_off_command_buffer taking its fence from `fence_pool`. */
+void zvar_finish_pooled_one_off_command_buffer(VkDevice device, VkCommandPool command_pool, VkQueue queue, VkCommandBuffer command_buffer, zvar_fence_pool_t *fence_pool);
+
+
+/* Frames in flight.
+ * Owns the swapchain clique together with per-frame command pools, semaphores and fences.
+ * The CPU records frame N + 1 while the GPU still executes frame N.
+ * Out of date and suboptimal swapchains are recreated by the loop itself.
+ */
+
+typedef struct
+{
+    VkCommandPool command_pool;
+    /* Allocated from `command_pool`, which is reset as a whole when the frame begins. */
+    VkCommandBuffer command_buffer;
+    VkSemaphore image_acquired;
+    VkFence in_flight;
+} zvar_frame_t;
+
+typedef struct
+{
+    /* Copied, pointers inside have to stay valid for the lifetime of the loop.
+     * `maximum_image_count` sizes the per-image arrays.
+     */
+    zvar_swapchain_create_info_t swapchain_info;
+
+    VkQueue graphics_queue;
+    uint32_t graphics_queue_family_index;
+    VkQueue present_queue;
+
+    /* Zero means 2. */
+    uint32_t frames_in_flight;
+
+    /* Used when the surface doesn't dictate the extent. */
+    uint32_t width, height;
+} zvar_frame_loop_create_info_t;
+
+typedef struct
+{
+    zvar_swapchain_create_info_t swapchain_info;
+
+    VkQueue graphics_queue;
+    VkQueue present_queue;
+
+    /* swapchain clique */
+    VkSwapchainKHR swapchain;
+    uint32_t width, height;
+    uint32_t image_count;
+    /* Only there without a render pass, NULL otherwise. */
+    VkImage *images;
+    VkImageView *views;
+    /* Only there with a render pass, NULL otherwise. */
+    VkFramebuffer *framebuffers;
+    /* Only there with multisampling, VK_NULL_HANDLE otherwise. */
+    VkImage color_image;
+    VkImageView color_view;
+    VkImage depth_image;
+    VkDeviceMemory depth_memory;
+    VkDeviceSize depth_memory_size;
+    VkImageView depth_view;
+
+    /* Per swapchain image, signaled by the frame's submission and waited on by present. */
+    VkSemaphore *render_finished;
+    /* Fence of the frame that last rendered into the image. */
+    VkFence *image_fences;
+
+    uint32_t frame_count;
+    zvar_frame_t *frames;
+
+    uint32_t frame_index;
+    uint32_t image_index;
+    uint64_t frame_number;
+
+    bool needs_recreation;
+    uint32_t recreation_count;
+} zvar_frame_loop_t;
+
+/* When the surface has no area yet the clique gets created by the first zvar_begin_frame that can. */
+void zvar_create_frame_loop(const zvar_frame_loop_create_info_t *info, zvar_frame_loop_t *loop);
+
+void zvar_destroy_frame_loop(zvar_frame_loop_t *loop);
+
+/* Waits for the frame slot, acquires the next image and begins the frame's command buffer.
+ * `width` and `height` are used when the clique has to be recreated and the surface doesn't dictate the extent.
+ * Returns NULL when there is nothing to render into, for example with a minimized window. Skip the frame then.
+ */
+VkCommandBuffer zvar_begin_frame(zvar_frame_loop_t *loop, uint32_t width, uint32_t height);
+
+/* Ends the command buffer, submits it and presents the image. */
+void zvar_end_frame(zvar_frame_loop_t *loop);
+
+/* Makes the next zvar_begin_frame recreate the clique, for example after a window resize. */
+void zvar_invalidate_frame_loop(zvar_frame_loop_t *loop);
+
+
+/* Pipeline cache persisted on disk.
+ * The file is memory mapped on load and its header is checked against the physical device
+ * (vendorID, deviceID and pipelineCacheUUID) along with its size and hash before the driver sees it.
+ * Anything that doesn't match is ignored and the cache starts empty.
+ */
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+
+    /* NULL keeps the cache in memory only. */
+    const char *path;
+} zvar_pipeline_cache_create_info_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkPipelineCache cache;
+    char *path;
+
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint8_t uuid[VK_UUID_SIZE];
+
+    /* Zero when nothing usable was on disk. */
+    size_t loaded_size;
+    size_t saved_size;
+
+    uint64_t load_time_ns;
+    uint64_t save_time_ns;
+} zvar_pipeline_cache_t;
+
+void zvar_create_pipeline_cache(const zvar_pipeline_cache_create_info_t *info, zvar_pipeline_cache_t *cache);
+
+/* Saves the cache before destroying it. */
+void zvar_destroy_pipeline_cache(zvar_pipeline_cache_t *cache);
+
+/* An empty cache for one worker thread so threads don't contend on the main one.
+ * Merge it back with zvar_merge_pipeline_caches and destroy it with vkDestroyPipelineCache.
+ */
+VkPipelineCache zvar_create_worker_pipeline_cache(const zvar_pipeline_cache_t *cache);
+
+void zvar_merge_pipeline_caches(zvar_pipeline_cache_t *cache, uint32_t worker_cache_count, const VkPipelineCache *worker_caches);
+
+/* Writes to a temporary file and renames it over the old one. */
+bool zvar_save_pipeline_cache(zvar_pipeline_cache_t *cache);
+
+
+/* Shader library.
+ * SPIR-V files are memory mapped and never copied. Shaders are deduplicated by content hash,
+ * so identical SPIR-V shares one reference counted VkShaderModule, and paths that were seen before
+ * don't touch the file system again.
+ * With `chain_shader_code` (requires VK_KHR_maintenance5) no modules are created at all
+ * and the code is chained into VkPipelineShaderStageCreateInfo instead.
+ * Not thread safe, calls on the same library have to be externally synchronized.
+ */
+
+typedef struct
+{
+    VkDevice device;
+    bool chain_shader_code;
+} zvar_shader_library_create_info_t;
+
+typedef struct
+{
+    uint64_t hash;
+    const uint32_t *code;
+    size_t size;
+
+    /* internal, NULL for caller owned code */
+    void *file;
+
+    /* VK_NULL_HANDLE when chaining. */
+    VkShaderModule module;
+
+    /* Zero for unused entries. */
+    uint32_t reference_count;
+    uint32_t next;
+} zvar_shader_t;
+
+typedef struct
+{
+    uint64_t hash;
+    char *path;
+    uint32_t shader;
+    uint32_t next;
+} zvar_shader_path_t;
+
+typedef struct
+{
+    VkDevice device;
+    bool chain_shader_code;
+
+    uint32_t shader_count, shader_capacity;
+    zvar_shader_t *shaders;
+    uint32_t free_shaders;
+
+    uint32_t path_count, path_capacity;
+    zvar_shader_path_t *paths;
+    uint32_t free_paths;
+
+    uint32_t bucket_count;
+    uint32_t *shader_buckets;
+    uint32_t *path_buckets;
+
+    /* statistics */
+    uint32_t live_shader_count;
+    uint64_t mapped_file_count;
+    uint64_t shared_count;
+} zvar_shader_library_t;
+
+void zvar_create_shader_library(const zvar_shader_library_create_info_t *info, zvar_shader_library_t *library);
+
+/* Every shader has to be released and unused by pending pipeline creation. */
+void zvar_destroy_shader_library(zvar_shader_library_t *library);
+
+/* Returns a reference to the shader or ZVAR_NO_INDEX when the file can't be read or isn't SPIR-V. */
+uint32_t zvar_load_shader(zvar_shader_library_t *library, const char *path);
+
+/* `code` is not copied and has to outlive the shader. */
+uint32_t zvar_add_shader(zvar_shader_library_t *library, size_t size, const void *code);
+
+void zvar_release_shader(zvar_shader_library_t *library, uint32_t shader);
+
+/* `chained_code` is storage for the chained VkShaderModuleCreateInfo and has to live until the pipeline is created. */
+VkPipelineShaderStageCreateInfo zvar_get_shader_stage(const zvar_shader_library_t *library, uint32_t shader, VkShaderStageFlagBits stage, const char *entry_point,
+                                                      VkShaderModuleCreateInfo *chained_code);
+
+
+/* host allocators
+ * Ready-made VkAllocationCallbacks, pass `&allocator.callbacks` through the create infos.
+ * They are safe to call from any thread, like Vulkan requires.
+ */
+
+#define ZVAR_HOST_POOL_CLASS_COUNT  8
+#define ZVAR_HOST_SCOPE_COUNT       (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+
+/* Power of two size classes from 64 bytes to 8 KiB carved out of 64 KiB slabs, bigger allocations go to malloc. */
+typedef struct
+{
+    VkAllocationCallbacks callbacks;
+
+    long lock;
+    void *free_lists[ZVAR_HOST_POOL_CLASS_COUNT];
+    void *slabs;
+
+    /* statistics */
+    uint64_t slab_count;
+    uint64_t pooled_count;
+    uint64_t large_count;
+} zvar_pool_host_allocator_t;
+
+void zvar_create_pool_host_allocator(zvar_pool_host_allocator_t *allocator);
+
+/* Everything allocated through it has to be freed already. */
+void zvar_destroy_pool_host_allocator(zvar_pool_host_allocator_t *allocator);
+
+
+typedef struct
+{
+    /* Allocations with a scope up to this one are bumped out of the arena. */
+    VkSystemAllocationScope max_scope;
+    /* Used for the other scopes, NULL uses malloc. */
+    const VkAllocationCallbacks *fallback;
+    /* 0 picks 256 KiB. */
+    size_t chunk_size;
+} zvar_arena_host_allocator_create_info_t;
+
+typedef struct
+{
+    VkAllocationCallbacks callbacks;
+
+    VkSystemAllocationScope max_scope;
+    const VkAllocationCallbacks *fallback;
+    size_t chunk_size;
+
+    long lock;
+    void *chunks;
+    void *current_chunk;
+    size_t used;
+
+    /* statistics */
+    uint64_t used_bytes;
+    uint64_t peak_bytes;
+} zvar_arena_host_allocator_t;
+
+void zvar_create_arena_host_allocator(const zvar_arena_host_allocator_create_info_t *info, zvar_arena_host_allocator_t *allocator);
+
+void zvar_destroy_arena_host_allocator(zvar_arena_host_allocator_t *allocator);
+
+/* Frees are no-ops inside the arena, resetting reclaims all of it at once.
+ * No Vulkan call using the callbacks may be running and nothing allocated from the arena may still be alive,
+ * which holds for command scope allocations between frames.
+ */
+void zvar_reset_arena_host_allocator(zvar_arena_host_allocator_t *allocator);
+
+
+typedef struct
+{
+    uint64_t allocations[ZVAR_HOST_SCOPE_COUNT];
+    uint64_t reallocations[ZVAR_HOST_SCOPE_COUNT];
+    uint64_t allocated_bytes[ZVAR_HOST_SCOPE_COUNT];
+    uint64_t frees;
+
+    /* Driver allocations that bypass the callbacks and are only reported. */
+    uint64_t internal_allocations[ZVAR_HOST_SCOPE_COUNT];
+    uint64_t internal_allocated_bytes[ZVAR_HOST_SCOPE_COUNT];
+    uint64_t internal_frees;
+} zvar_host_allocation_counts_t;
+
+/* Counts host allocations by VkSystemAllocationScope and forwards them to `parent`. */
+typedef struct
+{
+    VkAllocationCallbacks callbacks;
+
+    /* NULL uses malloc. */
+    const VkAllocationCallbacks *parent;
+
+    zvar_host_allocation_counts_t counts;
+} zvar_counting_host_allocator_t;
+
+void zvar_create_counting_host_allocator(const VkAllocationCallbacks *parent, zvar_counting_host_allocator_t *allocator);
+
+/* Copies the counts gathered since the last call and starts over, call it once a frame for per-frame numbers. */
+void zvar_take_host_allocation_counts(zvar_counting_host_allocator_t *allocator, zvar_host_allocation_counts_t *counts);
+
+
+/* GPU profiler.
+ * Zones write a timestamp query at their begin and end. Queries live in a ring of frames in flight
+ * and a frame is read back only when its slot comes around again, so reading never waits on the GPU.
+ */
+
+#define ZVAR_PROFILER_WINDOW 64
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+    /* Family the zones get recorded on, it has to support timestamps. */
+    uint32_t queue_family_index;
+
+    /* Has to match the frames in flight of the frame loop, results are read that many frames later. */
+    uint32_t frames_in_flight;
+    /* 0 picks 64. */
+    uint32_t max_zones_per_frame;
+} zvar_profiler_create_info_t;
+
+typedef struct
+{
+    const char *name;
+
+    /* Milliseconds spent in the zone per frame over the last ZVAR_PROFILER_WINDOW frames. */
+    double samples[ZVAR_PROFILER_WINDOW];
+    uint32_t sample_count;
+    uint32_t next_sample;
+
+    uint64_t frame_ticks;
+    bool touched;
+} zvar_profiler_zone_t;
+
+typedef struct
+{
+    uint32_t zone;
+    bool ended;
+} zvar_profiler_record_t;
+
+typedef struct
+{
+    uint32_t zone;
+    uint64_t frame_number;
+    uint64_t begin_ns;
+    uint64_t duration_ns;
+} zvar_profiler_event_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkQueryPool query_pool;
+
+    double ns_per_tick;
+    uint64_t timestamp_mask;
+
+    uint32_t frames_in_flight;
+    uint32_t max_zones_per_frame;
+
+    uint64_t frame_number;
+    uint32_t frame_slot;
+    uint32_t *record_counts;
+    zvar_profiler_record_t *records;
+
+    uint32_t zone_count, zone_capacity;
+    zvar_profiler_zone_t *zones;
+
+    bool tracing;
+    bool has_trace_origin;
+    uint64_t trace_origin;
+    uint32_t event_count, event_capacity;
+    zvar_profiler_event_t *events;
+
+    /* statistics */
+    uint64_t resolved_zone_count;
+    uint64_t dropped_zone_count;
+} zvar_profiler_t;
+
+typedef struct
+{
+    const char *name;
+    double min_ms;
+    double avg_ms;
+    double max_ms;
+    double last_ms;
+    uint32_t sample_count;
+} zvar_profiler_report_t;
+
+/* Returns false when the queue family doesn't support timestamps. */
+bool zvar_create_profiler(const zvar_profiler_create_info_t *info, zvar_profiler_t *profiler);
+
+/* The device has to be done with every recorded frame. */
+void zvar_destroy_profiler(zvar_profiler_t *profiler);
+
+/* Reads back the frame that used the slot before and resets its queries.
+ * Call it first thing in the frame's command buffer, outside of a render pass, once the slot's fence has signaled.
+ */
+void zvar_begin_profiler_frame(zvar_profiler_t *profiler, VkCommandBuffer command_buffer);
+
+/* `name` identifies the zone and has to outlive the profiler, a string literal for example.
+ * Returns what to pass to zvar_end_zone, zones nest.
+ */
+uint32_t zvar_begin_zone(zvar_profiler_t *profiler, VkCommandBuffer command_buffer, const char *name);
+
+void zvar_end_zone(zvar_profiler_t *profiler, VkCommandBuffer command_buffer, uint32_t record);
+
+/* Fills up to `capacity` reports and returns the number of zones. */
+uint32_t zvar_get_profiler_report(const zvar_profiler_t *profiler, uint32_t capacity, zvar_profiler_report_t *reports);
+
+/* Keeps every resolved zone from now on for zvar_write_profiler_trace. */
+void zvar_start_profiler_trace(zvar_profiler_t *profiler);
+
+/* Writes the zones kept since zvar_start_profiler_trace as Chrome trace JSON (chrome://tracing, Perfetto) and stops tracing. */
+bool zvar_write_profiler_trace(zvar_profiler_t *profiler, const char *path);
+
+
+/* CPU side instrumentation.
+ * Build zvar with ZVAR_INSTRUMENT defined to count calls and wall time of the entry points below,
+ * device memory allocated per memory type and the peak per-thread scratch size.
+ * Without it the hooks compile to nothing and the snapshot stays zero.
+ */
+
+#define ZVAR_COUNTERS(X) \
+    X(CREATE_INSTANCE,                  "zvar_create_instance") \
+    X(CHOOSE_PHYSICAL_DEVICE,           "zvar_choose_physical_device") \
+    X(CREATE_DEVICE,                    "zvar_create_device") \
+    X(FIND_SURFACE_FORMAT,              "zvar_find_surface_format") \
+    X(FIND_DEPTH_FORMAT,                "zvar_find_depth_format") \
+    X(CREATE_SWAPCHAIN_CLIQUE,          "zvar_create_swapchain_clique") \
+    X(CREATE_OFFSCREEN_CLIQUE,          "zvar_create_offscreen_clique") \
+    X(CREATE_COMMAND_POOL,              "zvar_create_command_pool") \
+    X(ALLOCATE_COMMAND_BUFFERS,         "zvar_allocate_command_buffers") \
+    X(CREATE_SEMAPHORE,                 "zvar_create_semaphore") \
+    X(CREATE_FENCE,                     "zvar_create_fence") \
+    X(CREATE_SHADER_MODULE,             "zvar_create_shader_module") \
+    X(CREATE_BUFFER,                    "zvar_create_buffer_exclusive") \
+    X(CREATE_IMAGE,                     "zvar_create_2d_image_exclusive") \
+    X(CREATE_IMAGE_VIEW,                "zvar_create_2d_image_view") \
+    X(ALLOCATE_MEMORY,                  "zvar_allocate_memory") \
+    X(BEGIN_ONE_OFF_COMMAND_BUFFER,     "zvar_begin_one_off_command_buffer") \
+    X(FINISH_ONE_OFF_COMMAND_BUFFER,    "zvar_finish_one_off_command_buffer") \
+    X(SUBALLOCATE_MEMORY,               "zvar_suballocate_memory") \
+    X(FREE_SUBALLOCATION,               "zvar_free_suballocation") \
+    X(SUBMIT_UPLOADS,                   "zvar_submit_uploads") \
+    X(WAIT_FOR_UPLOAD,                  "zvar_wait_for_upload") \
+    X(ALLOCATE_STAGING_SLICE,           "zvar_allocate_staging_slice") \
+    X(ACQUIRE_FENCE,                    "zvar_acquire_fence") \
+    X(ACQUIRE_SEMAPHORE,                "zvar_acquire_semaphore") \
+    X(BEGIN_FRAME,                      "zvar_begin_frame") \
+    X(END_FRAME,                        "zvar_end_frame") \
+    X(SAVE_PIPELINE_CACHE,              "zvar_save_pipeline_cache") \
+    X(LOAD_SHADER,                      "zvar_load_shader") \
+    X(ALLOCATE_DESCRIPTOR_SET,          "zvar_allocate_descriptor_set") \
+    X(FLUSH_BINDLESS_WRITES,            "zvar_flush_bindless_writes") \
+    X(FLUSH_BARRIERS,                   "zvar_flush_barriers") \
+    X(RECORD_PARALLEL,                  "zvar_record_parallel")
+
+typedef enum
+{
+#define X(counter, name) ZVAR_COUNTER_##counter,
+    ZVAR_COUNTERS(X)
+#undef X
+
+    ZVAR_COUNTER_COUNT,
+} zvar_counter_t;
+
+typedef struct
+{
+    uint64_t count;
+    /* Includes time spent in nested zvar calls. */
+    uint64_t time_ns;
+} zvar_call_counter_t;
+
+typedef struct
+{
+    zvar_call_counter_t calls[ZVAR_COUNTER_COUNT];
+
+    uint64_t memory_type_allocation_counts[VK_MAX_MEMORY_TYPES];
+    uint64_t memory_type_bytes[VK_MAX_MEMORY_TYPES];
+
+    uint64_t peak_scratch_size;
+} zvar_instrumentation_t;
+
+const char *zvar_get_counter_name(zvar_counter_t counter);
+
+void zvar_get_instrumentation(zvar_instrumentation_t *snapshot);
+
+void zvar_reset_instrumentation(void);
+
+
+/* Capability snapshot.
+ * Layers, extensions, features, format properties and queue families are enumerated once,
+ * per process for the instance and per physical device, and zvar answers every later query from the snapshot.
+ * Snapshots are immutable and stay valid until zvar_free_capabilities, getting them is thread safe.
+ * A cache file lets repeat launches skip the enumeration, device snapshots from it are matched by
+ * vendor, device, driver version and pipeline cache UUID. A snapshot from the cache that misses
+ * a requested layer or extension is enumerated again before zvar gives up on it.
+ * Device snapshots belong to the instance of their physical device, zvar_destroy_instance unbinds them
+ * and a later instance matches them again the same way.
+ */
+
+/* Core formats, up to VK_FORMAT_ASTC_12x12_SRGB_BLOCK. Extension formats are queried every time. */
+#define ZVAR_CORE_FORMAT_COUNT 185
+
+typedef struct
+{
+    char name[VK_MAX_EXTENSION_NAME_SIZE];
+    uint32_t spec_version;
+
+    /* internal */
+    uint64_t hash;
+    uint32_t next;
+} zvar_capability_name_t;
+
+typedef struct
+{
+    uint32_t count;
+    zvar_capability_name_t *names;
+
+    /* Power of two, chained through `next`. */
+    uint32_t bucket_count;
+    uint32_t *buckets;
+} zvar_capability_names_t;
+
+typedef struct
+{
+    uint32_t api_version;
+    zvar_capability_names_t layers;
+    zvar_capability_names_t extensions;
+
+    /* Read from a cache file, may be missing things installed since. */
+    bool from_cache;
+} zvar_instance_capabilities_t;
+
+typedef struct
+{
+    /* VK_NULL_HANDLE for snapshots from a cache file or a destroyed instance no physical device has matched yet. */
+    VkPhysicalDevice physical_device;
+
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    zvar_capability_names_t extensions;
+
+    /* All zero when neither Vulkan 1.1 nor VK_KHR_get_physical_device_properties2 is there to ask. */
+    uint8_t device_uuid[VK_UUID_SIZE];
+
+    uint32_t queue_family_count;
+    VkQueueFamilyProperties *queue_families;
+
+    /* Indexed by VkFormat. */
+    VkFormatProperties format_properties[ZVAR_CORE_FORMAT_COUNT];
+
+    bool from_cache;
+
+    /* internal */
+    void *instance_key;
+} zvar_device_capabilities_t;
+
+/* Initializes volk when needed. Returns NULL when the enumeration fails. */
+const zvar_instance_capabilities_t *zvar_get_instance_capabilities(void);
+
+const zvar_device_capabilities_t *zvar_get_device_capabilities(VkPhysicalDevice physical_device);
+
+/* Returns the index of `name` or ZVAR_NO_INDEX. */
+uint32_t zvar_find_capability_name(const zvar_capability_names_t *names, const char *name);
+
+VkFormatProperties zvar_get_format_properties(VkPhysicalDevice physical_device, VkFormat format);
+
+/* Call before anything else in zvar, snapshots that already exist are kept.
+ * Returns false when the file is missing, corrupt or written by a different build.
+ */
+bool zvar_load_capabilities(const char *path);
+
+/* Writes every snapshot taken so far. */
+bool zvar_save_capabilities(const char *path);
+
+/* Invalidates every snapshot returned before. */
+void zvar_free_capabilities(void);
+
+
+/* Physical device selection.
+ * Devices that can't do what is required are rejected, the rest get scored by type first,
+ * then by the biggest device local heap, dedicated compute and transfer families and a few limits,
+ * plus whatever the callback adds. The preferred device wins over any score as long as it isn't rejected.
+ */
+
+/* Added to the score, a negative return rejects the device. */
+typedef int64_t (*zvar_device_score_callback_t)(const zvar_device_capabilities_t *capabilities, void *user_data);
+
+typedef struct
+{
+    VkInstance instance;
+    /* Can be VK_NULL_HANDLE, otherwise a graphics family has to be able to present to it. */
+    VkSurfaceKHR surface;
+
+    VkPhysicalDeviceFeatures required_features;
+
+    uint32_t required_extension_count;
+    char   **required_extensions;
+
+    /* VK_UUID_SIZE bytes compared with deviceUUID, can be NULL. */
+    const uint8_t *preferred_uuid;
+    /* Matches any device whose name contains it, can be NULL. */
+    const char *preferred_name;
+
+    zvar_device_score_callback_t score_callback;
+    void *user_data;
+} zvar_device_selection_info_t;
+
+/* Returns -1 for a rejected device. */
+int64_t zvar_score_physical_device(const zvar_device_selection_info_t *info, VkPhysicalDevice physical_device);
+
+/* Returns VK_NULL_HANDLE when every device is rejected, ties go to the first enumerated. */
+VkPhysicalDevice zvar_choose_physical_device(const zvar_device_selection_info_t *info);
+
+
+/* Descriptor allocator.
+ * Sets come out of a list of pools per frame in flight, a pool that runs out is put aside and the next one is used,
+ * creating a bigger one when there is none left. A frame's pools are reset in bulk when it comes around again
+ * and get reused, so the steady state creates no pools and frees no sets one by one.
+ * Not thread safe, calls on the same allocator have to be externally synchronized.
+ */
+
+#define ZVAR_MAX_DESCRIPTOR_POOL_SIZES 11
+
+typedef struct
+{
+    VkDescriptorType type;
+    /* Descriptors of the type per set, a pool gets room for this times its set count. */
+    float per_set;
+} zvar_descriptor_pool_ratio_t;
+
+typedef struct
+{
+    VkDevice device;
+    /* Zero means 2. */
+    uint32_t frame_count;
+    /* Sets in each frame's first pool, later pools grow by half up to 4096. Zero means 64. */
+    uint32_t sets_per_pool;
+    /* Zero uses a mix of samplers, images, and uniform and storage buffers. */
+    uint32_t ratio_count;
+    const zvar_descriptor_pool_ratio_t *ratios;
+} zvar_descriptor_allocator_create_info_t;
+
+typedef struct
+{
+    /* The last one is allocated from. */
+    uint32_t ready_count, ready_capacity;
+    VkDescriptorPool *ready;
+
+    /* Ran out, reset with the frame. */
+    uint32_t full_count, full_capacity;
+    VkDescriptorPool *full;
+} zvar_descriptor_frame_t;
+
+typedef struct
+{
+    VkDevice device;
+
+    uint32_t ratio_count;
+    zvar_descriptor_pool_ratio_t ratios[ZVAR_MAX_DESCRIPTOR_POOL_SIZES];
+
+    /* Sets the next created pool gets room for. */
+    uint32_t sets_per_pool;
+
+    uint32_t frame_index;
+    uint32_t frame_count;
+    zvar_descriptor_frame_t *frames;
+
+    uint64_t pool_count;
+    uint64_t allocated_count;
+} zvar_descriptor_allocator_t;
+
+void zvar_create_descriptor_allocator(const zvar_descriptor_allocator_create_info_t *info, zvar_descriptor_allocator_t *allocator);
+
+/* The device has to be done with every set. */
+void zvar_destroy_descriptor_allocator(zvar_descriptor_allocator_t *allocator);
+
+/* Moves on to the next frame and resets its pools, the device has to be done with the sets allocated for it last time.
+ * An allocator for long lived sets just never calls this.
+ */
+void zvar_begin_descriptor_frame(zvar_descriptor_allocator_t *allocator);
+
+/* Valid until the current frame comes around again.
+ * `variable_count` is the descriptor count of a variable sized last binding, zero when there is none.
+ */
+VkDescriptorSet zvar_allocate_descriptor_set(zvar_descriptor_allocator_t *allocator, VkDescriptorSetLayout layout, uint32_t variable_count);
+
+
+/* Bindless descriptor table.
+ * One update after bind set holding big arrays of sampled images, storage buffers and samplers,
+ * bound once per command buffer while shaders pick resources by index:
+ *     layout(set = 0, binding = 0) uniform texture2D images[];
+ *     layout(set = 0, binding = 1) buffer Buffers { uint data[]; } buffers[];
+ *     layout(set = 0, binding = 2) uniform sampler samplers[];
+ * The device needs Vulkan 1.2's descriptor indexing or VK_EXT_descriptor_indexing turned on,
+ * asking for VK_EXT_descriptor_indexing as an optional device extension enables the features used here.
+ * Not thread safe, calls on the same table have to be externally synchronized.
+ */
+
+typedef enum
+{
+    ZVAR_BINDLESS_SAMPLED_IMAGE,
+    ZVAR_BINDLESS_STORAGE_BUFFER,
+    ZVAR_BINDLESS_SAMPLER,
+
+    ZVAR_BINDLESS_BINDING_COUNT,
+} zvar_bindless_binding_t;
+
+typedef struct
+{
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    /* Zero means VK_SHADER_STAGE_ALL. */
+    VkShaderStageFlags stage_flags;
+    /* Zero picks a default, everything gets clamped to the device's update after bind limits. */
+    uint32_t capacities[ZVAR_BINDLESS_BINDING_COUNT];
+} zvar_bindless_create_info_t;
+
+typedef struct
+{
+    VkDescriptorType type;
+    uint32_t binding;
+    uint32_t index;
+
+    union
+    {
+        VkDescriptorImageInfo image;
+        VkDescriptorBufferInfo buffer;
+    };
+} zvar_bindless_write_t;
+
+typedef struct
+{
+    uint32_t capacity;
+    /* Indices below it have been handed out at some point. */
+    uint32_t used_count;
+
+    uint32_t free_count, free_capacity;
+    uint32_t *free;
+} zvar_bindless_slots_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkDescriptorPool pool;
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet set;
+
+    zvar_bindless_slots_t slots[ZVAR_BINDLESS_BINDING_COUNT];
+
+    /* Queued until the next flush. */
+    uint32_t write_count, write_capacity;
+    zvar_bindless_write_t *writes;
+} zvar_bindless_table_t;
+
+/* Returns false when the device can't do update after bind. */
+bool zvar_create_bindless_table(const zvar_bindless_create_info_t *info, zvar_bindless_table_t *table);
+
+/* The device has to be done with the set. */
+void zvar_destroy_bindless_table(zvar_bindless_table_t *table);
+
+/* Return the index for the shaders, or ZVAR_NO_INDEX when the array is full.
+ * The descriptor gets written on the next flush.
+ */
+uint32_t zvar_add_bindless_image(zvar_bindless_table_t *table, VkImageView view, VkImageLayout layout);
+uint32_t zvar_add_bindless_buffer(zvar_bindless_table_t *table, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+uint32_t zvar_add_bindless_sampler(zvar_bindless_table_t *table, VkSampler sampler);
+
+/* The index gets handed out again, work still in flight must not be using it. */
+void zvar_remove_bindless(zvar_bindless_table_t *table, zvar_bindless_binding_t binding, uint32_t index);
+
+/* Writes every queued descriptor with a single update, call before submitting work that uses them.
+ * Descriptors that aren't used by work in flight can be written while the set is bound.
+ */
+void zvar_flush_bindless_writes(zvar_bindless_table_t *table);
+
+void zvar_bind_bindless_table(zvar_bindless_table_t *table, VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index);
+
+
+/* Barrier tracker.
+ * Remembers the last layout, stages and access of every tracked image subresource and buffer,
+ * and turns each use into the barrier it needs, if any: reads after reads need none, reads wait for the last write
+ * only until it is visible to them, and writes wait for the reads and the write before.
+ * Barriers queue up until zvar_flush_barriers, so uses requested back to back end up in one vkCmdPipelineBarrier2.
+ * Uses have to be requested in the order the GPU executes them, across command buffers too.
+ * Needs the synchronization2 feature, zvar_create_device turns it on when VK_KHR_synchronization2 is among the optional
+ * device extensions, through Vulkan 1.3 where the device has it. zvar_flush_barriers asserts it is on.
+ * Not thread safe, calls on the same tracker have to be externally synchronized.
+ */
+
+typedef struct
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    /* Ignored for buffers. */
+    VkImageLayout layout;
+} zvar_resource_use_t;
+
+typedef struct
+{
+    VkImageLayout layout;
+
+    /* Last write, every later use waits for it. */
+    VkPipelineStageFlags2 write_stages;
+    VkAccessFlags2 write_access;
+
+    /* Reads since the last write, the next write waits for them. */
+    VkPipelineStageFlags2 read_stages;
+
+    /* Where the last write has been made visible already. */
+    VkPipelineStageFlags2 visible_stages;
+    VkAccessFlags2 visible_access;
+
+    /* Matches the tracker's while a queued barrier covers the subresource. */
+    uint64_t batch;
+} zvar_resource_state_t;
+
+typedef struct
+{
+    VkImage image;
+    VkImageAspectFlags aspect;
+    uint32_t mip_level_count;
+    uint32_t array_layer_count;
+
+    /* Mip major, points to `state` for a single subresource. */
+    zvar_resource_state_t *states;
+    zvar_resource_state_t state;
+} zvar_tracked_image_t;
+
+typedef struct
+{
+    VkBuffer buffer;
+    zvar_resource_state_t state;
+} zvar_tracked_buffer_t;
+
+typedef struct
+{
+    uint64_t batch;
+
+    uint32_t image_barrier_count, image_barrier_capacity;
+    VkImageMemoryBarrier2 *image_barriers;
+
+    uint32_t buffer_barrier_count, buffer_barrier_capacity;
+    VkBufferMemoryBarrier2 *buffer_barriers;
+
+    uint64_t barrier_count;
+    uint64_t flush_count;
+} zvar_barrier_tracker_t;
+
+void zvar_create_barrier_tracker(zvar_barrier_tracker_t *tracker);
+
+void zvar_destroy_barrier_tracker(zvar_barrier_tracker_t *tracker);
+
+/* `layout` is the one every subresource is in, VK_IMAGE_LAYOUT_UNDEFINED for a freshly created image.
+ * The tracked image must not be moved once uses have been requested, use zvar_free_tracked_image before it goes.
+ */
+void zvar_track_image(zvar_tracked_image_t *tracked, VkImage image, VkImageAspectFlags aspect, uint32_t mip_level_count, uint32_t array_layer_count, VkImageLayout layout);
+
+void zvar_free_tracked_image(zvar_tracked_image_t *tracked);
+
+void zvar_track_buffer(zvar_tracked_buffer_t *tracked, VkBuffer buffer);
+
+/* Queues what the use needs, a subresource already covered by a queued barrier flushes the queue into `command_buffer` first.
+ * VK_REMAINING_MIP_LEVELS and VK_REMAINING_ARRAY_LAYERS work, the aspect of the range is ignored.
+ */
+void zvar_use_image(zvar_barrier_tracker_t *tracker, VkCommandBuffer command_buffer, zvar_tracked_image_t *tracked, const VkImageSubresourceRange *range, const zvar_resource_use_t *use);
+
+void zvar_use_buffer(zvar_barrier_tracker_t *tracker, VkCommandBuffer command_buffer, zvar_tracked_buffer_t *tracked, const zvar_resource_use_t *use);
+
+/* Records every queued barrier with a single vkCmdPipelineBarrier2, call before the commands doing the uses. */
+void zvar_flush_barriers(zvar_barrier_tracker_t *tracker, VkCommandBuffer command_buffer);
+
+
+/* Frame graph.
+ * Passes declare the images and buffers they use and get added in the order they run.
+ * Compiling culls the passes whose results nothing uses, splits the rest into batches per queue family,
+ * and places transient images whose lifetimes don't overlap in the same device memory.
+ * Recording a batch derives every barrier through a barrier tracker, queue family ownership transfers between batches included.
+ * Batches have to be submitted in order, a batch on another queue than the one before waits on it with a semaphore.
+ * Imported resources have to be owned by the queue family of their first use when the first batch gets recorded.
+ * Graph images are 2D with a single mip level and array layer.
+ * Needs synchronization2, like the barrier tracker. Not thread safe.
+ */
+
+#define ZVAR_GRAPH_MAX_PASS_ACCESSES 16
+
+typedef void (*zvar_graph_execute_t)(VkCommandBuffer command_buffer, void *user_data);
+
+typedef struct
+{
+    VkFormat format;
+    uint32_t width, height;
+    /* On top of what the uses need. */
+    VkImageUsageFlags usage;
+} zvar_graph_image_info_t;
+
+typedef struct
+{
+    uint32_t resource;
+    /* Access with read bits makes the pass depend on earlier writes, one without only overwrites. */
+    zvar_resource_use_t use;
+} zvar_graph_access_t;
+
+typedef struct
+{
+    uint32_t queue_family_index;
+    /* Kept even when nothing uses what it writes. */
+    bool side_effects;
+
+    zvar_graph_execute_t execute;
+    void *user_data;
+
+    uint32_t access_count;
+    zvar_graph_access_t accesses[ZVAR_GRAPH_MAX_PASS_ACCESSES];
+} zvar_graph_pass_t;
+
+typedef struct
+{
+    bool imported;
+    bool is_buffer;
+
+    zvar_graph_image_info_t image_info;
+    VkImageAspectFlags aspect;
+    VkImageLayout initial_layout;
+
+    VkImage image;
+    VkImageView view;
+    VkBuffer buffer;
+
+    /* Imported resources get into it at the end of the last batch. */
+    bool has_final_use;
+    zvar_resource_use_t final_use;
+
+    zvar_tracked_image_t tracked_image;
+    zvar_tracked_buffer_t tracked_buffer;
+    /* Owner as of the last recorded use, VK_QUEUE_FAMILY_IGNORED before the first. */
+    uint32_t queue_family_index;
+
+    /* Positions in the compiled pass order, ZVAR_NO_INDEX when no pass that survived culling uses it. */
+    uint32_t first_use, last_use;
+
+    /* Transient images only. */
+    uint32_t memory_index;
+    VkDeviceSize memory_offset;
+    VkMemoryRequirements memory_requirements;
+
+    /* Transient images sharing memory with this one, itself included. */
+    uint32_t overlap_count, overlap_capacity;
+    uint32_t *overlaps;
+} zvar_graph_resource_t;
+
+typedef struct
+{
+    uint32_t queue_family_index;
+    /* Range of the compiled pass order. */
+    uint32_t first_pass, pass_count;
+} zvar_graph_batch_t;
+
+typedef struct
+{
+    uint32_t resource;
+    uint32_t src_queue_family_index, dst_queue_family_index;
+    /* Released at the end of this batch, acquired before the pass at `acquire_pass`. */
+    uint32_t release_batch;
+    uint32_t acquire_pass;
+    zvar_resource_use_t use;
+} zvar_graph_transfer_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties *physical_device_memory_properties;
+} zvar_frame_graph_create_info_t;
+
+typedef struct
+{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties *physical_device_memory_properties;
+
+    uint32_t pass_count, pass_capacity;
+    zvar_graph_pass_t *passes;
+
+    uint32_t resource_count, resource_capacity;
+    zvar_graph_resource_t *resources;
+
+    /* Filled in by zvar_compile_frame_graph. */
+    bool compiled;
+
+    /* Passes that survived culling. */
+    uint32_t order_count, order_capacity;
+    uint32_t *order;
+
+    uint32_t batch_count, batch_capacity;
+    zvar_graph_batch_t *batches;
+
+    uint32_t transfer_count, transfer_capacity;
+    zvar_graph_transfer_t *transfers;
+
+    uint32_t memory_count, memory_capacity;
+    VkDeviceMemory *memories;
+
+    /* Device memory the transient images would take one allocation each, and what they take aliased. */
+    VkDeviceSize unaliased_size;
+    VkDeviceSize aliased_size;
+
+    zvar_barrier_tracker_t tracker;
+} zvar_frame_graph_t;
+
+void zvar_create_frame_graph(const zvar_frame_graph_create_info_t *info, zvar_frame_graph_t *graph);
+
+/* The device has to be done with every batch. */
+void zvar_destroy_frame_graph(zvar_frame_graph_t *graph);
+
+/* The functions adding resources and passes return indices, all of them have to come before compiling. */
+uint32_t zvar_add_graph_image(zvar_frame_graph_t *graph, const zvar_graph_image_info_t *info);
+
+/* `final_use` can be NULL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR with no stages or access for a swapchain image for example. */
+uint32_t zvar_import_graph_image(zvar_frame_graph_t *graph, VkImage image, VkImageView view, VkImageAspectFlags aspect, VkImageLayout layout, const zvar_resource_use_t *final_use);
+
+uint32_t zvar_import_graph_buffer(zvar_frame_graph_t *graph, VkBuffer buffer, const zvar_resource_use_t *final_use);
+
+/* Swaps an imported image between recordings, the next swapchain image for example. `layout` is the one it is in. */
+void zvar_set_graph_image(zvar_frame_graph_t *graph, uint32_t resource, VkImage image, VkImageView view, VkImageLayout layout);
+
+uint32_t zvar_add_graph_pass(zvar_frame_graph_t *graph, const zvar_graph_pass_t *pass);
+
+/* Creates the transient images, they are there in `resources` afterwards. */
+void zvar_compile_frame_graph(zvar_frame_graph_t *graph);
+
+/* Records the barriers and the passes of a batch, every recording of the graph goes through the batches in order. */
+void zvar_record_graph_batch(zvar_frame_graph_t *graph, uint32_t batch_index, VkCommandBuffer command_buffer);
+
+
+/* Parallel command recording.
+ * Jobs record secondary command buffers on a pool of worker threads, the calling thread being worker 0.
+ * Every worker has a command pool per frame in flight, so recording never contends on a pool and a frame's pools are reset in bulk.
+ * The jobs get split into a range per worker, a worker that runs out steals half the remaining range of another.
+ * The secondaries are executed in the order of the jobs, no matter which worker recorded them.
+ * Not thread safe, calls on the same recorder have to be externally synchronized.
+ */
+
+typedef void (*zvar_record_callback_t)(VkCommandBuffer command_buffer, uint32_t worker_index, void *user_data);
+
+typedef struct
+{
+    zvar_record_callback_t record;
+    void *user_data;
+
+    /* Filled in by zvar_record_parallel. */
+    VkCommandBuffer command_buffer;
+} zvar_recording_job_t;
+
+typedef struct
+{
+    VkDevice device;
+    uint32_t queue_family_index;
+
+    /* Zero means 2, has to match the frame indices passed to zvar_begin_recording_frame. */
+    uint32_t frame_count;
+    /* Zero means one per logical processor. */
+    uint32_t worker_count;
+} zvar_parallel_recorder_create_info_t;
+
+typedef struct
+{
+    VkCommandPool command_pool;
+
+    /* Secondaries allocated so far, the first `used_count` are recorded in the current frame. */
+    uint32_t command_buffer_count, command_buffer_capacity;
+    VkCommandBuffer *command_buffers;
+    uint32_t used_count;
+} zvar_recording_pool_t;
+
+typedef struct zvar_worker_pool zvar_worker_pool_t;
+
+typedef struct
+{
+    VkDevice device;
+
+    uint32_t frame_count;
+    uint32_t worker_count;
+    uint32_t frame_index;
+
+    /* `worker_count` per frame, the pools of a frame are next to each other. */
+    zvar_recording_pool_t *pools;
+
+    zvar_worker_pool_t *workers;
+
+    uint64_t recorded_count;
+    /* Ranges taken over from another worker. */
+    uint64_t steal_count;
+} zvar_parallel_recorder_t;
+
+void zvar_create_parallel_recorder(const zvar_parallel_recorder_create_info_t *info, zvar_parallel_recorder_t *recorder);
+
+/* Joins the workers, the device has to be done with every secondary. */
+void zvar_destroy_parallel_recorder(zvar_parallel_recorder_t *recorder);
+
+/* Resets the pools of `frame_index`, the device has to be done with the secondaries recorded in them.
+ * After zvar_begin_frame that is the case for the frame loop's `frame_index`.
+ */
+void zvar_begin_recording_frame(zvar_parallel_recorder_t *recorder, uint32_t frame_index);
+
+/* Records every job into a secondary begun with `flags` and `inheritance`, returns once all of them are done.
+ * Secondaries drawn inside a render pass need VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+ * with dynamic rendering the inheritance chains a VkCommandBufferInheritanceRenderingInfo.
+ * Callbacks run concurrently, everything they touch besides their command buffer has to be safe to use from several threads.
+ */
+void zvar_record_parallel(zvar_parallel_recorder_t *recorder, VkCommandBufferUsageFlags flags, const VkCommandBufferInheritanceInfo *inheritance,
+                          uint32_t job_count, zvar_recording_job_t *jobs);
+
+/* Executes the recorded secondaries in job order. */
+void zvar_execute_recording_jobs(VkCommandBuffer command_buffer, uint32_t job_count, const zvar_recording_job_t *jobs);
+
 #endif // ZVAR_H_